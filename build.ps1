@@ -7,6 +7,7 @@ if($?){
         "main" {.\test\main.exe }
         "Lexer" { ctest --output-on-failure -R "LexerTest"}
         "Parser" { ctest --output-on-failure -R "ParserTest"}
+        "Bench" {.\test\lexer_bench.exe ; .\test\parser_bench.exe }
     }
 }
 cd ..
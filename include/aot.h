@@ -0,0 +1,30 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <expected>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+#include "codegen.h"
+#include "error.h"
+
+namespace tua{
+
+    // prefix of the symbols of an object written by compile_object
+    constexpr std::string_view AOT_PREFIX="tua_";
+
+    // lowers the functions of program lower() takes, runs the O2 pipeline
+    // and writes them to object_path as a relocatable object for the host,
+    // for a generic cpu so it runs on any machine of the same target.
+    // The functions keep the ABI of lower(), <prefix>fib and so on
+    std::expected<std::vector<Lowered>,Error*> compile_object(Program& program,std::string_view object_path);
+
+    // C++ declarations of the functions of an object, and for each one an
+    // inline tua::native::<name> returning nullopt where the VM would
+    // raise an error. A name that is a C++ keyword becomes <name>_
+    std::string cpp_header(const std::vector<Lowered>& lowered);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tua{
+
+    // bump allocator the AST nodes and their vectors come from. Nothing is
+    // freed on its own, destructors are not run: release() or destroying
+    // the arena gives back every block at once
+    class Arena{
+        public:
+            Arena():memory(INITIAL_SIZE){}
+            explicit Arena(std::size_t initial_size):memory(initial_size){}
+            Arena(const Arena&)=delete;
+            Arena& operator=(const Arena&)=delete;
+
+            template<typename T,typename... Args> T* make(Args&&... args){
+                return new(memory.allocate(sizeof(T),alignof(T))) T(std::forward<Args>(args)...);
+            }
+
+            std::string_view copy(std::string_view text){
+                if(text.empty()) return std::string_view();
+                auto data=static_cast<char*>(memory.allocate(text.size(),1));
+                std::memcpy(data,text.data(),text.size());
+                return std::string_view(data,text.size());
+            }
+
+            // other lives as long as this arena, so nodes made in several
+            // arenas can hang off one Program
+            void adopt(std::unique_ptr<Arena>&& other){adopted.push_back(std::move(other));}
+            // same for what nodes point to outside of the arena
+            void keep(std::shared_ptr<const void> owner){kept.push_back(std::move(owner));}
+
+            std::pmr::memory_resource* resource() noexcept {return &memory;}
+            void release() noexcept {
+                memory.release();
+                adopted.clear();
+                kept.clear();
+            }
+
+        private:
+            static constexpr std::size_t INITIAL_SIZE=1<<16;
+            std::pmr::monotonic_buffer_resource memory;
+            std::vector<std::unique_ptr<Arena>> adopted;
+            std::vector<std::shared_ptr<const void>> kept;
+    };
+};
+
+#endif
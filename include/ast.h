@@ -1,89 +1,142 @@
 #ifndef AST_H
 #define AST_H
 
-#include<string>
+#include<cstdint>
+#include<expected>
+#include<memory>
+#include<memory_resource>
+#include<string_view>
+#include<tuple>
+#include<type_traits>
 #include<vector>
 
+#include"arena.h"
+#include"error.h"
+#include"interner.h"
 #include"lexer.h"
+#include"node_kind.h"
 
 namespace tua{
 
-    using Type=std::string;
+    // a type name, NoIdent when there is none
+    using Type=IdentId;
 
+    // kind names the concrete type of the node, see AstVisitor and
+    // node_cast for getting it back without dynamic_cast
     struct Stmt{
+        Stmt(NodeKind kind):kind(kind){}
         virtual ~Stmt(){}
+        NodeKind kind;
     };
 
-    using Stmts=std::vector<Stmt*>;
+    // nullptr when node isn't a T, T has to be a concrete node type
+    template<typename T> T* node_cast(Stmt* node) noexcept {
+        return node && node->kind==T::Kind?static_cast<T*>(node):nullptr;
+    }
+
+    template<typename T> const T* node_cast(const Stmt* node) noexcept {
+        return node && node->kind==T::Kind?static_cast<const T*>(node):nullptr;
+    }
+
+    // nodes live in an Arena and are never deleted one by one, the vectors
+    // of a node allocate from the same arena
+    using Stmts=std::pmr::vector<Stmt*>;
 
     struct Expr:Stmt{
+        Expr(NodeKind kind):Stmt(kind){}
         virtual ~Expr(){}
+        // set by check_types(), NoIdent when it can only be known at run time
+        Type type=NoIdent;
+    };
+
+    using Exprs=std::pmr::vector<Expr*>;
+
+    // where resolve() found a name: a slot of the frame of the function
+    // using it (Local), of a function around it (Capture), the function
+    // itself (Self) or a global
+    enum class Scope : std::uint8_t { Unresolved, Local, Capture, Self, Global };
+
+    struct Resolution{
+        Scope scope=Scope::Unresolved;
+        // functions out from the one using the name, 0 for a Local
+        std::uint16_t depth=0;
+        // the slot in the frame of that function
+        std::uint16_t slot=0;
     };
 
     struct Symbol:Expr{
-        Symbol(std::string&& ident):ident_(std::move(ident)){}
+        static constexpr NodeKind Kind=NodeKind::Symbol;
+        Symbol(IdentId ident):Expr(Kind),ident_(ident){}
+        Symbol(std::string_view name):Expr(Kind),ident_(Interner::global().intern(name)){}
         Symbol(const Symbol&)=default;
         Symbol(Symbol&&)=default;
         Symbol& operator=(const Symbol&)=default;
         Symbol& operator=(Symbol&&)=default;
-        std::string ident_;
+        std::string_view name() const {return ident_name(ident_);}
+        IdentId ident_;
+        Resolution resolved;
         bool operator==(const Symbol lhs)const noexcept {return ident_==lhs.ident_;}
     };
 
-    using Params=std::vector<std::tuple<Symbol*,Type*>>;
+    // parameter name and type
+    using Params=std::pmr::vector<std::tuple<IdentId,Type>>;
+    // frame slots of a function that a function inside it captures
+    using Slots=std::pmr::vector<std::uint16_t>;
 
     struct Block:Stmt{
         public:
-            Block(Stmts&& stmts):stmts(std::move(stmts)){}
+            static constexpr NodeKind Kind=NodeKind::Block;
+            Block(Stmts&& stmts):Stmt(Kind),stmts(std::move(stmts)){}
             const Stmts& get_stmts() const noexcept {return stmts;}
-            virtual ~Block(){}
             Stmts stmts;
     };
 
+    // what a lazy parser needs to parse the bodies it skipped, shared by
+    // the functions it parsed into arena and kept alive by it. The lexer
+    // shares the source of the parser, a Lexer::view() source has to
+    // outlive the program
+    struct LazySource{
+        Lexer lexer;
+        Arena* arena;
+        std::uint32_t max_depth;
+    };
+
     struct ClassStmt:Stmt{
         public:
-            ClassStmt(Symbol* ident,Type* parent,Block* block):ident_(std::move(ident)),parent_(parent),block_(block){}
-            virtual ~ClassStmt(){}
+            static constexpr NodeKind Kind=NodeKind::ClassStmt;
+            ClassStmt(Symbol* ident,Type parent,Block* block):Stmt(Kind),ident_(std::move(ident)),parent_(parent),block_(block){}
             Symbol* ident_;
-            Type* parent_;
+            Type parent_;
             Block* block_;
     };
 
     struct FctDecl:Stmt{
-        FctDecl(Type* return_type,Symbol* name,Params&& params,Block* block):
-            ret_type_(return_type),ident_(name),params_(std::move(params)),block_(block){}
+        static constexpr NodeKind Kind=NodeKind::FctDecl;
+        FctDecl(Type return_type,Symbol* name,Params&& params,Block* block):
+            Stmt(Kind),ret_type_(return_type),ident_(name),params_(std::move(params)),block_(block),captured_(params_.get_allocator()){}
         FctDecl(const FctDecl&)=default;
         FctDecl(FctDecl&&)=default;
         FctDecl& operator=(const FctDecl&)=default;
         FctDecl& operator=(FctDecl&&)=default;
-        virtual ~FctDecl(){
-            if(! ret_type_){
-                delete ret_type_;
-            }
-
-            if(! block_){
-                delete block_;
-            }
-
-            if(! ident_){
-                delete ident_;
-            }
-        }
+        // block_ once the body is parsed, see Parser::use_lazy_bodies()
+        std::expected<Block*,Error*> body();
         Symbol* ident_;
-        Type* ret_type_;
+        Type ret_type_;
         Params params_ ;
+        // nullptr until body() when lazy_ is set
         Block* block_;
+        const LazySource* lazy_=nullptr;
+        // source offset of the { of a skipped body
+        std::uint32_t body_at=0;
+        // set by resolve()
+        Slots captured_;
     };
 
     struct VarDeclInit:Stmt{
-        VarDeclInit(Symbol* ident,Expr* value,Type* type):ident_(ident),value_(value),type_(type){}
-        virtual ~VarDeclInit(){
-            if(!value_) delete value_;
-            if(!type_) delete type_;
-            if(!ident_) delete ident_;
-        }
+        static constexpr NodeKind Kind=NodeKind::VarDeclInit;
+        VarDeclInit(Symbol* ident,Expr* value,Type type):Stmt(Kind),ident_(ident),value_(value),type_(type){}
             Expr* value_;
-            Type* type_;
+            Type type_;
             Symbol* ident_;
     };
 
@@ -92,20 +145,8 @@ namespace tua{
             const Stmt* get_if_stmt()const noexcept {return if_;}
             const Stmt* get_else_stmt()const noexcept {return else_;}
             const Expr* get_condtion_expr()const noexcept {return condition_;}
-            IfElse(Expr* condition,Block* left,Block* right):condition_(condition),if_(left),else_(right){}
-            virtual ~IfElse(){
-                if(!if_){
-                    delete if_;
-                }
-
-                if(!else_){
-                    delete else_;
-                }
-
-                if(!condition_){
-                    delete condition_;
-                }
-            }
+            static constexpr NodeKind Kind=NodeKind::IfElse;
+            IfElse(Expr* condition,Block* left,Block* right):Stmt(Kind),condition_(condition),if_(left),else_(right){}
             Expr* condition_;
             Block* if_;
             Block* else_;
@@ -114,27 +155,16 @@ namespace tua{
     struct WhileStmt:Stmt{
             const Stmt* get_block_stmt()const noexcept {return block_;}
             const Expr* get_condtion_expr()const noexcept {return condition_;}
-            WhileStmt(Expr* condition,Block* block):condition_(condition),block_(block){}
-            virtual ~WhileStmt(){
-                if(!block_ ){
-                    delete block_;
-                }
-                if(!condition_){
-                    delete condition_;
-                }
-            }
+            static constexpr NodeKind Kind=NodeKind::WhileStmt;
+            WhileStmt(Expr* condition,Block* block):Stmt(Kind),condition_(condition),block_(block){}
             Expr* condition_;
             Block* block_;
     };
 
     struct Return:Stmt{
             const Expr* get_value()const noexcept {return value_;}
-            Return(Expr* value):value_(value){}
-            virtual ~Return(){
-                if(!value_){
-                    delete value_;
-                }
-            }
+            static constexpr NodeKind Kind=NodeKind::Return;
+            Return(Expr* value):Stmt(Kind),value_(value){}
             Expr* value_;
     };
 
@@ -142,13 +172,7 @@ namespace tua{
         public:
             const Expr* get_left_expr()const noexcept {return left_;}
             const Expr* get_right_expr()const noexcept {return right_;}
-            BinExpr(Expr* left,Expr* right):left_(left),right_(right){}
-            virtual ~BinExpr(){
-                if(!left_ && !right_){
-                    delete left_;
-                    delete right_;
-                }
-            }
+            BinExpr(NodeKind kind,Expr* left,Expr* right):Expr(kind),left_(left),right_(right){}
             Expr* left_;
             Expr* right_;
     };
@@ -156,21 +180,47 @@ namespace tua{
     struct UnaryExpr:Expr{
         public:
             const Expr* get_expr()const noexcept {return expr_;}
-            UnaryExpr(Expr* expr):expr_(expr){}
-            virtual ~UnaryExpr(){
-                if(!expr_){
-                    delete expr_;
-                }
-            }
+            UnaryExpr(NodeKind kind,Expr* expr):Expr(kind),expr_(expr){}
             Expr* expr_;
     };
 
-    template<TokenKind kind> struct Unar_Expr:UnaryExpr{
-        Unar_Expr(Expr* expr):UnaryExpr(expr){}
+    constexpr NodeKind unary_kind(TokenKind kind){
+        switch(kind){
+            case TokenKind::MINUS: return NodeKind::Minus;
+            case TokenKind::BANG: return NodeKind::Negate;
+            case TokenKind::LEFT_PAREN: return NodeKind::Group;
+            default: throw "not a unary operator";
+        }
+    }
+
+    constexpr NodeKind binary_kind(TokenKind kind){
+        switch(kind){
+            case TokenKind::PLUS: return NodeKind::Add;
+            case TokenKind::MINUS: return NodeKind::Sub;
+            case TokenKind::STAR: return NodeKind::Mul;
+            case TokenKind::SLASH: return NodeKind::Div;
+            case TokenKind::EQUAL_EQUAL: return NodeKind::Equality;
+            case TokenKind::BANG_EQUAL: return NodeKind::NotEq;
+            case TokenKind::LESS: return NodeKind::Less;
+            case TokenKind::GREATER: return NodeKind::Great;
+            case TokenKind::LESS_EQUAL: return NodeKind::LessEq;
+            case TokenKind::GREATER_EQUAL: return NodeKind::GreatEq;
+            case TokenKind::BIT_OR: return NodeKind::BitOr;
+            case TokenKind::BIT_AND: return NodeKind::BitAnd;
+            case TokenKind::BIT_RSHIFT: return NodeKind::RShift;
+            case TokenKind::BIT_LSHIFT: return NodeKind::LShift;
+            default: throw "not a binary operator";
+        }
+    }
+
+    template<TokenKind op> struct Unar_Expr:UnaryExpr{
+        static constexpr NodeKind Kind=unary_kind(op);
+        Unar_Expr(Expr* expr):UnaryExpr(Kind,expr){}
     };
 
-    template<TokenKind kind> struct Bin_Expr:BinExpr{
-        Bin_Expr(Expr* left,Expr* right):BinExpr(left,right){}
+    template<TokenKind op> struct Bin_Expr:BinExpr{
+        static constexpr NodeKind Kind=binary_kind(op);
+        Bin_Expr(Expr* left,Expr* right):BinExpr(Kind,left,right){}
     };
 
     using Add=Bin_Expr<TokenKind::PLUS>;
@@ -179,6 +229,7 @@ namespace tua{
     using Div=Bin_Expr<TokenKind::SLASH>;
 
     using Equality=Bin_Expr<TokenKind::EQUAL_EQUAL>;
+    using NotEq=Bin_Expr<TokenKind::BANG_EQUAL>;
     using Less=Bin_Expr<TokenKind::LESS>;
     using Great=Bin_Expr<TokenKind::GREATER>;
     using LessEq=Bin_Expr<TokenKind::LESS_EQUAL>;
@@ -193,8 +244,19 @@ namespace tua{
     using Negate=Unar_Expr<TokenKind::BANG>;
     using Group=Unar_Expr<TokenKind::LEFT_PAREN>;
 
+    template<typename T> constexpr NodeKind literal_kind(){
+        if constexpr(std::is_same_v<T,double>) return NodeKind::Double;
+        else if constexpr(std::is_same_v<T,std::int64_t>) return NodeKind::Int;
+        else if constexpr(std::is_same_v<T,std::string_view>) return NodeKind::Str;
+        else{
+            static_assert(std::is_same_v<T,bool>,"no NodeKind for this literal type");
+            return NodeKind::Bool;
+        }
+    }
+
     template<typename T> struct Literal:Expr{
-        Literal(T value):value(value){}
+        static constexpr NodeKind Kind=literal_kind<T>();
+        Literal(T value):Expr(Kind),value(value){}
         Literal(const Literal&)=default;
         Literal(Literal&&)=default;
         Literal& operator=(const Literal&)=default;
@@ -204,47 +266,78 @@ namespace tua{
     };
 
     using Double=Literal<double>;
-    using Int=Literal<int>;
-    using Str=Literal<std::string>;
+    using Int=Literal<std::int64_t>;
+    // the text is copied into the arena of the program
+    using Str=Literal<std::string_view>;
     using Bool=Literal<bool>;
 
 
     struct Assign:Expr{
-        Assign(std::string&& ident,Expr* value):ident_(std::move(ident)),value_(value){}
+        static constexpr NodeKind Kind=NodeKind::Assign;
+        Assign(IdentId ident,Expr* value):Expr(Kind),ident_(ident),value_(value){}
         Assign(const Assign&)=default;
         Assign(Assign&&)=default;
         Assign& operator=(const Assign&)=default;
         Assign& operator=(Assign&&)=default;
-        std::string ident_;
+        IdentId ident_;
         Expr* value_;
+        Resolution resolved;
     };
 
     struct FctCall:Expr{
-        FctCall(Expr* expr,std::vector<Expr*>&& exprs):expr_(expr),exprs_(std::move(exprs)){}
+        static constexpr NodeKind Kind=NodeKind::FctCall;
+        FctCall(Expr* expr,Exprs&& exprs):Expr(Kind),expr_(expr),exprs_(std::move(exprs)){}
         FctCall(const FctCall&)=default;
         FctCall(FctCall&&)=default;
         FctCall& operator=(const FctCall&)=default;
         FctCall& operator=(FctCall&&)=default;
         Expr* expr_;
-        std::vector<Expr*> exprs_;
+        Exprs exprs_;
     };
 
     struct FctExpr:Expr{
-        FctExpr(Type* return_type,Params&& params,Block* block):
-            ret_type(return_type),params_(std::move(params)),block_(block){}
+        static constexpr NodeKind Kind=NodeKind::FctExpr;
+        FctExpr(Type return_type,Params&& params,Block* block):
+            Expr(Kind),ret_type(return_type),params_(std::move(params)),block_(block),captured_(params_.get_allocator()){}
         FctExpr(const FctExpr&)=default;
         FctExpr(FctExpr&&)=default;
         FctExpr& operator=(const FctExpr&)=default;
         FctExpr& operator=(FctExpr&&)=default;
-        Type* ret_type;
+        std::expected<Block*,Error*> body();
+        Type ret_type;
         Params params_ ;
         Block* block_;
+        const LazySource* lazy_=nullptr;
+        std::uint32_t body_at=0;
+        // set by resolve()
+        Slots captured_;
     };
 
 
+    // owns the arena every node of stmts comes from, freeing a program
+    // releases the arena in one go. The stmts of a reparsed program are on
+    // the heap and its arena adopts the one of the program before. ends[i] is the source offset just past
+    // the ; of stmts[i], reparses counts the Parser::reparse() calls the
+    // program went through since it was parsed from scratch
     struct Program{
-        Program(Stmts&& stmts):stmts(stmts){}
+        Program(std::unique_ptr<Arena>&& arena,Stmts&& stmts,std::vector<std::uint32_t>&& ends):
+            arena(std::move(arena)),stmts(std::move(stmts)),ends(std::move(ends)){}
+        Program(Program&&)=default;
+        // the old arena would go before the stmts pointing into it
+        Program& operator=(Program&&)=delete;
+        std::unique_ptr<Arena> arena;
         Stmts stmts;
+        std::vector<std::uint32_t> ends;
+        std::uint32_t reparses=0;
+        // how the parser that made it was set, reparse() parses the
+        // statements it replaces the same way
+        std::uint32_t max_depth=0;
+        bool lazy=false;
+        // the FctDecl and FctExpr a lazy parse left the body of to body(),
+        // those body() parsed since hold the ones skipped in them
+        std::vector<Stmt*> lazy_bodies;
+        // slots of the top level frame captured by a function, see resolve()
+        std::vector<std::uint16_t> captured;
     };
 };
 
@@ -0,0 +1,60 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include <cstdint>
+#include <expected>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+#include "flat_ast.h"
+#include "interner.h"
+#include "source.h"
+
+namespace tua{
+
+    // bumped whenever the file layout, FlatNode or NodeKind changes, files
+    // of another version are ignored
+    constexpr std::uint32_t AST_CACHE_VERSION=1;
+
+    // the key of a cache file, hashes 8 bytes at a time
+    std::uint64_t source_hash(std::string_view text) noexcept;
+
+    // writes ast, parsed from a source hashing to hash, as a cache file:
+    //   header, nodes, extra, stmts, names as offset and length pairs,
+    //   strings, name bytes
+    // sections start at offsets aligned to 8 bytes and hold indices only,
+    // names are numbered from 1 in the order they are first met. The file
+    // is written aside and renamed over path, a process mapping the old
+    // one keeps reading it
+    bool write_ast_cache(std::string_view path,const FlatAst& ast,std::uint64_t hash);
+
+    // a cache file mapped in memory, the nodes are used where they are and
+    // only the names are interned on load
+    class AstCache{
+        public:
+            // a CacheError when path can't be read, is of another version,
+            // wasn't written for a source hashing to hash or has a section
+            // or an index out of bounds
+            static std::expected<AstCache,Error*> load(std::string_view path,std::uint64_t hash);
+            FlatView view() const noexcept;
+
+        private:
+            friend std::expected<AstCache,Error*> load_or_parse(std::string_view cache_path,std::string_view source);
+            AstCache(Source&& file,std::vector<IdentId>&& idents):file(std::move(file)),idents(std::move(idents)){}
+            // a tree that couldn't be cached
+            AstCache(FlatAst&& parsed):file(std::string()),parsed(std::move(parsed)){}
+
+            Source file;
+            // global id of each name of the file, NoIdent first. Empty
+            // when the tree is in parsed instead
+            std::vector<IdentId> idents;
+            FlatAst parsed;
+    };
+
+    // the tree of source from the cache at cache_path when it is there and
+    // up to date, else parses source and writes the cache for next time
+    std::expected<AstCache,Error*> load_or_parse(std::string_view cache_path,std::string_view source);
+};
+
+#endif
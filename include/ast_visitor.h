@@ -0,0 +1,142 @@
+#ifndef AST_VISITOR_H
+#define AST_VISITOR_H
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "node_kind.h"
+
+namespace tua{
+
+    // every concrete node type, in NodeKind order
+    using NodeTypes=std::tuple<
+        Block,ClassStmt,FctDecl,VarDeclInit,IfElse,WhileStmt,Return,
+        Add,Sub,Mul,Div,Equality,NotEq,Less,Great,LessEq,GreatEq,BitOr,BitAnd,RShift,LShift,
+        Minus,Negate,Group,
+        Int,Double,Str,Bool,Symbol,Assign,FctCall,FctExpr>;
+
+    namespace detail{
+        template<std::size_t I> constexpr bool kind_at(){
+            using T=std::tuple_element_t<I,NodeTypes>;
+            return T::Kind==static_cast<NodeKind>(I);
+        }
+
+        template<std::size_t... I> constexpr bool kinds_in_order(std::index_sequence<I...>){
+            return (kind_at<I>() && ...);
+        }
+    };
+
+    static_assert((std::tuple_size_v<NodeTypes> == NODE_KIND_COUNT),"a NodeKind has no node type");
+    static_assert(detail::kinds_in_order(std::make_index_sequence<NODE_KIND_COUNT>{}),"NodeTypes is out of NodeKind order");
+
+    // dispatch(node) calls derived.visit(T*) with the concrete type of node
+    // through a table indexed by its kind. Derived must accept every node
+    // type, a visit for a base class (BinExpr*, Expr*...) covers all the
+    // types deriving from it; a missing one fails to compile
+    template<typename Derived,typename R=void> class AstVisitor{
+        public:
+            R dispatch(Stmt* node){
+                return table[static_cast<std::size_t>(node->kind)](static_cast<Derived&>(*this),node);
+            }
+
+        private:
+            using Entry=R(*)(Derived&,Stmt*);
+
+            template<typename T> static R call(Derived& self,Stmt* node){
+                return self.visit(static_cast<T*>(node));
+            }
+
+            template<std::size_t... I> static constexpr std::array<Entry,sizeof...(I)> make_table(std::index_sequence<I...>){
+                return {&call<std::tuple_element_t<I,NodeTypes>>...};
+            }
+
+            static constexpr std::array<Entry,NODE_KIND_COUNT> table=make_table(std::make_index_sequence<NODE_KIND_COUNT>{});
+    };
+
+    // the parser builds chains of BinExpr and UnaryExpr as long as the
+    // source without recursing, passes over them walk the chain under expr
+    // on a heap stack instead of dispatching down it. operand(e) gets the
+    // expressions of the chain that aren't operators, op(e) each operator
+    // after its operands, left to right. Either returns false to stop the
+    // walk, walk_operators() then returns false
+    template<typename Operand,typename Operator> bool walk_operators(Expr* expr,Operand&& operand,Operator&& op){
+        struct Pending{
+            Expr* expr;
+            bool expanded;
+        };
+        std::vector<Pending> stack{{expr,false}};
+        while(!stack.empty()){
+            auto [at,expanded]=stack.back();
+            stack.pop_back();
+            if(expanded){
+                if(!op(at)) return false;
+            }else if(is_binary(at->kind)){
+                auto bin=static_cast<BinExpr*>(at);
+                stack.push_back({at,true});
+                stack.push_back({bin->right_,false});
+                stack.push_back({bin->left_,false});
+            }else if(is_unary(at->kind)){
+                stack.push_back({at,true});
+                stack.push_back({static_cast<UnaryExpr*>(at)->expr_,false});
+            }else if(!operand(at)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the nodes right under stmt in source order, a FlatAst has them before
+    // stmt in that order. A lazy body not parsed yet is left out
+    template<typename Each> void each_child(Stmt* stmt,Each&& each){
+        switch(stmt->kind){
+            case NodeKind::Block: for(auto child:static_cast<Block*>(stmt)->stmts) each(child); break;
+            case NodeKind::ClassStmt: each(static_cast<ClassStmt*>(stmt)->block_); break;
+            case NodeKind::FctDecl: if(auto block=static_cast<FctDecl*>(stmt)->block_) each(block); break;
+            case NodeKind::FctExpr: if(auto block=static_cast<FctExpr*>(stmt)->block_) each(block); break;
+            case NodeKind::VarDeclInit:{
+                                           auto var=static_cast<VarDeclInit*>(stmt);
+                                           if(var->value_) each(var->value_);
+                                           break;
+                                       }
+            case NodeKind::IfElse:{
+                                      auto ifelse=static_cast<IfElse*>(stmt);
+                                      each(ifelse->condition_);
+                                      each(ifelse->if_);
+                                      if(ifelse->else_) each(ifelse->else_);
+                                      break;
+                                  }
+            case NodeKind::WhileStmt:{
+                                         auto loop=static_cast<WhileStmt*>(stmt);
+                                         each(loop->condition_);
+                                         each(loop->block_);
+                                         break;
+                                     }
+            case NodeKind::Return: each(static_cast<Return*>(stmt)->value_); break;
+            case NodeKind::Int:
+            case NodeKind::Double:
+            case NodeKind::Str:
+            case NodeKind::Bool:
+            case NodeKind::Symbol: break;
+            case NodeKind::Assign: each(static_cast<Assign*>(stmt)->value_); break;
+            case NodeKind::FctCall:{
+                                       auto call=static_cast<FctCall*>(stmt);
+                                       each(call->expr_);
+                                       for(auto arg:call->exprs_) each(arg);
+                                       break;
+                                   }
+            default:
+                if(is_binary(stmt->kind)){
+                    each(static_cast<BinExpr*>(stmt)->left_);
+                    each(static_cast<BinExpr*>(stmt)->right_);
+                }else{
+                    each(static_cast<UnaryExpr*>(stmt)->expr_);
+                }
+        }
+    }
+};
+
+#endif
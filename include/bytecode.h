@@ -0,0 +1,86 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+#include "interner.h"
+#include "value.h"
+
+namespace tua{
+
+    // operands follow the opcode, 16 bit ones little endian:
+    //   Const k16                      push constants[k]
+    //   GetLocal, SetLocal s8          slot s of the frame, Set keeps the
+    //   StoreLocal s8                  value on the stack, Store pops it
+    //   GetCapture ... c8              captures[c] of the running closure
+    //   GetGlobal ... g16              globals[g]
+    //   Jump, JumpIfFalse o16          forward o bytes past the operand,
+    //                                  JumpIfFalse pops the condition
+    //   Loop o16                       backward o bytes past the operand
+    //   Call n8                        the function below n arguments
+    //   Closure f16 {from8 index8}     Module::functions[f], then for each
+    //                                  capture a local (0) or a capture (1)
+    //                                  of the running function, or the new
+    //                                  closure itself (2)
+    #define TUA_OPCODES(X) \
+        X(Const) X(Nil) X(True) X(False) X(Pop) \
+        X(GetLocal) X(SetLocal) X(StoreLocal) \
+        X(GetCapture) X(SetCapture) X(StoreCapture) \
+        X(GetGlobal) X(SetGlobal) X(StoreGlobal) \
+        X(Add) X(Sub) X(Mul) X(Div) \
+        X(Equal) X(NotEqual) X(Less) X(Greater) X(LessEqual) X(GreaterEqual) \
+        X(BitOr) X(BitAnd) X(RShift) X(LShift) X(Neg) X(Not) \
+        X(Jump) X(JumpIfFalse) X(Loop) X(Call) X(Closure) X(Return)
+
+    enum class OpCode : std::uint8_t {
+        #define TUA_OPCODE_ENUM(name) name,
+        TUA_OPCODES(TUA_OPCODE_ENUM)
+        #undef TUA_OPCODE_ENUM
+    };
+
+    constexpr std::size_t OPCODE_COUNT=static_cast<std::size_t>(OpCode::Return)+1;
+
+    enum class CaptureFrom : std::uint8_t { Local, Capture, Itself };
+
+    // a function compiled to bytecode. Its frame holds the params then the
+    // locals in slots, the stack of its expressions above them
+    struct Function{
+        // NoIdent for lambdas and the top level
+        IdentId name=NoIdent;
+        std::uint8_t arity=0;
+        std::uint8_t captures=0;
+        std::uint16_t slots=0;
+        // deepest the expression stack gets
+        std::uint16_t max_stack=0;
+        // declared by a top level fun
+        bool global=false;
+        std::vector<std::uint8_t> code;
+        std::vector<Value> constants;
+        // set by Jit::compile, runs the call instead of the code when it
+        // returns true, see lower(). depth is the frame the call would take
+        using Native=bool(*)(const Value* args,Value* result,std::uint32_t depth);
+        Native native=nullptr;
+    };
+
+    struct Module{
+        // functions[0] runs the top level statements
+        std::vector<std::unique_ptr<Function>> functions;
+        // name of each global slot
+        std::vector<IdentId> globals;
+        std::vector<std::unique_ptr<StrObj>> strings;
+    };
+
+    // top level let and fun are globals, found by name when the code runs,
+    // the others are slots of their function. A lambda or nested function
+    // copies the values it uses from around it when it is made. Lazy
+    // bodies are parsed on the way, their ParseError is returned as is
+    std::expected<Module,Error*> compile(Program& program);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "interner.h"
+
+namespace llvm{
+    class Module;
+};
+
+namespace tua{
+
+    enum class NativeType : std::uint8_t { Int, Double, Bool };
+
+    // a function lowered by lower(), symbol and entry are its names in
+    // the llvm::Module
+    struct Lowered{
+        IdentId name;
+        std::vector<NativeType> params;
+        std::vector<IdentId> param_names;
+        NativeType ret;
+        std::string symbol;
+        std::string entry;
+    };
+
+    // lowers to LLVM IR the top level functions of program whose params
+    // and return value are declared int, double (or float) or bool, whose
+    // bodies only use let, assignments, if, while, return, arithmetic,
+    // comparisons and calls to other such functions, and whose name is
+    // given a value nowhere else. Each one becomes
+    //   i1 @<prefix><name>(params..., ret* out, i32 depth)
+    // false where the VM would stop with a runtime error (division by
+    // zero, falling off the end, a call whose frame depth would be
+    // MAX_FRAMES or past it, depth being the VM frame the call takes).
+    // They only touch their locals, the VM can run them again to report
+    // it. And
+    //   i1 @<prefix>entry_<name>(const Value* args, Value* result, i32 depth)
+    // which is also false when an argument isn't of the declared type.
+    // Lambdas are values with captures, functions using them are left to
+    // the VM
+    std::vector<Lowered> lower(Program& program,llvm::Module& module,const std::string& prefix);
+
+    // the O2 pipeline, module has its target triple and data layout set
+    void optimize(llvm::Module& module);
+};
+
+#endif
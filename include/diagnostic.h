@@ -0,0 +1,57 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tua{
+
+    enum class DiagCode : std::uint8_t {
+        SemicolonExpected,
+        LeftParenExpected,
+        RightParenExpected,
+        LeftBraceExpected,
+        CommaExpected,
+        ColonExpected,
+        ReturnTypeExpected,
+        FunctionNameExpected,
+        ParamNameExpected,
+        TypeExpected,
+        TooManyParams,
+        ClassNameExpected,
+        ParentClassExpected,
+        VariableNameExpected,
+        UnknownTerminal,
+        EndOfTokens,
+        BlocksTooDeep,
+        ExprTooDeep,
+        UnknownToken,
+        MalformedNumber,
+        NumberOutOfRange,
+    };
+
+    // a parse error kept as plain data, the message is only formatted when
+    // someone looks at it. offset and length are the token the parser
+    // stopped at
+    struct Diagnostic {
+        DiagCode code;
+        // the messages of lambda heads end with a space
+        bool lambda=false;
+        // already in the diagnostics of Parser::parse_all()
+        bool reported=false;
+        // class bodies the error is in
+        std::uint16_t class_depth=0;
+        std::uint32_t offset=0;
+        std::uint32_t length=0;
+        std::uint32_t line=0;
+        // nesting limit of BlocksTooDeep and ExprTooDeep
+        std::uint32_t limit=0;
+    };
+
+    // the text of the ParseError for diagnostic, lexeme being the text of
+    // its token
+    std::string message(const Diagnostic& diagnostic,std::string_view lexeme);
+};
+
+#endif
@@ -7,6 +7,7 @@ namespace tua{
 
     struct Error{
             Error(std::string&& msg,std::uint32_t lnum):_msg(std::move(msg)),_lnum(lnum){}
+            virtual ~Error()=default;
             std::string _msg;
             std::uint32_t _lnum;
 
@@ -24,6 +25,49 @@ namespace tua{
                 return !((bool)(_msg.compare(err._msg))) && _lnum==err._lnum;
             }
     };
+
+    // the tree has no source positions, these carry the name of the
+    // function instead of a line
+    struct CompileError:Error{
+            CompileError(std::string&& msg):Error(std::move(msg),0){}
+
+            virtual operator std::string() const override{
+                return _msg;
+            }
+    };
+
+    struct TypeError:Error{
+            TypeError(std::string&& msg):Error(std::move(msg),0){}
+
+            virtual operator std::string() const override{
+                return _msg;
+            }
+    };
+
+    struct ResolveError:Error{
+            ResolveError(std::string&& msg):Error(std::move(msg),0){}
+
+            virtual operator std::string() const override{
+                return _msg;
+            }
+    };
+
+    // why a cache file wasn't used, the source is parsed instead
+    struct CacheError:Error{
+            CacheError(std::string&& msg):Error(std::move(msg),0){}
+
+            virtual operator std::string() const override{
+                return _msg;
+            }
+    };
+
+    struct RuntimeError:Error{
+            RuntimeError(std::string&& msg):Error(std::move(msg),0){}
+
+            virtual operator std::string() const override{
+                return _msg;
+            }
+    };
 };
 
 
@@ -0,0 +1,120 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+#include "interner.h"
+#include "node_kind.h"
+
+namespace tua{
+
+    // index of a node in FlatAst::nodes
+    using NodeId=std::uint32_t;
+    constexpr NodeId NoNode=UINT32_MAX;
+
+    // fixed size record, what a, b and c hold depends on kind:
+    //   Block          b,c: range of statement ids in extra
+    //   ClassStmt      a: name, b: parent type or NoIdent, c: block
+    //   FctDecl        a: name, b: return type, c: index in extra of
+    //   FctExpr        a: NoIdent  [block, param count, name, type, ...]
+    //   VarDeclInit    a: name, b: type, c: value or NoNode
+    //   IfElse         a: condition, b: if block, c: else block or NoNode
+    //   WhileStmt      a: condition, b: block
+    //   Return         a: value
+    //   binary         a: left, b: right
+    //   unary, Group   a: operand
+    //   Int, Double    a,b: low and high half of the value bits
+    //   Str            a,b: offset and length in strings
+    //   Bool           a: 0 or 1
+    //   Symbol         a: name
+    //   Assign         a: name, b: value
+    //   FctCall        a: callee, b,c: range of argument ids in extra
+    struct FlatNode{
+        NodeKind kind;
+        // zeroed so nodes written to a cache file are the same on each run
+        std::uint8_t pad[3];
+        std::uint32_t a;
+        std::uint32_t b;
+        std::uint32_t c;
+    };
+    static_assert(sizeof(FlatNode)==16);
+
+    // read only view of the arrays of a FlatAst, wherever they are. Names
+    // in nodes and params go through ident(): the ids of a FlatAst are the
+    // global IdentIds, a cache file has its own numbering mapped by idents
+    struct FlatView{
+        std::span<const FlatNode> nodes;
+        std::span<const std::uint32_t> extra;
+        std::string_view strings;
+        std::span<const NodeId> stmts;
+        std::span<const IdentId> idents;
+
+        const FlatNode& operator[](NodeId id) const noexcept {return nodes[id];}
+        std::size_t size() const noexcept {return nodes.size();}
+
+        IdentId ident(std::uint32_t name) const noexcept {return idents.empty()?name:idents[name];}
+
+        // statements of a Block, arguments of a FctCall
+        std::span<const NodeId> children(NodeId id) const noexcept {
+            const auto& node=nodes[id];
+            return extra.subspan(node.b,node.c);
+        }
+
+        NodeId fct_block(NodeId id) const noexcept {return extra[nodes[id].c];}
+        // name and type of each parameter, one after the other
+        std::span<const std::uint32_t> fct_params(NodeId id) const noexcept {
+            auto first=nodes[id].c;
+            return extra.subspan(first+2,extra[first+1]*2);
+        }
+
+        std::int64_t int_value(NodeId id) const noexcept {return std::bit_cast<std::int64_t>(bits(id));}
+        double double_value(NodeId id) const noexcept {return std::bit_cast<double>(bits(id));}
+        std::string_view str(NodeId id) const noexcept {
+            return strings.substr(nodes[id].a,nodes[id].b);
+        }
+
+        private:
+            std::uint64_t bits(NodeId id) const noexcept {
+                return nodes[id].a | std::uint64_t(nodes[id].b)<<32;
+            }
+    };
+
+    // a whole program as one array of nodes, children always come before
+    // their parent so a forward walk visits them bottom up
+    struct FlatAst{
+        std::vector<FlatNode> nodes;
+        std::vector<std::uint32_t> extra;
+        std::string strings;
+        std::vector<NodeId> stmts;
+
+        const FlatNode& operator[](NodeId id) const noexcept {return nodes[id];}
+        std::size_t size() const noexcept {return nodes.size();}
+
+        NodeId add(NodeKind kind,std::uint32_t a=0,std::uint32_t b=0,std::uint32_t c=0){
+            nodes.push_back(FlatNode{kind,{},a,b,c});
+            return nodes.size()-1;
+        }
+
+        FlatView view() const noexcept {return FlatView{nodes,extra,strings,stmts,{}};}
+
+        std::span<const NodeId> children(NodeId id) const noexcept {return view().children(id);}
+        NodeId fct_block(NodeId id) const noexcept {return view().fct_block(id);}
+        std::span<const std::uint32_t> fct_params(NodeId id) const noexcept {return view().fct_params(id);}
+        std::int64_t int_value(NodeId id) const noexcept {return view().int_value(id);}
+        double double_value(NodeId id) const noexcept {return view().double_value(id);}
+        std::string_view str(NodeId id) const noexcept {return view().str(id);}
+    };
+
+    // the nodes of ast made again as a Program for the passes that take
+    // one. Its bodies are all parsed and it has no ends, reparse() starts
+    // from the top
+    Program to_program(const FlatView& ast);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+namespace tua{
+
+    // interned identifiers are compared and hashed as plain integers
+    using IdentId=std::uint32_t;
+    // the empty name, interned first
+    constexpr IdentId NoIdent=0;
+
+    // maps every distinct name to a dense id. Names are copied once into
+    // blocks that never move, the table keeps their hash so growing it
+    // doesn't hash the names again. Safe to use from several threads
+    class Interner{
+        public:
+            Interner();
+            Interner(const Interner&)=delete;
+            Interner& operator=(const Interner&)=delete;
+
+            // the one the lexer interns identifiers into
+            static Interner& global();
+
+            IdentId intern(std::string_view name);
+            // the view stays valid as long as the interner, or until
+            // truncate() drops the name
+            std::string_view name(IdentId id) const;
+            std::size_t size() const;
+            // drops the names interned since size() was size, for a host
+            // that parses one program after another to let go of the names
+            // of those it's done with. The ids and views of the names
+            // dropped must not be used anymore, the next names get them
+            void truncate(std::size_t size);
+
+        private:
+            struct Slot{
+                std::size_t hash;
+                IdentId id;
+            };
+            static constexpr IdentId Empty=UINT32_MAX;
+
+            // slot holding name or the empty slot where it belongs
+            std::size_t find(std::string_view name,std::size_t hash) const noexcept;
+            std::string_view store(std::string_view name);
+            void grow();
+
+            mutable std::shared_mutex mutex;
+            std::vector<Slot> slots;
+            std::vector<std::string_view> names;
+            struct Block{
+                std::unique_ptr<char[]> bytes;
+                std::size_t size;
+                // the first name stored in it
+                IdentId first;
+            };
+            std::vector<Block> blocks;
+            std::size_t block_used;
+            std::size_t block_size;
+    };
+
+    inline std::string_view ident_name(IdentId id){ return Interner::global().name(id); }
+};
+
+#endif
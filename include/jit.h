@@ -0,0 +1,44 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "error.h"
+#include "interner.h"
+
+namespace llvm::orc{
+    class LLJIT;
+};
+
+namespace tua{
+
+    // native code for the functions lower() takes, the VM calls it in
+    // place of their bytecode. The code lives as long as the Jit, modules
+    // it compiled must not be run after it is gone
+    class Jit{
+        public:
+            static std::expected<Jit,Error*> create();
+            Jit(Jit&&) noexcept;
+            Jit& operator=(Jit&&) noexcept;
+            ~Jit();
+
+            // compiles the functions of program it can and sets native on
+            // their Function in module, which compile(program) made.
+            // Returns their names
+            std::expected<std::vector<IdentId>,Error*> compile(Program& program,Module& module);
+
+        private:
+            Jit(std::unique_ptr<llvm::orc::LLJIT>&& jit);
+
+            std::unique_ptr<llvm::orc::LLJIT> jit;
+            // each compile names its functions apart
+            std::uint32_t compiles=0;
+    };
+};
+
+#endif
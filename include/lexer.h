@@ -1,12 +1,19 @@
 #ifndef LEXER_H
 #define  LEXER_H
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
+
+#include "interner.h"
+#include "source.h"
 
 namespace tua{
 
-    enum class TokenKind {
+    enum class TokenKind : std::uint8_t {
         Err,
         Eof ,
 
@@ -65,21 +72,40 @@ namespace tua{
         LET ,
     };
 
+    // value of INT and DOUBLE tokens, converted once by the lexer
+    union Number {
+        std::int64_t int_value;
+        double double_value;
+    };
+
+    // why the lexer gave up on an Err token
+    enum class LexError : std::uint8_t {
+        Unknown,
+        Malformed,
+        OutOfRange,
+    };
+
+    // lexeme is a view into the Source of the Lexer that produced the token,
+    // it stays valid as long as that Lexer or one of its copies is alive.
+    // offset is where the token starts in the source (past the opening quote
+    // for strings), Lexer::line_of() turns it into a line
     struct Token {
         TokenKind kind;
-        std::string lexeme;
-        std::uint16_t line;
-        char* begin,end;
-
-        Token(TokenKind kind, std::string&& lexeme,std::uint16_t line) : kind(kind), lexeme(lexeme),line(line) {}
-        Token(TokenKind kind,std::uint16_t line) : kind(kind),lexeme(""),line(line){}
+        std::string_view lexeme;
+        std::uint32_t offset;
+        Number number{};
+        LexError error=LexError::Unknown;
+        IdentId ident=NoIdent;
+
+        Token(TokenKind kind, std::string_view lexeme,std::uint32_t offset) : kind(kind), lexeme(lexeme),offset(offset) {}
+        Token(TokenKind kind,std::uint32_t offset) : kind(kind),lexeme(),offset(offset){}
         Token(const Token&)=default;
         Token(Token&&)=default;
         Token& operator=(const Token&)=default;
         Token& operator=(Token&&)=default;
 
         friend bool operator==(const Token& Rhs, const Token& Lhs){
-            return Rhs.kind==Lhs.kind && Rhs.lexeme==Lhs.lexeme && Rhs.line==Lhs.line;
+            return Rhs.kind==Lhs.kind && Rhs.lexeme==Lhs.lexeme && Rhs.offset==Lhs.offset;
         }
 
         friend bool operator!=(const Token& Rhs, const Token& Lhs){
@@ -87,24 +113,131 @@ namespace tua{
         }
     };
 
+    // the tokens of a whole source as struct of arrays, token i starts at
+    // offsets[i] in the source and its lexeme is lengths[i] bytes long.
+    // payloads[i] indexes numbers for INT and DOUBLE tokens, holds the
+    // IdentId of IDENT tokens and the LexError of Err tokens
+    struct TokenBuffer {
+        std::vector<TokenKind> kinds;
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> lengths;
+        std::vector<std::uint32_t> payloads;
+        std::vector<Number> numbers;
+
+        std::size_t size() const noexcept {return kinds.size();}
+        void reserve(std::size_t count);
+        void push_back(const Token& token);
+        // appends the first count tokens of other
+        void append(const TokenBuffer& other,std::size_t count);
+        // copy of the tokens in [first,last) numbered from 0. A slice that
+        // stops before the end gets an Eof where token last starts
+        TokenBuffer slice(std::size_t first,std::size_t last) const;
+    };
+
+    // classifies a word as one of the key words by length and first chars,
+    // words that are not key words are IDENT
+    constexpr TokenKind key_word(std::string_view word) noexcept{
+        auto match=[word](std::string_view key,TokenKind kind){
+            return word==key?kind:TokenKind::IDENT;
+        };
+        switch(word.size()){
+            case 2:
+                switch(word[0]){
+                    case 'i': return match("if",TokenKind::IF);
+                    case 'o': return match("or",TokenKind::OR);
+                    default: break;
+                }
+                break;
+            case 3:
+                switch(word[0]){
+                    case 'a': return match("and",TokenKind::AND);
+                    case 'f': return word[1]=='u'?match("fun",TokenKind::FUN):match("for",TokenKind::FOR);
+                    case 'l': return match("let",TokenKind::LET);
+                    case 'n': return match("nil",TokenKind::NIL);
+                    default: break;
+                }
+                break;
+            case 4:
+                switch(word[0]){
+                    case 'e': return match("else",TokenKind::ELSE);
+                    case 't': return word[1]=='h'?match("this",TokenKind::THIS):match("true",TokenKind::TRUE);
+                    default: break;
+                }
+                break;
+            case 5:
+                switch(word[0]){
+                    case 'c': return match("class",TokenKind::CLASS);
+                    case 'f': return match("false",TokenKind::FALSE);
+                    case 's': return match("super",TokenKind::SUPER);
+                    case 'w': return match("while",TokenKind::WHILE);
+                    default: break;
+                }
+                break;
+            case 6:
+                switch(word[0]){
+                    case 'l': return match("lambda",TokenKind::LAMBDA);
+                    case 'r': return match("return",TokenKind::RETURN);
+                    default: break;
+                }
+                break;
+            default: break;
+        }
+        return TokenKind::IDENT;
+    }
+
+    class StreamLexer;
+    class ThreadPool;
+
     class Lexer {
         public:
-            Lexer(std::string&& source):src(std::move(source)),iter(src.begin()),iter_end(src.end()),current_line(0){ }
+            Lexer(std::string&& source):Lexer(Source(std::move(source))){ }
+            Lexer(Source&& source):
+                owner(std::make_shared<const Source>(std::move(source))),lines(std::make_shared<Lines>()),src(owner->text()),pos(0),token_start(0){ }
+            // lexes text from start without a copy, text has to outlive the
+            // lexer and its tokens
+            static Lexer view(std::string_view text,std::size_t start=0);
+            // copy lexing the same source from start
+            Lexer at(std::size_t start) const;
             const Token get_token();
-            const std::uint16_t get_line() const noexcept;
+            // lexes the remaining source up to and including the Eof or Err token
+            TokenBuffer tokenize_all();
+            // same tokens as tokenize_all(), the source is cut in segments at
+            // newlines outside strings and comments that are lexed on the pool
+            TokenBuffer tokenize_parallel(ThreadPool& pool,std::size_t segments);
+            // line and column of a source offset, the line starts are found
+            // on the first call since only errors need them
+            std::uint32_t line_of(std::uint32_t offset) const;
+            std::uint32_t column_of(std::uint32_t offset) const;
+            std::string_view source() const noexcept;
 
         private:
-            std::string src;
-            std::string::iterator iter,iter_end;
-            std::uint16_t current_line;
+            friend class StreamLexer;
+            // lexes a text owned by the caller
+            Lexer(std::string_view text,std::size_t start):lines(std::make_shared<Lines>()),src(text),pos(start),token_start(start){ }
+
+            struct Lines{
+                std::once_flag built;
+                std::vector<std::uint32_t> starts;
+            };
+
+            // copies of a Lexer share the source and its line starts, so
+            // their tokens stay valid
+            std::shared_ptr<const Source> owner;
+            std::shared_ptr<Lines> lines;
+            std::string_view src;
+            std::size_t pos;
+            std::size_t token_start;
 
             void consume(); 
+            void skip_trivia();
+            void build_lines() const;
             const bool at_end() const noexcept;
+            const Token lex_token();
             const Token tokenize_ident();
             const Token tokenize_numeric();
             const Token tokenize_string();
 
-            static const std::unordered_map<std::string,TokenKind> key_words;
+            std::string_view lexeme_from(std::size_t start) const noexcept;
     };
 
     
@@ -0,0 +1,54 @@
+#ifndef NODE_KIND_H
+#define NODE_KIND_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tua{
+
+    // concrete node types, shared by the Stmt/Expr tree and the FlatAst
+    enum class NodeKind : std::uint8_t {
+        Block,
+        ClassStmt,
+        FctDecl,
+        VarDeclInit,
+        IfElse,
+        WhileStmt,
+        Return,
+
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Equality,
+        NotEq,
+        Less,
+        Great,
+        LessEq,
+        GreatEq,
+        BitOr,
+        BitAnd,
+        RShift,
+        LShift,
+
+        Minus,
+        Negate,
+        Group,
+
+        Int,
+        Double,
+        Str,
+        Bool,
+        Symbol,
+        Assign,
+        FctCall,
+        FctExpr,
+    };
+
+    constexpr std::size_t NODE_KIND_COUNT=static_cast<std::size_t>(NodeKind::FctExpr)+1;
+
+    constexpr bool is_binary(NodeKind kind){return kind>=NodeKind::Add && kind<=NodeKind::LShift;}
+    constexpr bool is_unary(NodeKind kind){return kind>=NodeKind::Minus && kind<=NodeKind::Group;}
+};
+
+#endif
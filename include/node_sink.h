@@ -0,0 +1,269 @@
+#ifndef NODE_SINK_H
+#define NODE_SINK_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "ast.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "node_kind.h"
+
+namespace tua{
+
+    // where the grammar of Parser puts the nodes it makes, TreeSink makes
+    // the Stmt and Expr objects of a Program and FlatSink the FlatNodes of
+    // a FlatAst. The grammar only holds their StmtRef, ExprRef and BlockRef
+    // and builds the statements of a block, the arguments of a call and
+    // the parameters of a function in the list the sink gives it
+
+    // a function declaration up to the { of its body
+    template<typename Sink>
+    struct FctHead{
+        Type ret_type;
+        typename Sink::Name ident;
+        typename Sink::ParamList params;
+    };
+
+    template<typename Sink>
+    struct ClassHead{
+        typename Sink::Name ident;
+        Type parent;
+    };
+
+    // a statement waiting for the end of its block in explicit stack mode
+    template<typename Sink>
+    struct NestFrame{
+        NodeKind kind;
+        // start of its statements in the nest_stmts of the sink
+        std::size_t mark;
+        typename Sink::ExprRef condition=Sink::none;
+        // set once the else block of an IfElse is open
+        typename Sink::BlockRef if_block=Sink::none;
+        // params keep the arena allocator when moved, not assigned
+        std::optional<FctHead<Sink>> fct;
+        ClassHead<Sink> cls;
+    };
+
+    struct TreeSink{
+        using StmtRef=Stmt*;
+        using ExprRef=Expr*;
+        using BlockRef=Block*;
+        using Name=Symbol*;
+        using StmtList=Stmts;
+        using ArgList=Exprs;
+        using ParamList=Params;
+        static constexpr std::nullptr_t none=nullptr;
+        // only the tree has a node for a body left to parse
+        static constexpr bool lazy_bodies=true;
+
+        // where the nodes of the statement being parsed go
+        Arena* arena=nullptr;
+        // stacks of the expressions and blocks being parsed, reused from
+        // one statement to the next
+        std::vector<ExprRef> operands;
+        std::vector<NestFrame<TreeSink>> nest_frames;
+        std::vector<StmtRef> nest_stmts;
+
+        StmtList stmts(){return StmtList(arena->resource());}
+        ArgList args(){return ArgList(arena->resource());}
+        ParamList params(){return ParamList(arena->resource());}
+        void push(StmtList& list,StmtRef stmt){list.push_back(stmt);}
+        void push(ArgList& list,ExprRef arg){list.push_back(arg);}
+        void param(ParamList& list,IdentId name,Type type){list.push_back(std::make_tuple(name,type));}
+
+        // a declaration's name, parsed as a symbol
+        Name name(ExprRef ident){return static_cast<Symbol*>(ident);}
+
+        BlockRef block(StmtList&& stmts){return arena->make<Block>(std::move(stmts));}
+        // the block of the statements on nest_stmts from mark
+        BlockRef nested_block(std::size_t mark){
+            return arena->make<Block>(StmtList(nest_stmts.begin()+mark,nest_stmts.end(),arena->resource()));
+        }
+        StmtRef if_else(ExprRef condition,BlockRef if_block,BlockRef else_block){
+            return arena->make<IfElse>(condition,if_block,else_block);
+        }
+        StmtRef while_stmt(ExprRef condition,BlockRef block){return arena->make<WhileStmt>(condition,block);}
+        FctDecl* fct_decl(FctHead<TreeSink>&& head,BlockRef block){
+            return arena->make<FctDecl>(head.ret_type,head.ident,std::move(head.params),block);
+        }
+        StmtRef class_stmt(ClassHead<TreeSink>&& head,BlockRef block){
+            return arena->make<ClassStmt>(head.ident,head.parent,block);
+        }
+        StmtRef var_decl(Name ident,ExprRef value,Type type){return arena->make<VarDeclInit>(ident,value,type);}
+        StmtRef return_stmt(ExprRef value){return arena->make<Return>(value);}
+
+        ExprRef binary(TokenKind op,ExprRef left,ExprRef right){
+            switch(op){
+                case TokenKind::PLUS: return arena->make<Add>(left,right);
+                case TokenKind::MINUS: return arena->make<Sub>(left,right);
+                case TokenKind::STAR: return arena->make<Mul>(left,right);
+                case TokenKind::SLASH: return arena->make<Div>(left,right);
+                case TokenKind::EQUAL_EQUAL: return arena->make<Equality>(left,right);
+                case TokenKind::BANG_EQUAL: return arena->make<NotEq>(left,right);
+                case TokenKind::LESS: return arena->make<Less>(left,right);
+                case TokenKind::GREATER: return arena->make<Great>(left,right);
+                case TokenKind::LESS_EQUAL: return arena->make<LessEq>(left,right);
+                case TokenKind::GREATER_EQUAL: return arena->make<GreatEq>(left,right);
+                case TokenKind::BIT_OR: return arena->make<BitOr>(left,right);
+                case TokenKind::BIT_AND: return arena->make<BitAnd>(left,right);
+                case TokenKind::BIT_RSHIFT: return arena->make<RShift>(left,right);
+                case TokenKind::BIT_LSHIFT: return arena->make<LShift>(left,right);
+                default: return nullptr;
+            }
+        }
+        ExprRef unary(TokenKind op,ExprRef operand){
+            if(op==TokenKind::MINUS){
+                return arena->make<Minus>(operand);
+            }
+            return arena->make<Negate>(operand);
+        }
+        ExprRef group(ExprRef expr){return arena->make<Group>(expr);}
+        ExprRef fct_call(ExprRef callee,ArgList&& args){return arena->make<FctCall>(callee,std::move(args));}
+        FctExpr* fct_expr(Type ret_type,ParamList&& params,BlockRef block){
+            return arena->make<FctExpr>(ret_type,std::move(params),block);
+        }
+        ExprRef int_value(std::int64_t value){return arena->make<Int>(value);}
+        ExprRef double_value(double value){return arena->make<Double>(value);}
+        ExprRef bool_value(bool value){return arena->make<Bool>(value);}
+        ExprRef str(std::string_view text){return arena->make<Str>(arena->copy(text));}
+        ExprRef symbol(IdentId ident){return arena->make<Symbol>(ident);}
+        ExprRef assign(IdentId ident,ExprRef value){return arena->make<Assign>(ident,value);}
+    };
+
+    // the nodes go to ast as they are made, children before their parent.
+    // The lists are all on one stack: the grammar closes a list before the
+    // one it is in
+    struct FlatSink{
+        using StmtRef=NodeId;
+        using ExprRef=NodeId;
+        using BlockRef=NodeId;
+        using Name=IdentId;
+        // where a list starts on lists
+        using StmtList=std::size_t;
+        using ArgList=std::size_t;
+        using ParamList=std::size_t;
+        static constexpr NodeId none=NoNode;
+        static constexpr bool lazy_bodies=false;
+
+        explicit FlatSink(FlatAst& ast):ast(&ast){}
+
+        FlatAst* ast;
+        std::vector<std::uint32_t> lists;
+        std::vector<ExprRef> operands;
+        std::vector<NestFrame<FlatSink>> nest_frames;
+        std::vector<StmtRef> nest_stmts;
+
+        StmtList stmts(){return lists.size();}
+        ArgList args(){return lists.size();}
+        ParamList params(){return lists.size();}
+        void push(std::size_t,NodeId id){lists.push_back(id);}
+        void param(ParamList,IdentId name,Type type){
+            lists.push_back(name);
+            lists.push_back(type);
+        }
+
+        // the Symbol of a name is only read, it is dropped again
+        Name name(ExprRef ident){
+            auto name=ast->nodes[ident].a;
+            if(ident+1==ast->size() && ast->nodes[ident].kind==NodeKind::Symbol){
+                ast->nodes.pop_back();
+            }
+            return name;
+        }
+
+        BlockRef block(StmtList stmts){
+            std::uint32_t count=lists.size()-stmts;
+            return ast->add(NodeKind::Block,0,close(stmts),count);
+        }
+        BlockRef nested_block(std::size_t mark){
+            std::uint32_t first=ast->extra.size();
+            ast->extra.insert(ast->extra.end(),nest_stmts.begin()+mark,nest_stmts.end());
+            return ast->add(NodeKind::Block,0,first,nest_stmts.size()-mark);
+        }
+        StmtRef if_else(ExprRef condition,BlockRef if_block,BlockRef else_block){
+            return ast->add(NodeKind::IfElse,condition,if_block,else_block);
+        }
+        StmtRef while_stmt(ExprRef condition,BlockRef block){return ast->add(NodeKind::WhileStmt,condition,block);}
+        StmtRef fct_decl(FctHead<FlatSink>&& head,BlockRef block){
+            return ast->add(NodeKind::FctDecl,head.ident,head.ret_type,fct(block,head.params));
+        }
+        StmtRef class_stmt(ClassHead<FlatSink>&& head,BlockRef block){
+            return ast->add(NodeKind::ClassStmt,head.ident,head.parent,block);
+        }
+        StmtRef var_decl(Name ident,ExprRef value,Type type){return ast->add(NodeKind::VarDeclInit,ident,type,value);}
+        StmtRef return_stmt(ExprRef value){return ast->add(NodeKind::Return,value);}
+
+        ExprRef binary(TokenKind op,ExprRef left,ExprRef right){
+            NodeKind kind;
+            switch(op){
+                case TokenKind::PLUS: kind=NodeKind::Add; break;
+                case TokenKind::MINUS: kind=NodeKind::Sub; break;
+                case TokenKind::STAR: kind=NodeKind::Mul; break;
+                case TokenKind::SLASH: kind=NodeKind::Div; break;
+                case TokenKind::EQUAL_EQUAL: kind=NodeKind::Equality; break;
+                case TokenKind::BANG_EQUAL: kind=NodeKind::NotEq; break;
+                case TokenKind::LESS: kind=NodeKind::Less; break;
+                case TokenKind::GREATER: kind=NodeKind::Great; break;
+                case TokenKind::LESS_EQUAL: kind=NodeKind::LessEq; break;
+                case TokenKind::GREATER_EQUAL: kind=NodeKind::GreatEq; break;
+                case TokenKind::BIT_OR: kind=NodeKind::BitOr; break;
+                case TokenKind::BIT_AND: kind=NodeKind::BitAnd; break;
+                case TokenKind::BIT_RSHIFT: kind=NodeKind::RShift; break;
+                case TokenKind::BIT_LSHIFT: kind=NodeKind::LShift; break;
+                default: return NoNode;
+            }
+            return ast->add(kind,left,right);
+        }
+        ExprRef unary(TokenKind op,ExprRef operand){
+            return ast->add(op==TokenKind::MINUS?NodeKind::Minus:NodeKind::Negate,operand);
+        }
+        ExprRef group(ExprRef expr){return ast->add(NodeKind::Group,expr);}
+        ExprRef fct_call(ExprRef callee,ArgList args){
+            std::uint32_t count=lists.size()-args;
+            return ast->add(NodeKind::FctCall,callee,close(args),count);
+        }
+        ExprRef fct_expr(Type ret_type,ParamList params,BlockRef block){
+            return ast->add(NodeKind::FctExpr,NoIdent,ret_type,fct(block,params));
+        }
+        ExprRef int_value(std::int64_t value){return bits(NodeKind::Int,std::bit_cast<std::uint64_t>(value));}
+        ExprRef double_value(double value){return bits(NodeKind::Double,std::bit_cast<std::uint64_t>(value));}
+        ExprRef bool_value(bool value){return ast->add(NodeKind::Bool,value);}
+        ExprRef str(std::string_view text){
+            std::uint32_t offset=ast->strings.size();
+            ast->strings.append(text);
+            return ast->add(NodeKind::Str,offset,text.size());
+        }
+        ExprRef symbol(IdentId ident){return ast->add(NodeKind::Symbol,ident);}
+        ExprRef assign(IdentId ident,ExprRef value){return ast->add(NodeKind::Assign,ident,value);}
+
+        private:
+            // moves the list from start to extra, where it is now
+            std::uint32_t close(std::size_t start){
+                std::uint32_t first=ast->extra.size();
+                ast->extra.insert(ast->extra.end(),lists.begin()+start,lists.end());
+                lists.resize(start);
+                return first;
+            }
+            // [block, param count, name, type, ...] in extra
+            std::uint32_t fct(BlockRef block,ParamList params){
+                std::uint32_t first=ast->extra.size();
+                ast->extra.push_back(block);
+                ast->extra.push_back((lists.size()-params)/2);
+                close(params);
+                return first;
+            }
+            ExprRef bits(NodeKind kind,std::uint64_t bits){
+                return ast->add(kind,static_cast<std::uint32_t>(bits),static_cast<std::uint32_t>(bits>>32));
+            }
+    };
+};
+
+#endif
@@ -1,52 +1,258 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include<cstdint>
 #include<expected>
+#include<memory>
 #include<optional>
+#include<string>
+#include<string_view>
+#include<vector>
 
 #include"lexer.h"
+#include"stream_lexer.h"
+#include"arena.h"
 #include"ast.h"
+#include"diagnostic.h"
 #include"error.h"
+#include"flat_ast.h"
+#include"node_sink.h"
 
 namespace tua{
 
+    class ThreadPool;
+
     const uint16_t MAX_PARAMS=128;
+    // block nesting allowed by default in explicit stack mode
+    const std::uint32_t MAX_NESTING=1<<16;
+    // expressions nested in one another, they recurse in both modes
+    const std::uint32_t MAX_EXPR_DEPTH=256;
+    // a Program reparsed that many times is parsed from scratch on the next
+    // edit, dropping the arenas of the statements replaced until then
+    const std::uint32_t MAX_REPARSES=1024;
+
+    // the removed bytes at offset of a source were replaced by inserted
+    struct Edit{
+        std::uint32_t offset;
+        std::uint32_t removed;
+        std::string_view inserted;
+    };
+
+    // how tightly a binary operator binds, 0 for tokens that aren't one.
+    // Same order as in C, all of them are left associative
+    constexpr int binary_precedence(TokenKind kind){
+        switch(kind){
+            case TokenKind::BIT_OR: return 1;
+            case TokenKind::BIT_AND: return 2;
+            case TokenKind::EQUAL_EQUAL:
+            case TokenKind::BANG_EQUAL: return 3;
+            case TokenKind::LESS:
+            case TokenKind::LESS_EQUAL:
+            case TokenKind::GREATER:
+            case TokenKind::GREATER_EQUAL: return 4;
+            case TokenKind::BIT_LSHIFT:
+            case TokenKind::BIT_RSHIFT: return 5;
+            case TokenKind::PLUS:
+            case TokenKind::MINUS: return 6;
+            case TokenKind::STAR:
+            case TokenKind::SLASH: return 7;
+            default: return 0;
+        }
+    }
+
+    // what parse_all() could make of a source
+    struct ParseResult{
+        Program program;
+        std::vector<Diagnostic> diagnostics;
+    };
 
     class Parser{
         public:
             Parser(Lexer&& lexer);
             Parser(Lexer& lexer);
+            // tokens are pulled from the stream while parsing, the text of a
+            // top level statement is released once it is parsed
+            Parser(StreamLexer& stream);
             std::expected<Program,Error*> parse();
+            // parse() that goes on after an error: the parser skips to the
+            // end of the statement it failed in, or to the } of the block
+            // around it, and keeps the statements that parse. Stops at the
+            // first lexer error, the tokens end there
+            ParseResult parse_all();
+            // the text of the ParseError for diagnostic
+            std::string message(const Diagnostic& diagnostic) const;
+            // same Program and errors as parse(). The top level statements
+            // are cut in runs at the ; outside parentheses and braces and
+            // the runs are parsed on the pool, each into its own arena.
+            // Stream parsers fall back to parse()
+            std::expected<Program,Error*> parse_parallel(ThreadPool& pool);
+            // parse() of text, previous being the Program of text before edit.
+            // The statements from the one the edit starts in are lexed and
+            // parsed again until one ends where an old one did past the
+            // edit, the others are taken over from previous with their
+            // nodes. On error previous is left alone but no longer matches
+            // text, the next edit has to start from a full parse. The bodies
+            // a lazy parser skipped in the statements taken over are read
+            // from text from then on, it has to outlive the program
+            static std::expected<Program,Error*> reparse(Program&& previous,std::string_view text,const Edit& edit);
+            // parses the next top level statement into arena, nullptr at the
+            // end of the source
+            std::expected<Stmt*,Error*> parse_next(Arena& arena);
+            // parse() with the nodes made as a FlatAst, no Program is made
+            // on the way
+            std::expected<FlatAst,Error*> parse_flat();
+            // parse() and parse_next() keep the open blocks on a heap stack
+            // instead of recursing into them. Blocks nested deeper than
+            // max_depth or expressions deeper than MAX_EXPR_DEPTH are a
+            // ParseError
+            void use_explicit_stack(std::uint32_t max_depth=MAX_NESTING);
+            // parse(), parse_all() and parse_next() only find the } of a
+            // function or lambda body and leave it to FctDecl::body() and
+            // FctExpr::body(), errors in the body come up there. Stream
+            // parsers and parse_flat() parse every body
+            void use_lazy_bodies();
+            // the body skipped at offset by a lazy parser, into its arena
+            static std::expected<Block*,Error*> parse_body(const LazySource& source,std::uint32_t offset);
         private:
+            // parses the tokens [first,last) of parent
+            Parser(const Parser& parent,std::size_t first,std::size_t last);
+            // lexes the tokens as they are reached
+            Parser(Lexer&& lexer,bool pull);
+            std::vector<std::size_t> top_level_runs(std::size_t target) const;
             bool at_end() const noexcept;
             bool match_token_kind(TokenKind kind) const;
-            std::expected<bool,Error*> consume_token();
-            std::expected<Stmt*,Error*> parse_stmt();
-            std::expected<Block*,Error*> parse_block();
-            std::expected<IfElse*,Error*> parse_if();
-            std::expected<FctDecl*,Error*> parse_fct_decl();
-            std::expected<ClassStmt*,Error*> parse_class();
-            std::expected<WhileStmt*,Error*> parse_while();
-            std::expected<VarDeclInit*,Error*> parse_vardeclinit();
-            std::expected<Type*,Error*> parse_type();
-            std::expected<Return*,Error*> parse_return();
-            std::expected<Expr*,Error*> parse_expr();
-            std::expected<Expr*,Error*> parse_term();
-            std::expected<Expr*,Error*> parse_factor();
-            std::expected<Expr*,Error*> parse_terminals();
-            std::expected<Expr*,Error*> parse_group();
-            std::expected<Expr*,Error*>parse_int();
-            std::expected<Expr*,Error*> parse_double();
-            std::expected<Expr*,Error*>parse_str();
-            std::expected<Expr*,Error*> parse_bool();
-            std::expected<Expr*,Error*> parse_fct_expr();
-            std::expected<Expr*,Error*> parse_symbol_assign();
-            std::expected<Expr*,Error*> parse_fctcalls();
-            std::expected<Expr*,Error*> parse_fctcall(Expr* expr);
+            TokenKind current_kind() const noexcept;
+            std::string_view current_lexeme() const noexcept;
+            IdentId current_ident() const noexcept;
+            std::uint32_t current_line() const noexcept;
+            void fetch_token();
+            // errors are Diagnostics inside the parser, the public calls
+            // make a ParseError of the one they stop at
+            Diagnostic diag(DiagCode code,bool lambda=false) const;
+            Diagnostic lex_error() const;
+            Error* to_error(const Diagnostic& diagnostic) const;
+            // records error in parse_all() mode and skips past it, false
+            // when the error can't be recovered from here
+            bool recover(Diagnostic& error,bool top_level=false);
+            bool synchronize(bool top_level);
+            std::expected<bool,Diagnostic> consume_token();
+            std::expected<bool,Diagnostic> end_top_level();
+            template<typename Node> using Parsed=std::expected<Node,Diagnostic>;
+            // parses the next top level statement with the nodes made by
+            // the tree sink into arena
+            Parsed<Stmt*> next_stmt(Arena& arena);
+            // the grammar, the nodes are made by sink. Sink::none past the
+            // last top level statement
+            template<typename Sink> Parsed<typename Sink::StmtRef> next_stmt(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_stmt(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_nested(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::BlockRef> parse_block(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_condition(Sink& sink);
+            template<typename Sink> Parsed<FctHead<Sink>> parse_fct_head(Sink& sink);
+            template<typename Sink> Parsed<ClassHead<Sink>> parse_class_head(Sink& sink);
+            Diagnostic class_body_error(Diagnostic error);
+            // moves past the } of the body starting at the current {,
+            // the offset of the { to parse it from later
+            std::expected<std::uint32_t,Diagnostic> skip_body();
+            const LazySource* lazy_source_here();
+            // program of the statements parsed, in the mode of the parser
+            Program make_program(std::unique_ptr<Arena>&& program_arena,Stmts&& stmts,std::vector<std::uint32_t>&& ends);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_if(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_fct_decl(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_class(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_while(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_vardeclinit(Sink& sink);
+            Parsed<Type> parse_type();
+            template<typename Sink> Parsed<typename Sink::StmtRef> parse_return(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_expr(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_unary(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_terminals(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_group(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_int(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_double(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_str(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_bool(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_fct_expr(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_symbol_assign(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_fctcalls(Sink& sink);
+            template<typename Sink> Parsed<typename Sink::ExprRef> parse_fctcall(Sink& sink,typename Sink::ExprRef expr);
+            // binary operators by precedence climbing over explicit stacks
+            // instead of one native frame per operator. operand() parses a
+            // prefix expression, make(op,left,right) builds the node
+            template<typename Node,typename Operand,typename Make>
+            std::expected<Node,Diagnostic> climb(std::vector<Node>& operands,Operand&& operand,Make&& make);
             Lexer _lexer;
-            std::optional<Token> current_token;
+            TokenBuffer tokens;
+            std::uint32_t current;
+            StreamLexer* stream;
+            // tokens are lexed one statement at a time, from stream when
+            // set or else from _lexer
+            bool pull;
+            // just past the ; ending the last top level statement
+            std::uint32_t stmt_end;
+            // where parse_all() collects the errors
+            std::vector<Diagnostic>* diagnostics;
+            // makes the nodes of parse() and the other calls building a
+            // Program
+            TreeSink tree;
+            // stack of the operators being parsed, each call of climb()
+            // works above what its callers left there
+            std::vector<TokenKind> operators;
+            // explicit stack mode when not 0
+            std::uint32_t max_depth;
+            std::uint32_t expr_depth;
+            // class bodies open around the current token in either mode,
+            // the prefixes of the errors parse_all() recovers from in them
+            std::uint16_t class_bodies=0;
+            bool lazy;
+            // for the bodies skipped into arena
+            std::shared_ptr<LazySource> lazy_source;
+            // the functions whose body was skipped, in source order
+            std::vector<Stmt*> skipped;
     };
 
+    template<typename Node,typename Operand,typename Make>
+    std::expected<Node,Diagnostic> Parser::climb(std::vector<Node>& operands,Operand&& operand,Make&& make){
+        auto operands_base=operands.size();
+        auto operators_base=operators.size();
+        auto fail=[&](Diagnostic error){
+            operands.resize(operands_base);
+            operators.resize(operators_base);
+            return std::unexpected(error);
+        };
+        auto reduce=[&]{
+            auto right=operands.back();
+            operands.pop_back();
+            operands.back()=make(operators.back(),operands.back(),right);
+            operators.pop_back();
+        };
+
+        auto first=operand();
+        if(!first){
+            return fail(first.error());
+        }
+        operands.push_back(first.value());
+        while(auto precedence=binary_precedence(current_kind())){
+            // what binds at least as tight as the new operator is complete
+            while(operators.size()>operators_base && binary_precedence(operators.back())>=precedence){
+                reduce();
+            }
+            operators.push_back(current_kind());
+            consume_token();
+            auto next=operand();
+            if(!next){
+                return fail(next.error());
+            }
+            operands.push_back(next.value());
+        }
+        while(operators.size()>operators_base){
+            reduce();
+        }
+        auto expr=operands.back();
+        operands.pop_back();
+        return expr;
+    }
+
 }
 
 #endif 
@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstdint>
+
+namespace tua::scan{
+
+    // ASCII classification, unlike <cctype> it does not depend on the C locale
+    constexpr bool is_space(char c) noexcept{ return c==' ' || (c>='\t' && c<='\r'); }
+    constexpr bool is_digit(char c) noexcept{ return c>='0' && c<='9'; }
+    constexpr bool is_alpha(char c) noexcept{ return (c>='a' && c<='z') || (c>='A' && c<='Z'); }
+    constexpr bool is_alnum(char c) noexcept{ return is_alpha(c) || is_digit(c); }
+
+    // the scanners below use AVX2 or SSE2 when the cpu supports them (checked
+    // once at runtime) and fall back to a byte by byte loop otherwise
+
+    // first position in [p,end) that is not a space
+    const char* skip_space(const char* p,const char* end) noexcept;
+
+    // first position in [p,end) that is not alphanumeric
+    const char* skip_alnum(const char* p,const char* end) noexcept;
+
+    // first position in [p,end) holding c, end when there is none
+    const char* find_byte(const char* p,const char* end,char c) noexcept;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef SEMA_H
+#define SEMA_H
+
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+
+namespace tua{
+
+    // the interned names of the builtin types, float is another name of
+    // double and resolves to it. Interned on each call so they are there
+    // again after Interner::truncate()
+    struct BuiltinTypes{
+        Type int_type;
+        Type double_type;
+        Type bool_type;
+        Type str_type;
+        Type fn_type;
+    };
+
+    BuiltinTypes builtin_types();
+
+    // resolves every Type of program to a builtin or a class name and
+    // sets Expr::type bottom up:
+    //   int op int is int, int op double is double, str + str is str
+    //   comparisons and ! are bool, | & << >> need ints
+    //   a call to a fun in scope has its return type, to anything else
+    //   it is unknown
+    // lets, assignments, arguments and returns must be of the declared
+    // type, where a type is unknown (a name declared without let, a call
+    // through a fn) it isn't checked. Returns every mismatch, none when
+    // program is well typed
+    std::vector<Error*> check_types(Program& program);
+
+    // sets Symbol::resolved and Assign::resolved to where compile() finds
+    // the name: the slot of a local of the function using it, a local of
+    // a function depth out that it captures, the function itself by its
+    // own name, or a global. The top level frame only has the locals of
+    // its blocks. The slots captured by an inner function go in captured_
+    // of the function declaring them, or captured of program. Returns the
+    // names read that no let, fun, class or assignment makes a global,
+    // and the top level reads of a global before its let or fun
+    std::vector<Error*> resolve(Program& program);
+};
+
+#endif
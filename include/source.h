@@ -0,0 +1,38 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace tua{
+
+    // text scanned by the Lexer, either owned or a read only mapping of a
+    // file. text().data()[text().size()] is always a readable '\0': files
+    // filling their last page exactly are read into memory instead of mapped
+    class Source{
+        public:
+            explicit Source(std::string&& text):owned(std::move(text)){}
+            Source(Source&& other) noexcept;
+            Source& operator=(Source&& other) noexcept;
+            Source(const Source&)=delete;
+            Source& operator=(const Source&)=delete;
+            ~Source();
+
+            static std::optional<Source> map_file(std::string_view path);
+
+            std::string_view text() const noexcept;
+            bool is_mapped() const noexcept {return mapped!=nullptr;}
+
+        private:
+            Source()=default;
+            void unmap() noexcept;
+
+            std::string owned;
+            const char* mapped=nullptr;
+            std::size_t mapped_size=0;
+    };
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef STREAM_LEXER_H
+#define STREAM_LEXER_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+
+#include "lexer.h"
+
+namespace tua{
+
+    // lexes an istream chunk by chunk. Only the bytes not released yet plus
+    // one chunk are kept in memory, tokens, strings and comments crossing a
+    // chunk boundary are lexed once the next chunk is read. Token offsets
+    // count from the start of the stream
+    class StreamLexer {
+        public:
+            StreamLexer(std::istream& input,std::size_t chunk_size=1<<16);
+            StreamLexer(const StreamLexer&)=delete;
+            StreamLexer& operator=(const StreamLexer&)=delete;
+
+            // the lexeme view is valid until the next call
+            const Token get_token();
+            // the bytes before offset are not needed anymore, offset can't
+            // be past the end of the last token returned
+            void release(std::uint32_t offset) noexcept;
+            std::string_view text(std::uint32_t offset,std::uint32_t length) const noexcept;
+            // counted in the window, offset must not be released
+            std::uint32_t line_of(std::uint32_t offset) const noexcept;
+            std::size_t buffered() const noexcept {return window.size();}
+
+        private:
+            bool refill();
+
+            std::istream& input;
+            std::size_t chunk_size;
+            // bytes [base,base+window.size()) of the stream
+            std::string window;
+            std::uint32_t base;
+            std::uint32_t base_line;
+            std::uint32_t pos;
+            std::uint32_t token_end;
+            std::uint32_t released;
+            // lexes each token in window, moved to it. Its line starts are
+            // never looked up, line_of() counts them in the window
+            Lexer lexer;
+            bool in_comment;
+            bool eof;
+    };
+};
+
+#endif
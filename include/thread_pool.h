@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tua{
+
+    // fixed set of worker threads running one parallel_for at a time, the
+    // indices are handed out one by one so slow tasks don't hold the others
+    class ThreadPool{
+        public:
+            explicit ThreadPool(unsigned threads=std::thread::hardware_concurrency());
+            ThreadPool(const ThreadPool&)=delete;
+            ThreadPool& operator=(const ThreadPool&)=delete;
+            ~ThreadPool();
+
+            // runs task(i) for every i in [0,count), the calling thread takes
+            // part, returns once every task is done
+            void parallel_for(std::size_t count,const std::function<void(std::size_t)>& task);
+            unsigned size() const noexcept {return workers.size()+1;}
+
+        private:
+            void work();
+            void run_tasks();
+
+            std::vector<std::thread> workers;
+            std::mutex mutex;
+            std::condition_variable wake,done;
+            std::size_t generation=0;
+            bool stop=false;
+
+            const std::function<void(std::size_t)>* task=nullptr;
+            std::size_t count=0;
+            std::atomic<std::size_t> next{0};
+            std::size_t finished=0;
+    };
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tua{
+
+    struct Function;
+
+    // Undefined only marks globals not assigned yet, scripts can't make one
+    enum class ValueKind : std::uint8_t { Nil, Bool, Int, Double, Str, Fct, Undefined };
+
+    enum class ObjKind : std::uint8_t { Str, Closure };
+
+    // what values point to on the heap of the vm. Objects made by a run are
+    // linked in next and freed once no value reaches them, string literals
+    // belong to their Module
+    struct Obj{
+        Obj(ObjKind kind):kind(kind){}
+        ObjKind kind;
+        bool marked=false;
+        Obj* next=nullptr;
+    };
+
+    struct StrObj:Obj{
+        StrObj(std::string&& value):Obj(ObjKind::Str),value(std::move(value)){}
+        std::string value;
+    };
+
+    struct ClosureObj;
+
+    // 16 bytes, copied around by value
+    struct Value{
+        Value():kind(ValueKind::Nil),i(0){}
+        explicit Value(bool b):kind(ValueKind::Bool),i(0){this->b=b;}
+        explicit Value(std::int64_t i):kind(ValueKind::Int),i(i){}
+        explicit Value(double d):kind(ValueKind::Double),d(d){}
+        explicit Value(StrObj* str):kind(ValueKind::Str),obj(str){}
+        explicit Value(ClosureObj* closure);
+        static Value undefined(){Value value; value.kind=ValueKind::Undefined; return value;}
+
+        std::string_view str() const noexcept {return static_cast<StrObj*>(obj)->value;}
+        ClosureObj* closure() const noexcept;
+
+        ValueKind kind;
+        union{
+            bool b;
+            std::int64_t i;
+            double d;
+            Obj* obj;
+        };
+    };
+    static_assert(sizeof(Value)==16);
+
+    // the values a function uses from the ones around it, copied when the
+    // closure is made
+    struct ClosureObj:Obj{
+        ClosureObj(const Function* fct):Obj(ObjKind::Closure),fct(fct){}
+        const Function* fct;
+        std::vector<Value> captures;
+    };
+
+    inline Value::Value(ClosureObj* closure):kind(ValueKind::Fct),obj(closure){}
+    inline ClosureObj* Value::closure() const noexcept {return static_cast<ClosureObj*>(obj);}
+
+    // false, nil, 0 and 0.0 are false
+    inline bool truthy(const Value& value) noexcept {
+        switch(value.kind){
+            case ValueKind::Nil: return false;
+            case ValueKind::Bool: return value.b;
+            case ValueKind::Int: return value.i!=0;
+            case ValueKind::Double: return value.d!=0;
+            default: return true;
+        }
+    }
+
+    bool operator==(const Value& left,const Value& right) noexcept;
+    std::string to_string(const Value& value);
+};
+
+#endif
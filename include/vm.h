@@ -0,0 +1,58 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "error.h"
+#include "value.h"
+
+namespace tua{
+
+    // calls deeper than that are a RuntimeError
+    const std::uint32_t MAX_FRAMES=1024;
+    const std::size_t STACK_SIZE=1<<18;
+
+    // runs the bytecode of a Module. Strings and closures made by a run
+    // live on the heap of the vm, they are freed when nothing on the
+    // stack or in a global reaches them, or by the next run
+    class VM{
+        public:
+            VM();
+            VM(const VM&)=delete;
+            VM& operator=(const VM&)=delete;
+            ~VM();
+
+            // the value of the top level return, nil when there is none
+            std::expected<Value,Error*> run(const Module& module);
+
+        private:
+            struct Frame{
+                const std::uint8_t* ip;
+                Value* base;
+                ClosureObj* closure;
+            };
+
+            StrObj* new_str(std::string&& value,Value* top);
+            ClosureObj* new_closure(const Function* fct,Value* top);
+            void track(Obj* obj,std::size_t size,Value* top);
+            // mark and sweep, the stack up to top and the globals are the roots
+            void collect(Value* top);
+            void free_objects();
+
+            std::unique_ptr<Value[]> stack;
+            std::unique_ptr<Frame[]> frames;
+            std::vector<Value> globals;
+            Obj* objects;
+            std::size_t allocated;
+            std::size_t next_collect;
+            std::vector<Obj*> gray;
+    };
+};
+
+#endif
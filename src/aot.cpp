@@ -0,0 +1,130 @@
+#include<memory>
+#include<optional>
+#include<string>
+#include<string_view>
+#include<system_error>
+#include<unordered_set>
+
+#include<llvm/Config/llvm-config.h>
+#include<llvm/IR/LegacyPassManager.h>
+#include<llvm/IR/LLVMContext.h>
+#include<llvm/IR/Module.h>
+#include<llvm/MC/TargetRegistry.h>
+#include<llvm/Support/CodeGen.h>
+#include<llvm/Support/FileSystem.h>
+#include<llvm/Support/TargetSelect.h>
+#include<llvm/Support/raw_ostream.h>
+#include<llvm/Target/TargetMachine.h>
+#include<llvm/Target/TargetOptions.h>
+#if LLVM_VERSION_MAJOR>=17
+#include<llvm/TargetParser/Host.h>
+#else
+#include<llvm/Support/Host.h>
+#endif
+
+#include"aot.h"
+
+namespace tua{
+
+namespace {
+
+Error* aot_error(const std::string& msg){
+    return new CompileError("aot : "+msg);
+}
+
+const char* cpp_type(NativeType type){
+    switch(type){
+        case NativeType::Int: return "std::int64_t";
+        case NativeType::Double: return "double";
+        default: return "bool";
+    }
+}
+
+// a function named after a C++ keyword gets a _ like the params, tua names
+// have no _ so it can't meet another one. Keywords with a _ are left out
+std::string cpp_name(IdentId name){
+    static const std::unordered_set<std::string_view> keywords{
+        "alignas","alignof","and","asm","auto","bitand","bitor","bool","break","case","catch",
+        "char","class","compl","concept","const","consteval","constexpr","constinit","continue",
+        "decltype","default","delete","do","double","else","enum","explicit","export","extern",
+        "false","float","for","friend","goto","if","inline","int","long","mutable","namespace",
+        "new","noexcept","not","nullptr","operator","or","private","protected","public","register",
+        "requires","return","short","signed","sizeof","static","struct","switch","template","this",
+        "throw","true","try","typedef","typeid","typename","union","unsigned","using","virtual",
+        "void","volatile","while","xor",
+    };
+    auto text=std::string(ident_name(name));
+    return keywords.count(text)?text+"_":text;
+}
+
+};
+
+std::expected<std::vector<Lowered>,Error*> compile_object(Program& program,std::string_view object_path){
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto triple=llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    auto target=llvm::TargetRegistry::lookupTarget(triple,error);
+    if(!target) return std::unexpected(aot_error(error));
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(triple,"generic","",llvm::TargetOptions(),llvm::Reloc::PIC_));
+    if(!machine) return std::unexpected(aot_error("no target machine for "+triple));
+
+    llvm::LLVMContext context;
+    llvm::Module ir("tua",context);
+    ir.setTargetTriple(triple);
+    ir.setDataLayout(machine->createDataLayout());
+    auto lowered=lower(program,ir,std::string(AOT_PREFIX));
+    optimize(ir);
+
+    std::error_code failed;
+    llvm::raw_fd_ostream out(llvm::StringRef(object_path.data(),object_path.size()),failed,llvm::sys::fs::OF_None);
+    if(failed) return std::unexpected(aot_error(std::string(object_path)+" : "+failed.message()));
+    llvm::legacy::PassManager passes;
+#if LLVM_VERSION_MAJOR>=18
+    auto file_type=llvm::CodeGenFileType::ObjectFile;
+#else
+    auto file_type=llvm::CGFT_ObjectFile;
+#endif
+    if(machine->addPassesToEmitFile(passes,out,nullptr,file_type)){
+        return std::unexpected(aot_error("can't write objects for "+triple));
+    }
+    passes.run(ir);
+    out.flush();
+    if(out.has_error()) return std::unexpected(aot_error(std::string(object_path)+" : "+out.error().message()));
+    return lowered;
+}
+
+std::string cpp_header(const std::vector<Lowered>& lowered){
+    std::string header=
+        "// generated by tua, functions of the script compiled ahead of time\n"
+        "#pragma once\n\n"
+        "#include <cstdint>\n"
+        "#include <optional>\n\n"
+        "extern \"C\" {\n";
+    for(auto& fct:lowered){
+        header+="    bool "+fct.symbol+"(";
+        for(auto param:fct.params) header+=std::string(cpp_type(param))+",";
+        header+=std::string(cpp_type(fct.ret))+"*,std::int32_t);\n";
+    }
+    header+="}\n\nnamespace tua::native{\n";
+    for(auto& fct:lowered){
+        auto ret=std::string(cpp_type(fct.ret));
+        std::string params,args;
+        for(std::size_t i=0;i<fct.params.size();i++){
+            // tua names have no _, these can't be a keyword or out
+            auto name=std::string(ident_name(fct.param_names[i]))+"_";
+            params+=(i?",":"")+std::string(cpp_type(fct.params[i]))+" "+name;
+            args+=name+",";
+        }
+        // called as from the top level of a script, in frame 1
+        header+="    inline std::optional<"+ret+"> "+cpp_name(fct.name)+"("+params+"){\n"
+            "        "+ret+" out;\n"
+            "        if(!"+fct.symbol+"("+args+"&out,1)) return std::nullopt;\n"
+            "        return out;\n"
+            "    }\n";
+    }
+    header+="}\n";
+    return header;
+}
+
+};
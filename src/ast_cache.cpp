@@ -0,0 +1,291 @@
+#include<bit>
+#include<cstdint>
+#include<cstdio>
+#include<cstring>
+#include<expected>
+#include<filesystem>
+#include<fstream>
+#include<random>
+#include<string>
+#include<string_view>
+#include<unordered_map>
+#include<vector>
+
+#include"ast_cache.h"
+#include"lexer.h"
+#include"parser.h"
+
+namespace tua{
+
+    namespace {
+        constexpr char MAGIC[4]={'T','U','A','C'};
+        // written as is, a file from a machine of the other byte order
+        // reads it reversed
+        constexpr std::uint32_t ENDIAN_MARK=0x01020304;
+
+        struct Header{
+            char magic[4];
+            std::uint32_t version;
+            std::uint32_t byte_order;
+            std::uint32_t node_size;
+            std::uint64_t hash;
+            // counts of each section and where it starts in the file
+            std::uint32_t nodes,nodes_at;
+            std::uint32_t extra,extra_at;
+            std::uint32_t stmts,stmts_at;
+            std::uint32_t names,names_at;
+            std::uint32_t strings,strings_at;
+            std::uint32_t name_bytes,name_bytes_at;
+        };
+
+        std::uint64_t mix(std::uint64_t value) noexcept{
+            value^=value>>31;
+            value*=0xbf58476d1ce4e5b9;
+            value^=value>>29;
+            return value;
+        }
+
+        template<typename T> std::span<const T> section(std::string_view file,std::uint32_t at,std::uint32_t count){
+            return std::span<const T>(reinterpret_cast<const T*>(file.data()+at),count);
+        }
+
+        bool fits(std::string_view file,std::uint32_t at,std::uint64_t bytes){
+            return at%8==0 && at<=file.size() && bytes<=file.size()-at;
+        }
+
+        // the first node of ast with a child, a range of extra, a string or
+        // a name out of bounds, NoNode when there is none. A child has to
+        // come before its parent and be a Block where one is expected, an
+        // Expr where one is
+        NodeId bad_node(const FlatView& ast,std::uint32_t names){
+            std::uint64_t extra=ast.extra.size();
+            for(NodeId id=0;id<ast.size();id++){
+                const auto& node=ast[id];
+                auto stmt=[&](NodeId child){return child<id;};
+                auto expr=[&](NodeId child){return child<id && ast[child].kind>=NodeKind::Add;};
+                auto block=[&](NodeId child){return child<id && ast[child].kind==NodeKind::Block;};
+                auto name=[&](std::uint32_t name){return name<names;};
+                auto range=[&](std::uint64_t first,std::uint64_t count,auto&& each){
+                    if(first>extra || count>extra-first) return false;
+                    for(auto i=first;i<first+count;i++){
+                        if(!each(ast.extra[i])) return false;
+                    }
+                    return true;
+                };
+                bool ok=true;
+                switch(node.kind){
+                    case NodeKind::Block: ok=range(node.b,node.c,stmt); break;
+                    case NodeKind::ClassStmt: ok=name(node.a) && name(node.b) && block(node.c); break;
+                    case NodeKind::FctDecl:
+                    case NodeKind::FctExpr: ok=name(node.a) && name(node.b) && node.c<extra && extra-node.c>=2
+                                            && block(ast.extra[node.c]) && range(node.c+2ull,ast.extra[node.c+1]*2ull,name); break;
+                    case NodeKind::VarDeclInit: ok=name(node.a) && name(node.b) && (node.c==NoNode || expr(node.c)); break;
+                    case NodeKind::IfElse: ok=expr(node.a) && block(node.b) && (node.c==NoNode || block(node.c)); break;
+                    case NodeKind::WhileStmt: ok=expr(node.a) && block(node.b); break;
+                    case NodeKind::Return: ok=expr(node.a); break;
+                    case NodeKind::Int:
+                    case NodeKind::Double: break;
+                    case NodeKind::Str: ok=node.a<=ast.strings.size() && node.b<=ast.strings.size()-node.a; break;
+                    case NodeKind::Bool: ok=node.a<=1; break;
+                    case NodeKind::Symbol: ok=name(node.a); break;
+                    case NodeKind::Assign: ok=name(node.a) && expr(node.b); break;
+                    case NodeKind::FctCall: ok=expr(node.a) && range(node.b,node.c,expr); break;
+                    default:
+                        if(is_binary(node.kind)) ok=expr(node.a) && expr(node.b);
+                        else ok=is_unary(node.kind) && expr(node.a);
+                }
+                if(!ok) return id;
+            }
+            return NoNode;
+        }
+
+        Error* cache_error(std::string_view path,const std::string& why){
+            return new CacheError(std::string(path)+" : "+why);
+        }
+    };
+
+    std::uint64_t source_hash(std::string_view text) noexcept{
+        constexpr std::uint64_t K=0x9e3779b97f4a7c15;
+        std::uint64_t hash=text.size()*K;
+        std::size_t i=0;
+        for(;i+8<=text.size();i+=8){
+            std::uint64_t word;
+            std::memcpy(&word,text.data()+i,8);
+            hash=std::rotl((hash^mix(word))*K,27);
+        }
+        std::uint64_t tail=0;
+        if(i<text.size()){
+            std::memcpy(&tail,text.data()+i,text.size()-i);
+        }
+        return mix((hash^mix(tail))*K);
+    }
+
+    bool write_ast_cache(std::string_view path,const FlatAst& ast,std::uint64_t hash){
+        // names get file local numbers, the global ids mean nothing to
+        // another process
+        auto nodes=ast.nodes;
+        auto extra=ast.extra;
+        std::vector<IdentId> globals{NoIdent};
+        std::unordered_map<IdentId,std::uint32_t> locals{{NoIdent,0}};
+        auto rename=[&](std::uint32_t& id){
+            auto [local,added]=locals.try_emplace(id,globals.size());
+            if(added) globals.push_back(id);
+            id=local->second;
+        };
+        for(auto& node:nodes){
+            switch(node.kind){
+                case NodeKind::ClassStmt:
+                case NodeKind::VarDeclInit: rename(node.a); rename(node.b); break;
+                case NodeKind::FctDecl:
+                case NodeKind::FctExpr:{
+                                           rename(node.a);
+                                           rename(node.b);
+                                           auto first=node.c;
+                                           for(std::uint32_t i=0;i<extra[first+1]*2;i++) rename(extra[first+2+i]);
+                                           break;
+                                       }
+                case NodeKind::Symbol:
+                case NodeKind::Assign: rename(node.a); break;
+                default: break;
+            }
+        }
+        std::vector<std::uint32_t> names;
+        std::string name_bytes;
+        for(auto id:globals){
+            auto name=ident_name(id);
+            names.push_back(name_bytes.size());
+            names.push_back(name.size());
+            name_bytes+=name;
+        }
+
+        Header header{};
+        std::memcpy(header.magic,MAGIC,4);
+        header.version=AST_CACHE_VERSION;
+        header.byte_order=ENDIAN_MARK;
+        header.node_size=sizeof(FlatNode);
+        header.hash=hash;
+        std::string file(sizeof(Header),'\0');
+        auto put=[&](const void* data,std::size_t bytes,std::uint32_t& at){
+            file.resize((file.size()+7)/8*8);
+            at=file.size();
+            file.append(static_cast<const char*>(data),bytes);
+        };
+        header.nodes=nodes.size();
+        put(nodes.data(),nodes.size()*sizeof(FlatNode),header.nodes_at);
+        header.extra=extra.size();
+        put(extra.data(),extra.size()*sizeof(std::uint32_t),header.extra_at);
+        header.stmts=ast.stmts.size();
+        put(ast.stmts.data(),ast.stmts.size()*sizeof(NodeId),header.stmts_at);
+        header.names=globals.size();
+        put(names.data(),names.size()*sizeof(std::uint32_t),header.names_at);
+        header.strings=ast.strings.size();
+        put(ast.strings.data(),ast.strings.size(),header.strings_at);
+        header.name_bytes=name_bytes.size();
+        put(name_bytes.data(),name_bytes.size(),header.name_bytes_at);
+        std::memcpy(file.data(),&header,sizeof(Header));
+
+        // next to path so the rename stays on one file system
+        auto temp=std::string(path)+"."+std::to_string(std::random_device()())+".tmp";
+        {
+            std::ofstream out(temp,std::ios::binary|std::ios::trunc);
+            out.write(file.data(),file.size());
+            if(!out.flush()){
+                out.close();
+                std::remove(temp.c_str());
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temp,std::filesystem::path(path),error);
+        if(error){
+            std::remove(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::expected<AstCache,Error*> AstCache::load(std::string_view path,std::uint64_t hash){
+        auto file=Source::map_file(path);
+        if(!file){
+            return std::unexpected(cache_error(path,"can't be read"));
+        }
+        auto text=file->text();
+        Header header;
+        if(text.size()<sizeof(Header) || std::memcmp(text.data(),MAGIC,4)){
+            return std::unexpected(cache_error(path,"isn't an AST cache"));
+        }
+        std::memcpy(&header,text.data(),sizeof(Header));
+        if(header.version!=AST_CACHE_VERSION || header.byte_order!=ENDIAN_MARK || header.node_size!=sizeof(FlatNode)){
+            return std::unexpected(cache_error(path,"AST cache of another version"));
+        }
+        if(header.hash!=hash){
+            return std::unexpected(cache_error(path,"AST cache of another source"));
+        }
+        if(!fits(text,header.nodes_at,std::uint64_t(header.nodes)*sizeof(FlatNode))
+                || !fits(text,header.extra_at,std::uint64_t(header.extra)*sizeof(std::uint32_t))
+                || !fits(text,header.stmts_at,std::uint64_t(header.stmts)*sizeof(NodeId))
+                || !fits(text,header.names_at,std::uint64_t(header.names)*2*sizeof(std::uint32_t))
+                || !fits(text,header.strings_at,header.strings)
+                || !fits(text,header.name_bytes_at,header.name_bytes)
+                || !header.names){
+            return std::unexpected(cache_error(path,"AST cache truncated"));
+        }
+
+        auto names=section<std::uint32_t>(text,header.names_at,header.names*2);
+        auto name_bytes=text.substr(header.name_bytes_at,header.name_bytes);
+        std::vector<IdentId> idents;
+        idents.reserve(header.names);
+        auto& interner=Interner::global();
+        for(std::uint32_t i=0;i<header.names;i++){
+            if(names[2*i]>name_bytes.size() || names[2*i+1]>name_bytes.size()-names[2*i]){
+                return std::unexpected(cache_error(path,"name "+std::to_string(i)+" out of bounds"));
+            }
+            idents.push_back(interner.intern(name_bytes.substr(names[2*i],names[2*i+1])));
+        }
+        AstCache cache(std::move(*file),std::move(idents));
+        auto ast=cache.view();
+        if(auto bad=bad_node(ast,header.names);bad!=NoNode){
+            return std::unexpected(cache_error(path,"node "+std::to_string(bad)+" out of bounds"));
+        }
+        for(auto stmt:ast.stmts){
+            if(stmt>=ast.size()){
+                return std::unexpected(cache_error(path,"statement "+std::to_string(stmt)+" out of bounds"));
+            }
+        }
+        return cache;
+    }
+
+    FlatView AstCache::view() const noexcept{
+        if(idents.empty()){
+            return parsed.view();
+        }
+        auto text=file.text();
+        Header header;
+        std::memcpy(&header,text.data(),sizeof(Header));
+        return FlatView{
+            section<FlatNode>(text,header.nodes_at,header.nodes),
+            section<std::uint32_t>(text,header.extra_at,header.extra),
+            text.substr(header.strings_at,header.strings),
+            section<NodeId>(text,header.stmts_at,header.stmts),
+            idents,
+        };
+    }
+
+    std::expected<AstCache,Error*> load_or_parse(std::string_view cache_path,std::string_view source){
+        auto hash=source_hash(source);
+        // a cache that can't be used is parsed over and written again
+        auto cache=AstCache::load(cache_path,hash);
+        if(cache){
+            return std::move(*cache);
+        }
+        // a miss is no error of the caller, every cold start has one
+        delete cache.error();
+        auto ast=Parser(Lexer::view(source)).parse_flat();
+        if(!ast){
+            return std::unexpected(ast.error());
+        }
+        // a cache that can't be written only costs the next run a parse
+        write_ast_cache(cache_path,ast.value(),hash);
+        return AstCache(std::move(ast.value()));
+    }
+};
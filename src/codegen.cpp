@@ -0,0 +1,611 @@
+#include<cstddef>
+#include<cstdint>
+#include<optional>
+#include<string>
+#include<unordered_map>
+#include<unordered_set>
+#include<vector>
+
+#include<llvm/ADT/STLExtras.h>
+#include<llvm/Config/llvm-config.h>
+#include<llvm/IR/BasicBlock.h>
+#include<llvm/IR/Constants.h>
+#include<llvm/IR/DerivedTypes.h>
+#include<llvm/IR/Function.h>
+#include<llvm/IR/IRBuilder.h>
+#include<llvm/IR/LLVMContext.h>
+#include<llvm/IR/Module.h>
+#include<llvm/IR/Verifier.h>
+#include<llvm/Passes/OptimizationLevel.h>
+#include<llvm/Passes/PassBuilder.h>
+
+#include"ast.h"
+#include"ast_visitor.h"
+#include"codegen.h"
+#include"value.h"
+#include"vm.h"
+
+namespace tua{
+
+namespace {
+
+static_assert(offsetof(Value,i)==8);
+
+llvm::PointerType* pointer_to(llvm::Type* type){
+#if LLVM_VERSION_MAJOR>=15
+    return llvm::PointerType::getUnqual(type->getContext());
+#else
+    return llvm::PointerType::getUnqual(type);
+#endif
+}
+
+ValueKind value_kind(NativeType type){
+    switch(type){
+        case NativeType::Int: return ValueKind::Int;
+        case NativeType::Double: return ValueKind::Double;
+        default: return ValueKind::Bool;
+    }
+}
+
+// names given a value outside of their declaration, a function whose
+// name is one of them may not be the one called
+struct Assigned:AstVisitor<Assigned>{
+    std::unordered_set<IdentId> names;
+    bool top_level=true;
+
+    void each(const Stmts& stmts){for(auto stmt:stmts) dispatch(stmt);}
+    void body(Block* block){
+        auto was=top_level;
+        top_level=false;
+        each(block->stmts);
+        top_level=was;
+    }
+
+    void visit(Block* block){body(block);}
+    void visit(ClassStmt* cls){body(cls->block_);}
+    void visit(FctDecl* fct){
+        if(!top_level) names.insert(fct->ident_->ident_);
+        if(auto block=fct->body()) body(block.value());
+    }
+    void visit(VarDeclInit* var){
+        if(top_level) names.insert(var->ident_->ident_);
+        if(var->value_) dispatch(var->value_);
+    }
+    void visit(IfElse* ifelse){
+        dispatch(ifelse->condition_);
+        body(ifelse->if_);
+        if(ifelse->else_) body(ifelse->else_);
+    }
+    void visit(WhileStmt* loop){dispatch(loop->condition_); body(loop->block_);}
+    void visit(Return* ret){dispatch(ret->value_);}
+    void visit(BinExpr* node){operands(node);}
+    void visit(UnaryExpr* node){operands(node);}
+    void visit(Expr*){}
+    void visit(Assign* assign){names.insert(assign->ident_); dispatch(assign->value_);}
+    void visit(FctCall* call){
+        dispatch(call->expr_);
+        for(auto arg:call->exprs_) dispatch(arg);
+    }
+    void visit(FctExpr* fct){
+        if(auto block=fct->body()) body(block.value());
+    }
+    void operands(Expr* expr){
+        walk_operators(expr,[&](Expr* operand){dispatch(operand); return true;},[](Expr*){return true;});
+    }
+};
+
+class Lowering{
+    public:
+        Lowering(llvm::Module& module,const std::string& prefix):
+            module(module),context(module.getContext()),builder(module.getContext()),prefix(prefix),
+            type_names{
+                {Interner::global().intern("int"),NativeType::Int},
+                {Interner::global().intern("double"),NativeType::Double},
+                {Interner::global().intern("float"),NativeType::Double},
+                {Interner::global().intern("bool"),NativeType::Bool}}{}
+
+        std::vector<Lowered> lower(Program& program){
+            std::unordered_map<IdentId,std::size_t> count;
+            for(auto stmt:program.stmts){
+                if(auto fct=node_cast<FctDecl>(stmt)) count[fct->ident_->ident_]++;
+            }
+            Assigned assigned;
+            assigned.each(program.stmts);
+
+            for(auto stmt:program.stmts){
+                auto fct=node_cast<FctDecl>(stmt);
+                if(!fct) continue;
+                auto name=fct->ident_->ident_;
+                auto signature=signature_of(fct);
+                if(count[name]!=1 || assigned.names.count(name) || !signature || !fct->body()) continue;
+                candidates.emplace(name,Candidate{fct,std::move(*signature),nullptr});
+            }
+
+            // a function that can't be lowered takes the ones calling it
+            // along, lower them all again without it until none fails
+            while(true){
+                clear();
+                for(auto& [name,candidate]:candidates){
+                    candidate.function=declare(name,candidate.signature);
+                }
+                std::vector<IdentId> failed;
+                for(auto& [name,candidate]:candidates){
+                    if(!define(candidate)) failed.push_back(name);
+                }
+                if(failed.empty()) break;
+                for(auto name:failed) candidates.erase(name);
+            }
+
+            // in the order of the source
+            std::vector<Lowered> lowered;
+            for(auto stmt:program.stmts){
+                auto fct=node_cast<FctDecl>(stmt);
+                if(!fct) continue;
+                auto found=candidates.find(fct->ident_->ident_);
+                if(found==candidates.end()) continue;
+                auto& [name,candidate]=*found;
+                std::vector<IdentId> param_names;
+                for(auto& [param,type]:fct->params_) param_names.push_back(param);
+                auto entry=define_entry(name,candidate);
+                lowered.push_back(Lowered{name,candidate.signature.params,std::move(param_names),candidate.signature.ret,
+                        candidate.function->getName().str(),entry->getName().str()});
+            }
+            return lowered;
+        }
+
+    private:
+        struct Signature{
+            std::vector<NativeType> params;
+            NativeType ret;
+        };
+
+        struct Candidate{
+            FctDecl* decl;
+            Signature signature;
+            llvm::Function* function;
+        };
+
+        struct Typed{
+            llvm::Value* value;
+            NativeType type;
+        };
+
+        struct Local{
+            IdentId name;
+            NativeType type;
+            llvm::AllocaInst* slot;
+            std::uint32_t depth;
+        };
+
+        std::optional<NativeType> type_of(Type type) const {
+            auto found=type_names.find(type);
+            if(found==type_names.end()) return std::nullopt;
+            return found->second;
+        }
+
+        std::optional<Signature> signature_of(FctDecl* fct) const {
+            Signature signature;
+            auto ret=type_of(fct->ret_type_);
+            if(!ret) return std::nullopt;
+            signature.ret=*ret;
+            for(auto& [param,type]:fct->params_){
+                auto native=type_of(type);
+                if(!native) return std::nullopt;
+                signature.params.push_back(*native);
+            }
+            return signature;
+        }
+
+        llvm::Type* llvm_type(NativeType type){
+            switch(type){
+                case NativeType::Int: return builder.getInt64Ty();
+                case NativeType::Double: return builder.getDoubleTy();
+                default: return builder.getInt1Ty();
+            }
+        }
+
+        void clear(){
+            for(auto& function:module.functions()) function.dropAllReferences();
+            for(auto& function:llvm::make_early_inc_range(module.functions())) function.eraseFromParent();
+        }
+
+        llvm::Function* declare(IdentId name,const Signature& signature){
+            std::vector<llvm::Type*> params;
+            for(auto param:signature.params) params.push_back(llvm_type(param));
+            params.push_back(pointer_to(llvm_type(signature.ret)));
+            params.push_back(builder.getInt32Ty());
+            auto type=llvm::FunctionType::get(builder.getInt1Ty(),params,false);
+            auto declared=llvm::Function::Create(type,llvm::Function::ExternalLinkage,prefix+std::string(ident_name(name)),module);
+            // i1 is a C++ bool
+            declared->addRetAttr(llvm::Attribute::ZExt);
+            for(std::size_t i=0;i<signature.params.size();i++){
+                if(signature.params[i]==NativeType::Bool) declared->addParamAttr(i,llvm::Attribute::ZExt);
+            }
+            return declared;
+        }
+
+        llvm::AllocaInst* alloca_of(NativeType type){
+            auto& entry=function->getEntryBlock();
+            llvm::IRBuilder<> at(&entry,entry.begin());
+            return at.CreateAlloca(llvm_type(type));
+        }
+
+        // code after a return goes in a block nothing jumps to
+        void after_terminator(){
+            if(builder.GetInsertBlock()->getTerminator()){
+                builder.SetInsertPoint(llvm::BasicBlock::Create(context,"dead",function));
+            }
+        }
+
+        bool define(Candidate& candidate){
+            function=candidate.function;
+            ret=candidate.signature.ret;
+            locals.clear();
+            depth=1;
+            auto entry=llvm::BasicBlock::Create(context,"entry",function);
+            fail=llvm::BasicBlock::Create(context,"fail",function);
+            auto body_block=llvm::BasicBlock::Create(context,"body",function);
+            builder.SetInsertPoint(fail);
+            builder.CreateRet(builder.getFalse());
+
+            builder.SetInsertPoint(entry);
+            auto args=function->arg_begin();
+            std::size_t i=0;
+            for(auto& [param,type]:candidate.decl->params_){
+                auto native=candidate.signature.params[i++];
+                auto slot=alloca_of(native);
+                builder.CreateStore(&*args++,slot);
+                locals.push_back(Local{param,native,slot,depth});
+            }
+            out=&*args++;
+            call_depth=&*args;
+            // the frames of the VM go up to MAX_FRAMES-1
+            auto too_deep=builder.CreateICmpUGE(call_depth,builder.getInt32(MAX_FRAMES));
+            builder.CreateCondBr(too_deep,fail,body_block);
+
+            builder.SetInsertPoint(body_block);
+            for(auto stmt:candidate.decl->body().value()->stmts){
+                if(!statement(stmt)) return false;
+            }
+            // falling off the end returns nil, no native type holds it
+            if(!builder.GetInsertBlock()->getTerminator()){
+                builder.CreateBr(fail);
+            }
+            return !llvm::verifyFunction(*function);
+        }
+
+        llvm::Function* define_entry(IdentId name,Candidate& candidate){
+            auto i8=builder.getInt8Ty();
+            auto ptr=pointer_to(i8);
+            auto type=llvm::FunctionType::get(builder.getInt1Ty(),{ptr,ptr,builder.getInt32Ty()},false);
+            auto entry=llvm::Function::Create(type,llvm::Function::ExternalLinkage,prefix+"entry_"+std::string(ident_name(name)),module);
+            entry->addRetAttr(llvm::Attribute::ZExt);
+            function=entry;
+            auto args=entry->getArg(0);
+            auto result=entry->getArg(1);
+            auto depth=entry->getArg(2);
+            auto start=llvm::BasicBlock::Create(context,"entry",entry);
+            auto mismatch=llvm::BasicBlock::Create(context,"mismatch",entry);
+            builder.SetInsertPoint(mismatch);
+            builder.CreateRet(builder.getFalse());
+            builder.SetInsertPoint(start);
+
+            auto field=[&](llvm::Value* base,std::size_t offset,llvm::Type* type){
+                auto at=builder.CreateConstInBoundsGEP1_64(i8,base,offset);
+                return builder.CreateBitCast(at,pointer_to(type));
+            };
+            std::vector<llvm::Value*> call_args;
+            auto& params=candidate.signature.params;
+            for(std::size_t i=0;i<params.size();i++){
+                auto kind=builder.CreateLoad(i8,field(args,sizeof(Value)*i,i8));
+                auto next=llvm::BasicBlock::Create(context,"arg",entry);
+                builder.CreateCondBr(builder.CreateICmpEQ(kind,builder.getInt8(static_cast<std::uint8_t>(value_kind(params[i])))),next,mismatch);
+                builder.SetInsertPoint(next);
+                auto at=sizeof(Value)*i+offsetof(Value,i);
+                if(params[i]==NativeType::Bool){
+                    call_args.push_back(builder.CreateICmpNE(builder.CreateLoad(i8,field(args,at,i8)),builder.getInt8(0)));
+                }else{
+                    auto type=llvm_type(params[i]);
+                    call_args.push_back(builder.CreateLoad(type,field(args,at,type)));
+                }
+            }
+            auto native=candidate.signature.ret;
+            auto slot=alloca_of(native);
+            call_args.push_back(slot);
+            call_args.push_back(depth);
+            auto ok=builder.CreateCall(candidate.function,call_args);
+            ok->setAttributes(candidate.function->getAttributes());
+            auto done=llvm::BasicBlock::Create(context,"done",entry);
+            builder.CreateCondBr(ok,done,mismatch);
+
+            builder.SetInsertPoint(done);
+            llvm::Value* value=builder.CreateLoad(llvm_type(native),slot);
+            if(native==NativeType::Bool){
+                // the other bytes of the union are 0 as in Value(bool)
+                value=builder.CreateZExt(value,builder.getInt64Ty());
+            }
+            builder.CreateStore(builder.getInt8(static_cast<std::uint8_t>(value_kind(native))),field(result,0,i8));
+            builder.CreateStore(value,field(result,offsetof(Value,i),value->getType()));
+            builder.CreateRet(builder.getTrue());
+            return entry;
+        }
+
+        const Local* find(IdentId name) const {
+            for(auto local=locals.rbegin();local!=locals.rend();local++){
+                if(local->name==name) return &*local;
+            }
+            return nullptr;
+        }
+
+        bool block(Block* block){
+            depth++;
+            for(auto stmt:block->stmts){
+                if(!statement(stmt)) return false;
+            }
+            depth--;
+            while(!locals.empty() && locals.back().depth>depth) locals.pop_back();
+            return true;
+        }
+
+        llvm::Value* truthy(const Typed& value){
+            switch(value.type){
+                case NativeType::Bool: return value.value;
+                case NativeType::Int: return builder.CreateICmpNE(value.value,builder.getInt64(0));
+                default: return builder.CreateFCmpUNE(value.value,llvm::ConstantFP::get(builder.getDoubleTy(),0.0));
+            }
+        }
+
+        bool statement(Stmt* stmt){
+            after_terminator();
+            switch(stmt->kind){
+                case NodeKind::Block: return block(static_cast<Block*>(stmt));
+                case NodeKind::VarDeclInit:{
+                                               auto var=static_cast<VarDeclInit*>(stmt);
+                                               auto type=type_of(var->type_);
+                                               // a let without value holds nil
+                                               if(!type || !var->value_) return false;
+                                               auto value=expr(var->value_);
+                                               if(!value || value->type!=*type) return false;
+                                               auto slot=alloca_of(*type);
+                                               builder.CreateStore(value->value,slot);
+                                               locals.push_back(Local{var->ident_->ident_,*type,slot,depth});
+                                               return true;
+                                           }
+                case NodeKind::IfElse:{
+                                          auto ifelse=static_cast<IfElse*>(stmt);
+                                          auto condition=expr(ifelse->condition_);
+                                          if(!condition) return false;
+                                          auto then_block=llvm::BasicBlock::Create(context,"then",function);
+                                          auto else_block=llvm::BasicBlock::Create(context,"else",function);
+                                          auto end=llvm::BasicBlock::Create(context,"endif",function);
+                                          builder.CreateCondBr(truthy(*condition),then_block,else_block);
+                                          builder.SetInsertPoint(then_block);
+                                          if(!block(ifelse->if_)) return false;
+                                          if(!builder.GetInsertBlock()->getTerminator()) builder.CreateBr(end);
+                                          builder.SetInsertPoint(else_block);
+                                          if(ifelse->else_ && !block(ifelse->else_)) return false;
+                                          if(!builder.GetInsertBlock()->getTerminator()) builder.CreateBr(end);
+                                          builder.SetInsertPoint(end);
+                                          return true;
+                                      }
+                case NodeKind::WhileStmt:{
+                                             auto loop=static_cast<WhileStmt*>(stmt);
+                                             auto head=llvm::BasicBlock::Create(context,"while",function);
+                                             auto body=llvm::BasicBlock::Create(context,"do",function);
+                                             auto end=llvm::BasicBlock::Create(context,"endwhile",function);
+                                             builder.CreateBr(head);
+                                             builder.SetInsertPoint(head);
+                                             auto condition=expr(loop->condition_);
+                                             if(!condition) return false;
+                                             builder.CreateCondBr(truthy(*condition),body,end);
+                                             builder.SetInsertPoint(body);
+                                             if(!block(loop->block_)) return false;
+                                             if(!builder.GetInsertBlock()->getTerminator()) builder.CreateBr(head);
+                                             builder.SetInsertPoint(end);
+                                             return true;
+                                         }
+                case NodeKind::Return:{
+                                          auto value=expr(static_cast<Return*>(stmt)->value_);
+                                          if(!value || value->type!=ret) return false;
+                                          builder.CreateStore(value->value,out);
+                                          builder.CreateRet(builder.getTrue());
+                                          return true;
+                                      }
+                case NodeKind::ClassStmt:
+                case NodeKind::FctDecl: return false;
+                default: return expr(static_cast<Expr*>(stmt)).has_value();
+            }
+        }
+
+        llvm::Value* to_double(const Typed& value){
+            if(value.type==NativeType::Double) return value.value;
+            return builder.CreateSIToFP(value.value,builder.getDoubleTy());
+        }
+
+        // an operator chain, without recursing into it
+        std::optional<Typed> chain(Expr* node){
+            std::vector<Typed> values;
+            auto lowered=walk_operators(node,[&](Expr* operand){
+                        auto value=expr(operand);
+                        if(!value) return false;
+                        values.push_back(*value);
+                        return true;
+                    },[&](Expr* op){
+                        std::optional<Typed> value;
+                        if(is_binary(op->kind)){
+                            auto right=values.back();
+                            values.pop_back();
+                            value=binary(static_cast<BinExpr*>(op),values.back(),right);
+                        }else{
+                            value=unary(static_cast<UnaryExpr*>(op),values.back());
+                        }
+                        if(!value) return false;
+                        values.back()=*value;
+                        return true;
+                    });
+            if(!lowered) return std::nullopt;
+            return values.back();
+        }
+
+        std::optional<Typed> unary(UnaryExpr* node,Typed value){
+            switch(node->kind){
+                case NodeKind::Group: return value;
+                case NodeKind::Minus:{
+                                         if(value.type==NativeType::Bool) return std::nullopt;
+                                         if(value.type==NativeType::Int) return Typed{builder.CreateNeg(value.value),NativeType::Int};
+                                         return Typed{builder.CreateFNeg(value.value),NativeType::Double};
+                                     }
+                default: return Typed{builder.CreateNot(truthy(value)),NativeType::Bool};
+            }
+        }
+
+        std::optional<Typed> binary(BinExpr* node,Typed left,Typed right){
+            auto ints=left.type==NativeType::Int && right.type==NativeType::Int;
+            auto numbers=left.type!=NativeType::Bool && right.type!=NativeType::Bool;
+            auto a=left.value;
+            auto b=right.value;
+            switch(node->kind){
+                case NodeKind::Add:
+                case NodeKind::Sub:
+                case NodeKind::Mul:{
+                                       if(!numbers) return std::nullopt;
+                                       auto op=node->kind==NodeKind::Add?llvm::Instruction::Add:node->kind==NodeKind::Sub?llvm::Instruction::Sub:llvm::Instruction::Mul;
+                                       if(ints) return Typed{builder.CreateBinOp(op,a,b),NativeType::Int};
+                                       auto fop=op==llvm::Instruction::Add?llvm::Instruction::FAdd:op==llvm::Instruction::Sub?llvm::Instruction::FSub:llvm::Instruction::FMul;
+                                       return Typed{builder.CreateBinOp(fop,to_double(left),to_double(right)),NativeType::Double};
+                                   }
+                case NodeKind::Div:{
+                                       if(!numbers) return std::nullopt;
+                                       if(!ints) return Typed{builder.CreateFDiv(to_double(left),to_double(right)),NativeType::Double};
+                                       auto next=llvm::BasicBlock::Create(context,"div",function);
+                                       builder.CreateCondBr(builder.CreateICmpEQ(b,builder.getInt64(0)),fail,next);
+                                       builder.SetInsertPoint(next);
+                                       // INT64_MIN/-1 wraps as in the VM
+                                       auto minus_one=builder.CreateICmpEQ(b,builder.getInt64(-1));
+                                       auto quotient=builder.CreateSDiv(a,builder.CreateSelect(minus_one,builder.getInt64(1),b));
+                                       return Typed{builder.CreateSelect(minus_one,builder.CreateNeg(a),quotient),NativeType::Int};
+                                   }
+                case NodeKind::Equality:
+                case NodeKind::NotEq:{
+                                         auto equal=node->kind==NodeKind::Equality;
+                                         if(ints || (left.type==NativeType::Bool && right.type==NativeType::Bool)){
+                                             return Typed{equal?builder.CreateICmpEQ(a,b):builder.CreateICmpNE(a,b),NativeType::Bool};
+                                         }
+                                         if(!numbers) return Typed{builder.getInt1(!equal),NativeType::Bool};
+                                         auto x=to_double(left);
+                                         auto y=to_double(right);
+                                         return Typed{equal?builder.CreateFCmpOEQ(x,y):builder.CreateFCmpUNE(x,y),NativeType::Bool};
+                                     }
+                case NodeKind::Less:
+                case NodeKind::Great:
+                case NodeKind::LessEq:
+                case NodeKind::GreatEq:{
+                                           if(!numbers) return std::nullopt;
+                                           if(ints){
+                                               auto predicate=node->kind==NodeKind::Less?llvm::CmpInst::ICMP_SLT:node->kind==NodeKind::Great?llvm::CmpInst::ICMP_SGT:
+                                                   node->kind==NodeKind::LessEq?llvm::CmpInst::ICMP_SLE:llvm::CmpInst::ICMP_SGE;
+                                               return Typed{builder.CreateICmp(predicate,a,b),NativeType::Bool};
+                                           }
+                                           auto predicate=node->kind==NodeKind::Less?llvm::CmpInst::FCMP_OLT:node->kind==NodeKind::Great?llvm::CmpInst::FCMP_OGT:
+                                               node->kind==NodeKind::LessEq?llvm::CmpInst::FCMP_OLE:llvm::CmpInst::FCMP_OGE;
+                                           return Typed{builder.CreateFCmp(predicate,to_double(left),to_double(right)),NativeType::Bool};
+                                       }
+                default:{
+                            if(!ints) return std::nullopt;
+                            switch(node->kind){
+                                case NodeKind::BitOr: return Typed{builder.CreateOr(a,b),NativeType::Int};
+                                case NodeKind::BitAnd: return Typed{builder.CreateAnd(a,b),NativeType::Int};
+                                case NodeKind::RShift: return Typed{builder.CreateAShr(a,builder.CreateAnd(b,63)),NativeType::Int};
+                                default: return Typed{builder.CreateShl(a,builder.CreateAnd(b,63)),NativeType::Int};
+                            }
+                        }
+            }
+        }
+
+        std::optional<Typed> call(FctCall* call){
+            auto callee=node_cast<Symbol>(call->expr_);
+            if(!callee || find(callee->ident_)) return std::nullopt;
+            auto target=candidates.find(callee->ident_);
+            if(target==candidates.end()) return std::nullopt;
+            auto& signature=target->second.signature;
+            if(call->exprs_.size()!=signature.params.size()) return std::nullopt;
+            std::vector<llvm::Value*> args;
+            for(std::size_t i=0;i<call->exprs_.size();i++){
+                auto arg=expr(call->exprs_[i]);
+                if(!arg || arg->type!=signature.params[i]) return std::nullopt;
+                args.push_back(arg->value);
+            }
+            auto slot=alloca_of(signature.ret);
+            args.push_back(slot);
+            args.push_back(builder.CreateAdd(call_depth,builder.getInt32(1)));
+            auto ok=builder.CreateCall(target->second.function,args);
+            ok->setAttributes(target->second.function->getAttributes());
+            auto next=llvm::BasicBlock::Create(context,"called",function);
+            builder.CreateCondBr(ok,next,fail);
+            builder.SetInsertPoint(next);
+            return Typed{builder.CreateLoad(llvm_type(signature.ret),slot),signature.ret};
+        }
+
+        std::optional<Typed> expr(Expr* node){
+            switch(node->kind){
+                case NodeKind::Int: return Typed{builder.getInt64(static_cast<Int*>(node)->value),NativeType::Int};
+                case NodeKind::Double: return Typed{llvm::ConstantFP::get(builder.getDoubleTy(),static_cast<Double*>(node)->value),NativeType::Double};
+                case NodeKind::Bool: return Typed{builder.getInt1(static_cast<Bool*>(node)->value),NativeType::Bool};
+                case NodeKind::Symbol:{
+                                          auto local=find(static_cast<Symbol*>(node)->ident_);
+                                          if(!local) return std::nullopt;
+                                          return Typed{builder.CreateLoad(llvm_type(local->type),local->slot),local->type};
+                                      }
+                case NodeKind::Assign:{
+                                          auto assign=static_cast<Assign*>(node);
+                                          auto local=find(assign->ident_);
+                                          if(!local) return std::nullopt;
+                                          auto value=expr(assign->value_);
+                                          if(!value || value->type!=local->type) return std::nullopt;
+                                          builder.CreateStore(value->value,local->slot);
+                                          return value;
+                                      }
+                case NodeKind::FctCall: return call(static_cast<FctCall*>(node));
+                case NodeKind::Str:
+                case NodeKind::FctExpr: return std::nullopt;
+                default: return chain(node);
+            }
+        }
+
+        llvm::Module& module;
+        llvm::LLVMContext& context;
+        llvm::IRBuilder<> builder;
+        std::string prefix;
+        std::unordered_map<IdentId,NativeType> type_names;
+        std::unordered_map<IdentId,Candidate> candidates;
+        // the function being lowered
+        llvm::Function* function=nullptr;
+        NativeType ret=NativeType::Int;
+        std::vector<Local> locals;
+        std::uint32_t depth=0;
+        llvm::BasicBlock* fail=nullptr;
+        llvm::Value* out=nullptr;
+        llvm::Value* call_depth=nullptr;
+};
+
+};
+
+std::vector<Lowered> lower(Program& program,llvm::Module& module,const std::string& prefix){
+    return Lowering(module,prefix).lower(program);
+}
+
+void optimize(llvm::Module& module){
+    llvm::LoopAnalysisManager loops;
+    llvm::FunctionAnalysisManager functions;
+    llvm::CGSCCAnalysisManager cgscc;
+    llvm::ModuleAnalysisManager modules;
+    llvm::PassBuilder builder;
+    builder.registerModuleAnalyses(modules);
+    builder.registerCGSCCAnalyses(cgscc);
+    builder.registerFunctionAnalyses(functions);
+    builder.registerLoopAnalyses(loops);
+    builder.crossRegisterProxies(loops,functions,cgscc,modules);
+    builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2).run(module,modules);
+}
+
+};
@@ -0,0 +1,537 @@
+#include<cstdint>
+#include<expected>
+#include<memory>
+#include<optional>
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+#include"ast.h"
+#include"ast_visitor.h"
+#include"bytecode.h"
+#include"error.h"
+
+namespace tua{
+
+namespace {
+
+using Status=std::expected<void,Error*>;
+
+std::unexpected<Error*> fail(std::string&& message){
+    return std::unexpected<Error*>(new CompileError(std::move(message)));
+}
+
+// how many values an instruction leaves on the stack, Call and Closure
+// are counted where they are emitted
+constexpr int stack_effect(OpCode op){
+    switch(op){
+        case OpCode::Const:
+        case OpCode::Nil:
+        case OpCode::True:
+        case OpCode::False:
+        case OpCode::GetLocal:
+        case OpCode::GetCapture:
+        case OpCode::GetGlobal:
+        case OpCode::Closure: return 1;
+        case OpCode::SetLocal:
+        case OpCode::SetCapture:
+        case OpCode::SetGlobal:
+        case OpCode::Neg:
+        case OpCode::Not:
+        case OpCode::Jump:
+        case OpCode::Loop:
+        case OpCode::Call: return 0;
+        default: return -1;
+    }
+}
+
+constexpr OpCode binary_op(NodeKind kind){
+    switch(kind){
+        case NodeKind::Add: return OpCode::Add;
+        case NodeKind::Sub: return OpCode::Sub;
+        case NodeKind::Mul: return OpCode::Mul;
+        case NodeKind::Div: return OpCode::Div;
+        case NodeKind::Equality: return OpCode::Equal;
+        case NodeKind::NotEq: return OpCode::NotEqual;
+        case NodeKind::Less: return OpCode::Less;
+        case NodeKind::Great: return OpCode::Greater;
+        case NodeKind::LessEq: return OpCode::LessEqual;
+        case NodeKind::GreatEq: return OpCode::GreaterEqual;
+        case NodeKind::BitOr: return OpCode::BitOr;
+        case NodeKind::BitAnd: return OpCode::BitAnd;
+        case NodeKind::RShift: return OpCode::RShift;
+        default: return OpCode::LShift;
+    }
+}
+
+class Compiler:public AstVisitor<Compiler,Status>{
+    public:
+        Compiler(Module& module):module(module),state(nullptr){}
+
+        Status compile(Program& program){
+            FunctionState script(new_function(NoIdent),nullptr,NoIdent);
+            state=&script;
+            for(auto stmt:program.stmts){
+                auto done=statement(stmt);
+                if(!done){
+                    return done;
+                }
+            }
+            return finish();
+        }
+
+        Status visit(Block* block){
+            state->depth++;
+            for(auto stmt:block->stmts){
+                auto done=statement(stmt);
+                if(!done){
+                    return done;
+                }
+            }
+            end_scope();
+            return {};
+        }
+
+        Status visit(ClassStmt* cls){
+            return fail("class "+std::string(ident_name(cls->ident_->ident_))+" : classes can't be compiled yet");
+        }
+
+        Status visit(FctDecl* fct){
+            auto name=fct->ident_->ident_;
+            auto global=!state->depth;
+            if(!global){
+                // visible to the statements after it, the body knows the
+                // function as itself
+                auto slot=declare_local(name);
+                if(!slot){
+                    return std::unexpected(slot.error());
+                }
+            }
+            auto body=fct->body();
+            if(!body){
+                return std::unexpected(body.error());
+            }
+            auto index=module.functions.size();
+            auto made=function(name,fct->params_,body.value());
+            if(!made){
+                return made;
+            }
+            module.functions[index]->global=global;
+            if(global){
+                return emit_variable(OpCode::StoreGlobal,global_slot(name));
+            }
+            emit(OpCode::StoreLocal,state->locals.back().slot);
+            return {};
+        }
+
+        Status visit(VarDeclInit* var){
+            auto value=var->value_?dispatch(var->value_):Status();
+            if(!value){
+                return value;
+            }
+            if(!var->value_){
+                emit(OpCode::Nil);
+            }
+            auto name=var->ident_->ident_;
+            if(!state->depth){
+                return emit_variable(OpCode::StoreGlobal,global_slot(name));
+            }
+            auto slot=declare_local(name);
+            if(!slot){
+                return std::unexpected(slot.error());
+            }
+            emit(OpCode::StoreLocal,slot.value());
+            return {};
+        }
+
+        Status visit(IfElse* ifelse){
+            auto condition=dispatch(ifelse->condition_);
+            if(!condition){
+                return condition;
+            }
+            auto to_else=emit_jump(OpCode::JumpIfFalse);
+            auto if_block=visit(ifelse->if_);
+            if(!if_block){
+                return if_block;
+            }
+            if(!ifelse->else_){
+                return patch_jump(to_else);
+            }
+            auto to_end=emit_jump(OpCode::Jump);
+            auto patched=patch_jump(to_else);
+            if(!patched){
+                return patched;
+            }
+            auto else_block=visit(ifelse->else_);
+            if(!else_block){
+                return else_block;
+            }
+            return patch_jump(to_end);
+        }
+
+        Status visit(WhileStmt* loop){
+            auto start=code().size();
+            auto condition=dispatch(loop->condition_);
+            if(!condition){
+                return condition;
+            }
+            auto to_end=emit_jump(OpCode::JumpIfFalse);
+            auto block=visit(loop->block_);
+            if(!block){
+                return block;
+            }
+            auto back=code().size()+3-start;
+            if(back>UINT16_MAX){
+                return fail("loop body too long"+where());
+            }
+            emit(OpCode::Loop);
+            emit16(back);
+            return patch_jump(to_end);
+        }
+
+        Status visit(Return* ret){
+            auto value=dispatch(ret->value_);
+            if(!value){
+                return value;
+            }
+            emit(OpCode::Return);
+            return {};
+        }
+
+        // operator chains are as long as the source, see walk_operators()
+        Status visit(BinExpr* node){return chain(node);}
+        Status visit(UnaryExpr* node){return chain(node);}
+
+        Status visit(Int* value){return emit_constant(Value(value->value));}
+        Status visit(Double* value){return emit_constant(Value(value->value));}
+
+        Status visit(Str* value){
+            module.strings.push_back(std::make_unique<StrObj>(std::string(value->value)));
+            // never collected, see VM::collect()
+            module.strings.back()->marked=true;
+            return emit_constant(Value(module.strings.back().get()));
+        }
+
+        Status visit(Bool* value){
+            emit(value->value?OpCode::True:OpCode::False);
+            return {};
+        }
+
+        Status visit(Symbol* symbol){
+            return emit_access(symbol->ident_,OpCode::GetLocal,OpCode::GetCapture,OpCode::GetGlobal);
+        }
+
+        Status visit(Assign* assign){
+            auto value=dispatch(assign->value_);
+            if(!value){
+                return value;
+            }
+            return emit_access(assign->ident_,OpCode::SetLocal,OpCode::SetCapture,OpCode::SetGlobal);
+        }
+
+        Status visit(FctCall* call){
+            auto callee=dispatch(call->expr_);
+            if(!callee){
+                return callee;
+            }
+            if(call->exprs_.size()>UINT8_MAX){
+                return fail("too many arguments"+where());
+            }
+            for(auto arg:call->exprs_){
+                auto done=dispatch(arg);
+                if(!done){
+                    return done;
+                }
+            }
+            emit(OpCode::Call,call->exprs_.size());
+            state->stack-=call->exprs_.size();
+            return {};
+        }
+
+        Status visit(FctExpr* fct){
+            auto body=fct->body();
+            if(!body){
+                return std::unexpected(body.error());
+            }
+            return function(NoIdent,fct->params_,body.value());
+        }
+
+    private:
+        Status chain(Expr* expr){
+            Status done;
+            walk_operators(expr,[&](Expr* operand){
+                        done=dispatch(operand);
+                        return done.has_value();
+                    },[&](Expr* op){
+                        switch(op->kind){
+                            case NodeKind::Minus: emit(OpCode::Neg); break;
+                            case NodeKind::Negate: emit(OpCode::Not); break;
+                            case NodeKind::Group: break;
+                            default: emit(binary_op(op->kind)); break;
+                        }
+                        return true;
+                    });
+            return done;
+        }
+
+        struct Local{
+            IdentId name;
+            std::uint32_t depth;
+            std::uint8_t slot;
+        };
+
+        struct Capture{
+            IdentId name;
+            CaptureFrom from;
+            std::uint8_t index;
+        };
+
+        struct FunctionState{
+            FunctionState(Function* fct,FunctionState* enclosing,IdentId self):
+                fct(fct),enclosing(enclosing),self(self),depth(0),stack(0),last(0){}
+            Function* fct;
+            FunctionState* enclosing;
+            // the name a nested function calls itself by
+            IdentId self;
+            std::vector<Local> locals;
+            std::vector<Capture> captures;
+            // scopes open, 0 at the top level where names are globals
+            std::uint32_t depth;
+            int stack;
+            // where the last instruction starts
+            std::size_t last;
+        };
+
+        Function* new_function(IdentId name){
+            module.functions.push_back(std::make_unique<Function>());
+            module.functions.back()->name=name;
+            return module.functions.back().get();
+        }
+
+        std::vector<std::uint8_t>& code(){return state->fct->code;}
+
+        std::string where() const {
+            auto name=state->fct->name;
+            return name?" in "+std::string(ident_name(name)):std::string();
+        }
+
+        void emit(OpCode op){
+            state->last=code().size();
+            code().push_back(static_cast<std::uint8_t>(op));
+            state->stack+=stack_effect(op);
+            if(state->stack>state->fct->max_stack){
+                state->fct->max_stack=state->stack;
+            }
+        }
+
+        void emit(OpCode op,std::uint8_t operand){
+            emit(op);
+            code().push_back(operand);
+        }
+
+        void emit16(std::uint16_t operand){
+            code().push_back(operand&0xff);
+            code().push_back(operand>>8);
+        }
+
+        Status emit_variable(OpCode op,std::size_t slot){
+            if(slot>UINT16_MAX){
+                return fail("too many globals");
+            }
+            emit(op);
+            emit16(slot);
+            return {};
+        }
+
+        Status emit_constant(Value value){
+            auto& constants=state->fct->constants;
+            if(constants.size()>UINT16_MAX){
+                return fail("too many constants"+where());
+            }
+            constants.push_back(value);
+            emit(OpCode::Const);
+            emit16(constants.size()-1);
+            return {};
+        }
+
+        std::size_t emit_jump(OpCode op){
+            emit(op);
+            emit16(0);
+            return code().size()-2;
+        }
+
+        Status patch_jump(std::size_t at){
+            auto offset=code().size()-at-2;
+            if(offset>UINT16_MAX){
+                return fail("jump too long"+where());
+            }
+            code()[at]=offset&0xff;
+            code()[at+1]=offset>>8;
+            return {};
+        }
+
+        // an expression statement leaves nothing behind, when it ends in
+        // a Set that one becomes the Store that pops
+        Status statement(Stmt* stmt){
+            auto mark=code().size();
+            auto done=dispatch(stmt);
+            if(!done || stmt->kind<NodeKind::Add){
+                return done;
+            }
+            if(state->last>=mark){
+                auto& op=code()[state->last];
+                switch(static_cast<OpCode>(op)){
+                    case OpCode::SetLocal: op=static_cast<std::uint8_t>(OpCode::StoreLocal); state->stack--; return {};
+                    case OpCode::SetCapture: op=static_cast<std::uint8_t>(OpCode::StoreCapture); state->stack--; return {};
+                    case OpCode::SetGlobal: op=static_cast<std::uint8_t>(OpCode::StoreGlobal); state->stack--; return {};
+                    default: break;
+                }
+            }
+            emit(OpCode::Pop);
+            return {};
+        }
+
+        std::size_t global_slot(IdentId name){
+            auto [slot,added]=globals.try_emplace(name,module.globals.size());
+            if(added){
+                module.globals.push_back(name);
+            }
+            return slot->second;
+        }
+
+        std::expected<std::uint8_t,Error*> declare_local(IdentId name){
+            auto slot=state->locals.size();
+            if(slot>UINT8_MAX){
+                return fail("too many locals"+where());
+            }
+            state->locals.push_back(Local{name,state->depth,static_cast<std::uint8_t>(slot)});
+            if(state->locals.size()>state->fct->slots){
+                state->fct->slots=state->locals.size();
+            }
+            return slot;
+        }
+
+        // the slots of the locals going out of scope are used again
+        void end_scope(){
+            state->depth--;
+            auto& locals=state->locals;
+            while(!locals.empty() && locals.back().depth>state->depth){
+                locals.pop_back();
+            }
+        }
+
+        std::optional<std::uint8_t> find_local(FunctionState& in,IdentId name){
+            for(auto local=in.locals.rbegin();local!=in.locals.rend();local++){
+                if(local->name==name) return local->slot;
+            }
+            return std::nullopt;
+        }
+
+        // index in the captures of in, nullopt when name is a global
+        std::expected<std::optional<std::uint8_t>,Error*> find_capture(FunctionState& in,IdentId name){
+            for(std::size_t i=0;i<in.captures.size();i++){
+                if(in.captures[i].name==name) return in.captures[i].index;
+            }
+            auto capture=[&](CaptureFrom from,std::uint8_t index)->std::expected<std::optional<std::uint8_t>,Error*>{
+                if(in.captures.size()>UINT8_MAX){
+                    return fail("too many captures"+where());
+                }
+                auto at=static_cast<std::uint8_t>(in.captures.size());
+                in.captures.push_back(Capture{name,from,index});
+                return at;
+            };
+            if(in.self==name){
+                return capture(CaptureFrom::Itself,0);
+            }
+            if(!in.enclosing){
+                return std::nullopt;
+            }
+            if(auto slot=find_local(*in.enclosing,name)){
+                return capture(CaptureFrom::Local,*slot);
+            }
+            auto outer=find_capture(*in.enclosing,name);
+            if(!outer || !outer.value()){
+                return outer;
+            }
+            return capture(CaptureFrom::Capture,*outer.value());
+        }
+
+        Status emit_access(IdentId name,OpCode local,OpCode capture,OpCode global){
+            if(auto slot=find_local(*state,name)){
+                emit(local,*slot);
+                return {};
+            }
+            auto index=find_capture(*state,name);
+            if(!index){
+                return std::unexpected(index.error());
+            }
+            if(index.value()){
+                emit(capture,*index.value());
+                return {};
+            }
+            return emit_variable(global,global_slot(name));
+        }
+
+        Status function(IdentId name,const Params& params,Block* body){
+            if(module.functions.size()>UINT16_MAX){
+                return fail("too many functions");
+            }
+            auto index=module.functions.size();
+            FunctionState fct(new_function(name),state,name);
+            fct.fct->arity=params.size();
+            fct.depth=1;
+            state=&fct;
+            for(auto& [param,type]:params){
+                auto slot=declare_local(param);
+                if(!slot){
+                    state=fct.enclosing;
+                    return std::unexpected(slot.error());
+                }
+            }
+            for(auto stmt:body->stmts){
+                auto done=statement(stmt);
+                if(!done){
+                    state=fct.enclosing;
+                    return done;
+                }
+            }
+            auto done=finish();
+            state=fct.enclosing;
+            if(!done){
+                return done;
+            }
+
+            fct.fct->captures=fct.captures.size();
+            emit(OpCode::Closure);
+            emit16(index);
+            for(auto& capture:fct.captures){
+                code().push_back(static_cast<std::uint8_t>(capture.from));
+                code().push_back(capture.index);
+            }
+            return {};
+        }
+
+        // falling off the end returns nil
+        Status finish(){
+            emit(OpCode::Nil);
+            emit(OpCode::Return);
+            return {};
+        }
+
+        Module& module;
+        FunctionState* state;
+        std::unordered_map<IdentId,std::size_t> globals;
+};
+
+};
+
+std::expected<Module,Error*> compile(Program& program){
+    Module module;
+    auto done=Compiler(module).compile(program);
+    if(!done){
+        return std::unexpected(done.error());
+    }
+    return module;
+}
+
+};
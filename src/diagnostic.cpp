@@ -0,0 +1,56 @@
+#include<string>
+#include<string_view>
+
+#include"diagnostic.h"
+
+namespace tua{
+
+    namespace {
+        std::string_view text(DiagCode code){
+            switch(code){
+                case DiagCode::SemicolonExpected: return "; expected";
+                case DiagCode::LeftParenExpected: return "( expected";
+                case DiagCode::RightParenExpected: return ") expected";
+                case DiagCode::LeftBraceExpected: return "{ expected";
+                case DiagCode::CommaExpected: return ", expected";
+                case DiagCode::ColonExpected: return ": expected";
+                case DiagCode::ReturnTypeExpected: return "return type identifier expected ";
+                case DiagCode::FunctionNameExpected: return "function identifier expected";
+                case DiagCode::ParamNameExpected: return "parameter identifier expected";
+                case DiagCode::TypeExpected: return "type identifier expected";
+                case DiagCode::TooManyParams: return ") expected or overexceed params count";
+                case DiagCode::ClassNameExpected: return "class identifier expected";
+                case DiagCode::ParentClassExpected: return "parent class identifier expected";
+                case DiagCode::VariableNameExpected: return "variable identifier expected";
+                case DiagCode::UnknownTerminal: return "unknown Terminal token : ";
+                case DiagCode::EndOfTokens: return "end of token stream";
+                case DiagCode::BlocksTooDeep: return "blocks nested deeper than ";
+                case DiagCode::ExprTooDeep: return "expression nested deeper than ";
+                case DiagCode::UnknownToken: return "unrecognized token found";
+                case DiagCode::MalformedNumber: return "malformed number : ";
+                case DiagCode::NumberOutOfRange: return "number out of range : ";
+            }
+            return "";
+        }
+    };
+
+    std::string message(const Diagnostic& diagnostic,std::string_view lexeme){
+        std::string msg;
+        for(std::uint16_t i=0;i<diagnostic.class_depth;i++){
+            msg+="couldn't parse class body : ";
+        }
+        msg+=text(diagnostic.code);
+        switch(diagnostic.code){
+            case DiagCode::UnknownTerminal:
+            case DiagCode::MalformedNumber:
+            case DiagCode::NumberOutOfRange: msg+=lexeme; break;
+            case DiagCode::BlocksTooDeep:
+            case DiagCode::ExprTooDeep: msg+=std::to_string(diagnostic.limit); break;
+            default: break;
+        }
+        if(diagnostic.lambda){
+            msg+=' ';
+        }
+        return msg;
+    }
+};
@@ -0,0 +1,77 @@
+#include<cstdint>
+#include<memory>
+#include<vector>
+
+#include"ast.h"
+#include"flat_ast.h"
+
+namespace tua{
+
+    Program to_program(const FlatView& ast){
+        auto arena=std::make_unique<Arena>();
+        // children come before their parent, each one is made by the time
+        // the parent needs it
+        std::vector<Stmt*> made(ast.size());
+        auto expr=[&](NodeId id){return id==NoNode?nullptr:static_cast<Expr*>(made[id]);};
+        auto block=[&](NodeId id){return id==NoNode?nullptr:static_cast<Block*>(made[id]);};
+        auto symbol=[&](std::uint32_t name){return arena->make<Symbol>(ast.ident(name));};
+        auto params=[&](NodeId id){
+            auto names=ast.fct_params(id);
+            auto params=Params(arena->resource());
+            for(std::size_t i=0;i<names.size();i+=2) params.emplace_back(ast.ident(names[i]),ast.ident(names[i+1]));
+            return params;
+        };
+        for(NodeId id=0;id<ast.size();id++){
+            const auto& node=ast[id];
+            Stmt* stmt=nullptr;
+            switch(node.kind){
+                case NodeKind::Block:{
+                                         auto stmts=Stmts(arena->resource());
+                                         for(auto child:ast.children(id)) stmts.push_back(made[child]);
+                                         stmt=arena->make<Block>(std::move(stmts));
+                                         break;
+                                     }
+                case NodeKind::ClassStmt: stmt=arena->make<ClassStmt>(symbol(node.a),ast.ident(node.b),block(node.c)); break;
+                case NodeKind::FctDecl: stmt=arena->make<FctDecl>(ast.ident(node.b),symbol(node.a),params(id),block(ast.fct_block(id))); break;
+                case NodeKind::FctExpr: stmt=arena->make<FctExpr>(ast.ident(node.b),params(id),block(ast.fct_block(id))); break;
+                case NodeKind::VarDeclInit: stmt=arena->make<VarDeclInit>(symbol(node.a),expr(node.c),ast.ident(node.b)); break;
+                case NodeKind::IfElse: stmt=arena->make<IfElse>(expr(node.a),block(node.b),block(node.c)); break;
+                case NodeKind::WhileStmt: stmt=arena->make<WhileStmt>(expr(node.a),block(node.b)); break;
+                case NodeKind::Return: stmt=arena->make<Return>(expr(node.a)); break;
+                case NodeKind::Int: stmt=arena->make<Int>(ast.int_value(id)); break;
+                case NodeKind::Double: stmt=arena->make<Double>(ast.double_value(id)); break;
+                case NodeKind::Str: stmt=arena->make<Str>(arena->copy(ast.str(id))); break;
+                case NodeKind::Bool: stmt=arena->make<Bool>(node.a!=0); break;
+                case NodeKind::Symbol: stmt=arena->make<Symbol>(ast.ident(node.a)); break;
+                case NodeKind::Assign: stmt=arena->make<Assign>(ast.ident(node.a),expr(node.b)); break;
+                case NodeKind::FctCall:{
+                                           auto args=Exprs(arena->resource());
+                                           for(auto child:ast.children(id)) args.push_back(expr(child));
+                                           stmt=arena->make<FctCall>(expr(node.a),std::move(args));
+                                           break;
+                                       }
+                case NodeKind::Add: stmt=arena->make<Add>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Sub: stmt=arena->make<Sub>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Mul: stmt=arena->make<Mul>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Div: stmt=arena->make<Div>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Equality: stmt=arena->make<Equality>(expr(node.a),expr(node.b)); break;
+                case NodeKind::NotEq: stmt=arena->make<NotEq>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Less: stmt=arena->make<Less>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Great: stmt=arena->make<Great>(expr(node.a),expr(node.b)); break;
+                case NodeKind::LessEq: stmt=arena->make<LessEq>(expr(node.a),expr(node.b)); break;
+                case NodeKind::GreatEq: stmt=arena->make<GreatEq>(expr(node.a),expr(node.b)); break;
+                case NodeKind::BitOr: stmt=arena->make<BitOr>(expr(node.a),expr(node.b)); break;
+                case NodeKind::BitAnd: stmt=arena->make<BitAnd>(expr(node.a),expr(node.b)); break;
+                case NodeKind::RShift: stmt=arena->make<RShift>(expr(node.a),expr(node.b)); break;
+                case NodeKind::LShift: stmt=arena->make<LShift>(expr(node.a),expr(node.b)); break;
+                case NodeKind::Minus: stmt=arena->make<Minus>(expr(node.a)); break;
+                case NodeKind::Negate: stmt=arena->make<Negate>(expr(node.a)); break;
+                case NodeKind::Group: stmt=arena->make<Group>(expr(node.a)); break;
+            }
+            made[id]=stmt;
+        }
+        auto stmts=Stmts(arena->resource());
+        for(auto id:ast.stmts) stmts.push_back(made[id]);
+        return Program(std::move(arena),std::move(stmts),{});
+    }
+};
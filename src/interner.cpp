@@ -0,0 +1,113 @@
+#include<algorithm>
+#include<bit>
+#include<cstring>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<shared_mutex>
+#include<string_view>
+
+#include"interner.h"
+
+namespace tua{
+    namespace {
+        constexpr std::size_t BLOCK_SIZE=1<<16;
+    };
+
+    Interner::Interner():slots(64,Slot{0,Empty}),block_used(0),block_size(0){
+        intern(std::string_view());
+    }
+
+    Interner& Interner::global(){
+        static Interner interner;
+        return interner;
+    }
+
+    std::size_t Interner::find(std::string_view name,std::size_t hash) const noexcept{
+        auto mask=slots.size()-1;
+        for(auto i=hash&mask;;i=(i+1)&mask){
+            const auto& slot=slots[i];
+            if(slot.id==Empty || (slot.hash==hash && names[slot.id]==name)) return i;
+        }
+    }
+
+    std::string_view Interner::store(std::string_view name){
+        if(name.empty()) return std::string_view();
+        if(block_size-block_used<name.size()){
+            block_size=std::max(BLOCK_SIZE,name.size());
+            blocks.push_back(Block{std::make_unique<char[]>(block_size),block_size,static_cast<IdentId>(names.size())});
+            block_used=0;
+        }
+        char* copy=blocks.back().bytes.get()+block_used;
+        std::memcpy(copy,name.data(),name.size());
+        block_used+=name.size();
+        return std::string_view(copy,name.size());
+    }
+
+    void Interner::grow(){
+        std::vector<Slot> old(slots.size()*2,Slot{0,Empty});
+        old.swap(slots);
+        auto mask=slots.size()-1;
+        for(const auto& slot:old){
+            if(slot.id==Empty) continue;
+            auto i=slot.hash&mask;
+            while(slots[i].id!=Empty) i=(i+1)&mask;
+            slots[i]=slot;
+        }
+    }
+
+    IdentId Interner::intern(std::string_view name){
+        auto hash=std::hash<std::string_view>{}(name);
+        {
+            std::shared_lock lock(mutex);
+            const auto& slot=slots[find(name,hash)];
+            if(slot.id!=Empty) return slot.id;
+        }
+        std::unique_lock lock(mutex);
+        // another thread may have added it in between
+        auto i=find(name,hash);
+        if(slots[i].id!=Empty) return slots[i].id;
+
+        IdentId id=names.size();
+        names.push_back(store(name));
+        slots[i]=Slot{hash,id};
+        if(names.size()*2>slots.size()) grow();
+        return id;
+    }
+
+    void Interner::truncate(std::size_t size){
+        std::unique_lock lock(mutex);
+        size=std::max<std::size_t>(size,1);
+        if(size>=names.size()) return;
+        names.resize(size);
+        // the blocks holding only dropped names go, the last one left is
+        // filled from the end of the last name kept
+        while(!blocks.empty() && blocks.back().first>=size) blocks.pop_back();
+        block_used=0;
+        block_size=0;
+        if(!blocks.empty()){
+            auto last=names.back();
+            block_used=last.data()+last.size()-blocks.back().bytes.get();
+            block_size=blocks.back().size;
+        }
+        std::vector<Slot> kept(std::max<std::size_t>(64,std::bit_ceil(size*2)),Slot{0,Empty});
+        kept.swap(slots);
+        auto mask=slots.size()-1;
+        for(const auto& slot:kept){
+            if(slot.id==Empty || slot.id>=size) continue;
+            auto i=slot.hash&mask;
+            while(slots[i].id!=Empty) i=(i+1)&mask;
+            slots[i]=slot;
+        }
+    }
+
+    std::string_view Interner::name(IdentId id) const{
+        std::shared_lock lock(mutex);
+        return names[id];
+    }
+
+    std::size_t Interner::size() const{
+        std::shared_lock lock(mutex);
+        return names.size();
+    }
+};
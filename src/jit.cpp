@@ -0,0 +1,68 @@
+#include<memory>
+#include<string>
+#include<utility>
+
+#include<llvm/Config/llvm-config.h>
+#include<llvm/ExecutionEngine/Orc/LLJIT.h>
+#include<llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include<llvm/IR/LLVMContext.h>
+#include<llvm/IR/Module.h>
+#include<llvm/Support/Error.h>
+#include<llvm/Support/TargetSelect.h>
+
+#include"codegen.h"
+#include"jit.h"
+
+namespace tua{
+
+namespace {
+
+Error* jit_error(llvm::Error error){
+    return new CompileError("jit : "+llvm::toString(std::move(error)));
+}
+
+};
+
+std::expected<Jit,Error*> Jit::create(){
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto jit=llvm::orc::LLJITBuilder().create();
+    if(!jit) return std::unexpected(jit_error(jit.takeError()));
+    return Jit(std::move(jit.get()));
+}
+
+Jit::Jit(std::unique_ptr<llvm::orc::LLJIT>&& jit):jit(std::move(jit)),compiles(0){}
+Jit::Jit(Jit&&) noexcept=default;
+Jit& Jit::operator=(Jit&&) noexcept=default;
+Jit::~Jit()=default;
+
+std::expected<std::vector<IdentId>,Error*> Jit::compile(Program& program,Module& module){
+    auto context=std::make_unique<llvm::LLVMContext>();
+    auto ir=std::make_unique<llvm::Module>("tua",*context);
+    ir->setDataLayout(jit->getDataLayout());
+    ir->setTargetTriple(jit->getTargetTriple().str());
+    auto lowered=lower(program,*ir,"tua_"+std::to_string(compiles++)+"_");
+    std::vector<IdentId> names;
+    if(lowered.empty()) return names;
+
+    optimize(*ir);
+    if(auto error=jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(ir),std::move(context)))){
+        return std::unexpected(jit_error(std::move(error)));
+    }
+    for(auto& fct:lowered){
+        auto symbol=jit->lookup(fct.entry);
+        if(!symbol) return std::unexpected(jit_error(symbol.takeError()));
+#if LLVM_VERSION_MAJOR>=15
+        auto native=symbol->toPtr<Function::Native>();
+#else
+        auto native=llvm::jitTargetAddressToPointer<Function::Native>(symbol->getAddress());
+#endif
+        for(auto& function:module.functions){
+            if(function->global && function->name==fct.name) function->native=native;
+        }
+        names.push_back(fct.name);
+    }
+    return names;
+}
+
+};
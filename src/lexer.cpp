@@ -1,159 +1,354 @@
+#include<algorithm>
+#include<charconv>
+#include<mutex>
 #include<string>
-#include <sstream>
-#include <unordered_map>
+#include<string_view>
+#include<vector>
 
 #include"lexer.h"
+#include"scan.h"
+#include"thread_pool.h"
+
 namespace tua{
-    const std::unordered_map<std::string,TokenKind> Lexer::key_words={
-        {std::string("and") ,TokenKind::AND},
-        {std::string("class"),TokenKind::CLASS},
-        {std::string("else") ,TokenKind::ELSE},
-        {std::string("false") ,TokenKind::FALSE},
-        {std::string("fun") ,TokenKind::FUN},
-        {std::string("lambda") ,TokenKind::LAMBDA},
-        {std::string("for") ,TokenKind::FOR},
-        {std::string("if") ,TokenKind::IF},
-        {std::string("nil") ,TokenKind::NIL},
-        {std::string("or") ,TokenKind::OR},
-        {std::string("return") ,TokenKind::RETURN},
-        {std::string("super") ,TokenKind::SUPER},
-        {std::string("this") ,TokenKind::THIS},
-        {std::string("true") ,TokenKind::TRUE},
-        {std::string("let") ,TokenKind::LET},
-        {std::string("while") ,TokenKind::WHILE},
-    };
+    static_assert(key_word("and")==TokenKind::AND);
+    static_assert(key_word("class")==TokenKind::CLASS);
+    static_assert(key_word("else")==TokenKind::ELSE);
+    static_assert(key_word("false")==TokenKind::FALSE);
+    static_assert(key_word("fun")==TokenKind::FUN);
+    static_assert(key_word("lambda")==TokenKind::LAMBDA);
+    static_assert(key_word("for")==TokenKind::FOR);
+    static_assert(key_word("if")==TokenKind::IF);
+    static_assert(key_word("nil")==TokenKind::NIL);
+    static_assert(key_word("or")==TokenKind::OR);
+    static_assert(key_word("return")==TokenKind::RETURN);
+    static_assert(key_word("super")==TokenKind::SUPER);
+    static_assert(key_word("this")==TokenKind::THIS);
+    static_assert(key_word("true")==TokenKind::TRUE);
+    static_assert(key_word("let")==TokenKind::LET);
+    static_assert(key_word("while")==TokenKind::WHILE);
+    static_assert(key_word("fur")==TokenKind::IDENT);
+    static_assert(key_word("iff")==TokenKind::IDENT);
 
     void Lexer::consume(){
-        iter++;
+        pos++;
     }
 
     const bool Lexer::at_end() const noexcept{
-        return iter==iter_end;
+        return pos==src.size();
+    }
+
+    std::string_view Lexer::lexeme_from(std::size_t start) const noexcept{
+        return src.substr(start,pos-start);
+    }
+
+    void Lexer::skip_trivia(){
+        const char* begin=src.data();
+        const char* end=begin+src.size();
+        while(true){
+            pos=scan::skip_space(begin+pos,end)-begin;
+            if(src.size()-pos<2 || src[pos]!='/' || src[pos+1]!='/') return;
+            pos=scan::find_byte(begin+pos+2,end,'\n')-begin;
+        }
     }
 
     const Token Lexer::tokenize_string(){
-        std::stringstream ss;
-        while(!at_end() && *iter!='"') {
-            ss<<*iter;
-            iter++;
-        };
-        iter++;
-        return Token(TokenKind::STRING,std::move(ss.str()),current_line);
+        auto start=pos;
+        pos=scan::find_byte(src.data()+pos,src.data()+src.size(),'"')-src.data();
+        auto lexeme=lexeme_from(start);
+        if(!at_end()) consume();
+        return Token(TokenKind::STRING,lexeme,start);
+    }
+
+
+    void TokenBuffer::reserve(std::size_t count){
+        kinds.reserve(count);
+        offsets.reserve(count);
+        lengths.reserve(count);
+        payloads.reserve(count);
+    }
+
+    void TokenBuffer::push_back(const Token& token){
+        std::uint32_t payload=0;
+        switch(token.kind){
+            case TokenKind::INT:
+            case TokenKind::DOUBLE:{
+                                       payload=numbers.size();
+                                       numbers.push_back(token.number);
+                                       break;
+                                   }
+            case TokenKind::IDENT: payload=token.ident; break;
+            case TokenKind::Err: payload=static_cast<std::uint32_t>(token.error); break;
+            default: break;
+        }
+        kinds.push_back(token.kind);
+        offsets.push_back(token.offset);
+        lengths.push_back(token.lexeme.size());
+        payloads.push_back(payload);
+    }
+
+    void TokenBuffer::append(const TokenBuffer& other,std::size_t count){
+        auto first=size();
+        auto rebase=numbers.size();
+        kinds.insert(kinds.end(),other.kinds.begin(),other.kinds.begin()+count);
+        offsets.insert(offsets.end(),other.offsets.begin(),other.offsets.begin()+count);
+        lengths.insert(lengths.end(),other.lengths.begin(),other.lengths.begin()+count);
+        payloads.insert(payloads.end(),other.payloads.begin(),other.payloads.begin()+count);
+        numbers.insert(numbers.end(),other.numbers.begin(),other.numbers.end());
+        for(auto i=first;i<size();i++){
+            if(kinds[i]==TokenKind::INT || kinds[i]==TokenKind::DOUBLE) payloads[i]+=rebase;
+        }
+    }
+
+    TokenBuffer TokenBuffer::slice(std::size_t first,std::size_t last) const{
+        TokenBuffer part;
+        part.reserve(last-first+1);
+        part.kinds.assign(kinds.begin()+first,kinds.begin()+last);
+        part.offsets.assign(offsets.begin()+first,offsets.begin()+last);
+        part.lengths.assign(lengths.begin()+first,lengths.begin()+last);
+        part.payloads.assign(payloads.begin()+first,payloads.begin()+last);
+        for(std::size_t i=0;i<part.size();i++){
+            if(part.kinds[i]==TokenKind::INT || part.kinds[i]==TokenKind::DOUBLE){
+                part.payloads[i]=part.numbers.size();
+                part.numbers.push_back(numbers[payloads[first+i]]);
+            }
+        }
+        if(last<size()){
+            part.push_back(Token(TokenKind::Eof,offsets[last]));
+        }
+        return part;
+    }
+
+    namespace {
+        // segment starts, each one just past a newline that is not inside a
+        // string literal. Lexing a segment from its start then gives the same
+        // tokens as lexing the whole source up to there
+        std::vector<std::size_t> segment_starts(std::string_view src,std::size_t from,std::size_t segments){
+            std::vector<std::size_t> starts{from};
+            const char* begin=src.data();
+            const char* end=begin+src.size();
+            const char* p=begin+from;
+            auto length=src.size()-from;
+            for(std::size_t i=1;i<segments && p!=end;i++){
+                const char* target=begin+from+length*i/segments;
+                while(p<target){
+                    switch(*p){
+                        case '"':{
+                                     p=scan::find_byte(p+1,end,'"');
+                                     if(p!=end) p++;
+                                     break;
+                                 }
+                        case '/':{
+                                     if(p+1!=end && p[1]=='/') p=scan::find_byte(p+2,end,'\n');
+                                     else p++;
+                                     break;
+                                 }
+                        default: p++;
+                    }
+                }
+                while(p!=end && *p!='\n'){
+                    if(*p=='"'){
+                        p=scan::find_byte(p+1,end,'"');
+                        if(p==end) break;
+                    }
+                    else if(*p=='/' && p+1!=end && p[1]=='/'){
+                        p=scan::find_byte(p+2,end,'\n');
+                        break;
+                    }
+                    p++;
+                }
+                if(p==end) break;
+                p++;
+                starts.push_back(p-begin);
+            }
+            return starts;
+        }
+    };
+
+    Lexer Lexer::view(std::string_view text,std::size_t start){
+        return Lexer(text,start);
     }
 
+    Lexer Lexer::at(std::size_t start) const{
+        auto lexer=*this;
+        lexer.pos=start;
+        lexer.token_start=start;
+        return lexer;
+    }
 
     const Token Lexer::get_token(){
-        while(!at_end() && isspace(*iter) ){
-            if(*iter=='\n') current_line++; 
-            consume();
-        };
+        skip_trivia();
+        token_start=pos;
+        return lex_token();
+    }
+
+    TokenBuffer Lexer::tokenize_all(){
+        TokenBuffer tokens;
+        // about one token every 4 bytes in typical sources
+        tokens.reserve((src.size()-pos)/4+1);
+        while(true){
+            auto token=get_token();
+            tokens.push_back(token);
+            if(token.kind==TokenKind::Eof || token.kind==TokenKind::Err) break;
+        }
+        return tokens;
+    }
+
+    TokenBuffer Lexer::tokenize_parallel(ThreadPool& pool,std::size_t segments){
+        auto starts=segment_starts(src,pos,std::max<std::size_t>(segments,1));
+        starts.push_back(src.size());
+        std::vector<TokenBuffer> parts(starts.size()-1);
+        pool.parallel_for(parts.size(),[&](std::size_t i){
+            // offsets stay relative to the whole source
+            auto lexer=Lexer(src.substr(0,starts[i+1]),starts[i]);
+            parts[i]=lexer.tokenize_all();
+        });
+
+        std::size_t count=0;
+        for(const auto& part:parts) count+=part.size();
+        TokenBuffer tokens;
+        tokens.reserve(count);
+        for(std::size_t i=0;i<parts.size();i++){
+            auto& part=parts[i];
+            if(part.kinds.back()==TokenKind::Err || i+1==parts.size()){
+                tokens.append(part,part.size());
+                break;
+            }
+            // drops the Eof ending the segment
+            tokens.append(part,part.size()-1);
+        }
+        pos=tokens.kinds.back()==TokenKind::Err?tokens.offsets.back():src.size();
+        return tokens;
+    }
+
+    void Lexer::build_lines() const{
+        const char* begin=src.data();
+        const char* end=begin+src.size();
+        auto& starts=lines->starts;
+        starts.push_back(0);
+        for(const char* p=scan::find_byte(begin,end,'\n');p!=end;p=scan::find_byte(p+1,end,'\n')){
+            starts.push_back(p+1-begin);
+        }
+    }
+
+    std::uint32_t Lexer::line_of(std::uint32_t offset) const{
+        std::call_once(lines->built,&Lexer::build_lines,this);
+        const auto& starts=lines->starts;
+        return std::upper_bound(starts.begin(),starts.end(),offset)-starts.begin()-1;
+    }
 
-        if(at_end()) { return Token(TokenKind::Eof,current_line);}
-        switch(*iter){
-            case '(':{consume();return Token(TokenKind::LEFT_PAREN,current_line);}
-            case ')':{consume();return Token(TokenKind::RIGHT_PAREN,current_line);}
-            case '[':{consume();return Token(TokenKind::LEFT_BRACKET,current_line);}
-            case ']':{consume();return Token(TokenKind::RIGHT_BRACKET,current_line);}
-            case '{':{consume();return Token(TokenKind::LEFT_BRACE,current_line);}
-            case '}':{consume();return Token(TokenKind::RIGHT_BRACE,current_line);}
-            case '|':{consume();return Token(TokenKind::BIT_OR,current_line);}
-            case '&':{consume();return Token(TokenKind::BIT_AND,current_line);}
-            case ',':{consume();return Token(TokenKind::COMMA,current_line);}
-            case ':':{consume();return Token(TokenKind::COLLON,current_line);}
-            case ';':{consume();return Token(TokenKind::SEMICOLON,current_line);}
-            case '.':{consume();return Token(TokenKind::DOT,current_line);}
-            case '+':{consume();return Token(TokenKind::PLUS,current_line);}
-            case '-':{consume();return Token(TokenKind::MINUS,current_line);}
-            case '*':{consume();return Token(TokenKind::STAR,current_line);}
+    std::uint32_t Lexer::column_of(std::uint32_t offset) const{
+        return offset-lines->starts[line_of(offset)];
+    }
+
+    std::string_view Lexer::source() const noexcept{
+        return src;
+    }
+
+    const Token Lexer::lex_token(){
+        if(at_end()) { return Token(TokenKind::Eof,token_start);}
+        switch(src[pos]){
+            case '(':{consume();return Token(TokenKind::LEFT_PAREN,token_start);}
+            case ')':{consume();return Token(TokenKind::RIGHT_PAREN,token_start);}
+            case '[':{consume();return Token(TokenKind::LEFT_BRACKET,token_start);}
+            case ']':{consume();return Token(TokenKind::RIGHT_BRACKET,token_start);}
+            case '{':{consume();return Token(TokenKind::LEFT_BRACE,token_start);}
+            case '}':{consume();return Token(TokenKind::RIGHT_BRACE,token_start);}
+            case '|':{consume();return Token(TokenKind::BIT_OR,token_start);}
+            case '&':{consume();return Token(TokenKind::BIT_AND,token_start);}
+            case ',':{consume();return Token(TokenKind::COMMA,token_start);}
+            case ':':{consume();return Token(TokenKind::COLLON,token_start);}
+            case ';':{consume();return Token(TokenKind::SEMICOLON,token_start);}
+            case '.':{consume();return Token(TokenKind::DOT,token_start);}
+            case '+':{consume();return Token(TokenKind::PLUS,token_start);}
+            case '-':{consume();return Token(TokenKind::MINUS,token_start);}
+            case '*':{consume();return Token(TokenKind::STAR,token_start);}
             case '"':{consume();return tokenize_string();}
-            case '/':{
-                         consume();
-                         if (at_end() || *iter!='/' ){return Token(TokenKind::SLASH,current_line);}
-                         consume();
-                         while(*iter!='\n' ) {
-                             consume();
-                             if(at_end()) {return Token(TokenKind::Eof,current_line);}
-                         }
-                         consume();
-                         return get_token();
-                     }
+            case '/':{consume();return Token(TokenKind::SLASH,token_start);}
             case '=':{
                          consume();
-                         if (at_end() || *iter!='=' ){return Token(TokenKind::EQUAL,current_line);}
+                         if (at_end() || src[pos]!='=' ){return Token(TokenKind::EQUAL,token_start);}
                          consume();
-                         return Token(TokenKind::EQUAL_EQUAL,current_line);
+                         return Token(TokenKind::EQUAL_EQUAL,token_start);
                      }
             case '<':{
                          consume();
-                         if (!at_end() && *iter=='='){consume();return Token(TokenKind::LESS_EQUAL,current_line);}
-                         if (!at_end() && *iter=='<'){consume();return Token(TokenKind::BIT_LSHIFT,current_line);}
-                         return Token(TokenKind::LESS,current_line);
+                         if (!at_end() && src[pos]=='='){consume();return Token(TokenKind::LESS_EQUAL,token_start);}
+                         if (!at_end() && src[pos]=='<'){consume();return Token(TokenKind::BIT_LSHIFT,token_start);}
+                         return Token(TokenKind::LESS,token_start);
                      }
             case '>':{
                          consume();
-                         if (!at_end() && *iter=='='){consume();return Token(TokenKind::GREATER_EQUAL,current_line);}
-                         if (!at_end() && *iter=='>'){consume();return Token(TokenKind::BIT_RSHIFT,current_line);}
-                         return Token(TokenKind::GREATER,current_line);
+                         if (!at_end() && src[pos]=='='){consume();return Token(TokenKind::GREATER_EQUAL,token_start);}
+                         if (!at_end() && src[pos]=='>'){consume();return Token(TokenKind::BIT_RSHIFT,token_start);}
+                         return Token(TokenKind::GREATER,token_start);
                      }
             case '!':{
                          consume();
-                         if (at_end() || *iter!='=' ){return Token(TokenKind::BANG,current_line);}
+                         if (at_end() || src[pos]!='=' ){return Token(TokenKind::BANG,token_start);}
                          consume();
-                         return Token(TokenKind::BANG_EQUAL,current_line);
+                         return Token(TokenKind::BANG_EQUAL,token_start);
                      }
             default: break;
         };
 
-        if(at_end()) { return Token(TokenKind::Eof,current_line);}
-        if(std::isalpha(*iter)){
+        if(at_end()) { return Token(TokenKind::Eof,token_start);}
+        if(scan::is_alpha(src[pos])){
             return tokenize_ident();
         }
 
-        if(at_end()) { return Token(TokenKind::Eof,current_line);}
-        if(std::isdigit(*iter)){
+        if(at_end()) { return Token(TokenKind::Eof,token_start);}
+        if(scan::is_digit(src[pos])){
             return tokenize_numeric();
         }
-        return Token(TokenKind::Err,current_line);
-    }
-    const std::uint16_t Lexer::get_line() const noexcept{
-        return current_line;
+        return Token(TokenKind::Err,token_start);
     }
 
     const Token Lexer::tokenize_ident(){
-        std::stringstream ss;
-        while(!at_end() && std::isalnum(*iter)){
-            ss<<*iter;
-            iter++;
-        }
+        auto start=pos;
+        pos=scan::skip_alnum(src.data()+pos,src.data()+src.size())-src.data();
 
-        auto word=std::move(ss.str());
-        auto tkind_ptr=Lexer::key_words.find(word);
-        if(tkind_ptr==Lexer::key_words.end())
-            return Token(TokenKind::IDENT,std::move(word),current_line);
-        return Token(tkind_ptr->second,current_line);
+        auto word=lexeme_from(start);
+        auto tkind=key_word(word);
+        if(tkind!=TokenKind::IDENT)
+            return Token(tkind,token_start);
+        auto token=Token(TokenKind::IDENT,word,token_start);
+        token.ident=Interner::global().intern(word);
+        return token;
     }
 
     const Token Lexer::tokenize_numeric(){
-        std::stringstream ss;
+        auto start=pos;
         TokenKind tkind=TokenKind::INT;
         bool digit_pt=false;
-        while(!at_end() && (std::isdigit(*iter) || *iter=='.')) {
-            if (*iter=='.'){
+        while(!at_end() && (scan::is_digit(src[pos]) || src[pos]=='.')) {
+            if (src[pos]=='.'){
                 if (digit_pt) {
                     break;
                 }
-                else{
-                    digit_pt=true;
-                    tkind=TokenKind::DOUBLE;
-                    ss<<*iter;
-                }
-            }
-            else{
-                ss<<*iter;
+                digit_pt=true;
+                tkind=TokenKind::DOUBLE;
             }
-            iter++;
+            consume();
+        }
+        // a number running into letters or ending on its '.'
+        if(src[pos-1]=='.' || (!at_end() && scan::is_alpha(src[pos]))){
+            pos=scan::skip_alnum(src.data()+pos,src.data()+src.size())-src.data();
+            auto token=Token(TokenKind::Err,lexeme_from(start),token_start);
+            token.error=LexError::Malformed;
+            return token;
+        }
+
+        auto token=Token(tkind,lexeme_from(start),token_start);
+        const char* first=token.lexeme.data();
+        const char* last=first+token.lexeme.size();
+        auto result=tkind==TokenKind::INT?
+            std::from_chars(first,last,token.number.int_value):
+            std::from_chars(first,last,token.number.double_value);
+        if(result.ec!=std::errc() || result.ptr!=last){
+            token.kind=TokenKind::Err;
+            token.error=result.ec==std::errc::result_out_of_range?LexError::OutOfRange:LexError::Malformed;
         }
-        return Token(tkind,std::move(ss.str()),current_line);
+        return token;
     }
 
 };
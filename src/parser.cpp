@@ -1,62 +1,236 @@
-#include<string>
-#include<vector>
-
+#include<algorithm>
+#include<atomic>
 #include<expected>
+#include<memory>
 #include<optional>
+#include<string>
 
 #include"parser.h"
 #include"lexer.h"
 #include"ast.h"
 #include"error.h"
+#include"thread_pool.h"
 
 
 namespace tua{
 
-Parser::Parser(Lexer&& lexer):_lexer(std::move(lexer)){ current_token=_lexer.get_token(); }
-Parser::Parser(Lexer& lexer):_lexer(lexer){ current_token=_lexer.get_token(); }
+Parser::Parser(Lexer&& lexer):_lexer(std::move(lexer)),tokens(_lexer.tokenize_all()),current(0),stream(nullptr),pull(false),stmt_end(0),diagnostics(nullptr),max_depth(0),expr_depth(0),lazy(false){}
+Parser::Parser(Lexer& lexer):_lexer(lexer),tokens(_lexer.tokenize_all()),current(0),stream(nullptr),pull(false),stmt_end(0),diagnostics(nullptr),max_depth(0),expr_depth(0),lazy(false){}
+Parser::Parser(StreamLexer& stream):_lexer(std::string()),current(0),stream(&stream),pull(true),stmt_end(0),diagnostics(nullptr),max_depth(0),expr_depth(0),lazy(false){ fetch_token(); }
+Parser::Parser(Lexer&& lexer,bool pull):_lexer(std::move(lexer)),current(0),stream(nullptr),pull(pull),stmt_end(0),diagnostics(nullptr),max_depth(0),expr_depth(0),lazy(false){
+    if(pull){
+        fetch_token();
+    }else{
+        tokens=_lexer.tokenize_all();
+    }
+}
+Parser::Parser(const Parser& parent,std::size_t first,std::size_t last):
+    _lexer(parent._lexer),tokens(parent.tokens.slice(first,last)),current(0),stream(nullptr),pull(false),stmt_end(0),diagnostics(nullptr),max_depth(parent.max_depth),expr_depth(0),lazy(parent.lazy){}
+
+void Parser::fetch_token(){
+    tokens.push_back(stream?stream->get_token():_lexer.get_token());
+}
 
 
-std::expected<bool,Error*> Parser::consume_token(){
+std::expected<bool,Diagnostic> Parser::consume_token(){
     if(match_token_kind(TokenKind::Err)){
-        return std::unexpected(new ParseError("unrecognized token found",current_token->line));
+        return std::unexpected(lex_error());
     }
     if(match_token_kind(TokenKind::Eof)){
-        return std::unexpected(new ParseError("end of token stream",current_token->line));
+        return std::unexpected(diag(DiagCode::EndOfTokens));
+    }
+    current++;
+    if(pull && current==tokens.size()){
+        fetch_token();
     }
-    current_token=_lexer.get_token();
     return true;
 }
 
 std::expected<Program,Error*> Parser::parse(){
-    auto stmts=std::vector<Stmt*>{};
-    std::expected<Stmt*,Error*> stmt;
-    while(!at_end()){
-        stmt=parse_stmt();
-        if (!stmt){
-            return std::unexpected(stmt.error());
-        }
+    auto program_arena=std::make_unique<Arena>();
+    auto stmts=Stmts(program_arena->resource());
+    std::vector<std::uint32_t> ends;
+    std::expected<Stmt*,Diagnostic> stmt;
+    while((stmt=next_stmt(*program_arena)) && stmt.value()){
         stmts.push_back(stmt.value());
+        ends.push_back(stmt_end);
+    };
+    if (!stmt){
+        return std::unexpected(to_error(stmt.error()));
+    }
 
-        if(!match_token_kind(TokenKind::SEMICOLON)){
-        return std::unexpected(new ParseError("; expected",current_token->line));
+    return make_program(std::move(program_arena),std::move(stmts),std::move(ends));
+}
+
+Program Parser::make_program(std::unique_ptr<Arena>&& program_arena,Stmts&& stmts,std::vector<std::uint32_t>&& ends){
+    auto program=Program(std::move(program_arena),std::move(stmts),std::move(ends));
+    program.max_depth=max_depth;
+    program.lazy=lazy;
+    program.lazy_bodies=std::move(skipped);
+    skipped.clear();
+    return program;
+}
+
+std::expected<FlatAst,Error*> Parser::parse_flat(){
+    FlatAst ast;
+    // about one node for every two tokens in typical code
+    ast.nodes.reserve(tokens.size()/2+1);
+    ast.extra.reserve(tokens.size()/4+1);
+    FlatSink sink(ast);
+    Parsed<NodeId> stmt;
+    while((stmt=next_stmt(sink)) && stmt.value()!=NoNode){
+        ast.stmts.push_back(stmt.value());
+    }
+    if(!stmt){
+        return std::unexpected(to_error(stmt.error()));
+    }
+    return ast;
+}
+
+// runs of whole top level statements of at least target tokens, as the
+// index each one starts at followed by the end of the tokens. Past an
+// unmatched closing token the parser fails anyway, nothing is cut there
+std::vector<std::size_t> Parser::top_level_runs(std::size_t target) const{
+    std::vector<std::size_t> starts{current};
+    const auto& kinds=tokens.kinds;
+    std::int64_t depth=0;
+    for(std::size_t i=current;i<kinds.size() && depth>=0;i++){
+        switch(kinds[i]){
+            case TokenKind::LEFT_PAREN:
+            case TokenKind::LEFT_BRACE: depth++; break;
+            case TokenKind::RIGHT_PAREN:
+            case TokenKind::RIGHT_BRACE: depth--; break;
+            case TokenKind::SEMICOLON:{
+                                         // the last run keeps the Eof
+                                         if(!depth && i+1-starts.back()>=target && i+2<kinds.size()){
+                                             starts.push_back(i+1);
+                                         }
+                                         break;
+                                     }
+            default: break;
         }
-        consume_token();
+    }
+    starts.push_back(kinds.size());
+    return starts;
+}
+
+std::expected<Program,Error*> Parser::parse_parallel(ThreadPool& pool){
+    if(stream){
+        return parse();
+    }
+    // a few runs per thread so one long function doesn't hold the others
+    auto starts=top_level_runs((tokens.size()-current)/(pool.size()*4)+1);
+    auto runs=starts.size()-1;
+    struct Run{
+        std::unique_ptr<Arena> arena;
+        std::vector<Stmt*> stmts;
+        std::vector<std::uint32_t> ends;
+        std::vector<Stmt*> skipped;
+        std::optional<Diagnostic> error;
     };
+    std::vector<Run> results(runs);
+    // runs after the first failed one don't matter
+    std::atomic<std::size_t> failed{runs};
+    pool.parallel_for(runs,[&](std::size_t i){
+        if(i>failed.load(std::memory_order_relaxed)) return;
+        auto parser=Parser(*this,starts[i],starts[i+1]);
+        auto& run=results[i];
+        run.arena=std::make_unique<Arena>();
+        std::expected<Stmt*,Diagnostic> stmt;
+        while((stmt=parser.next_stmt(*run.arena)) && stmt.value()){
+            run.stmts.push_back(stmt.value());
+            run.ends.push_back(parser.stmt_end);
+        }
+        run.skipped=std::move(parser.skipped);
+        if(!stmt){
+            run.error=stmt.error();
+            auto seen=failed.load(std::memory_order_relaxed);
+            while(i<seen && !failed.compare_exchange_weak(seen,i,std::memory_order_relaxed));
+        }
+    });
+
+    std::size_t count=0;
+    for(auto& run:results){
+        if(run.error){
+            return std::unexpected(to_error(*run.error));
+        }
+        count+=run.stmts.size();
+    }
+    current=tokens.size()-1;
+    auto program_arena=std::make_unique<Arena>();
+    auto stmts=Stmts(program_arena->resource());
+    std::vector<std::uint32_t> ends;
+    stmts.reserve(count);
+    ends.reserve(count);
+    for(auto& run:results){
+        stmts.insert(stmts.end(),run.stmts.begin(),run.stmts.end());
+        ends.insert(ends.end(),run.ends.begin(),run.ends.end());
+        skipped.insert(skipped.end(),run.skipped.begin(),run.skipped.end());
+        program_arena->adopt(std::move(run.arena));
+    }
+    return make_program(std::move(program_arena),std::move(stmts),std::move(ends));
+}
+
+std::expected<Stmt*,Error*> Parser::parse_next(Arena& arena){
+    auto stmt=next_stmt(arena);
+    if(!stmt){
+        return std::unexpected(to_error(stmt.error()));
+    }
+    return stmt.value();
+}
+
+Parser::Parsed<Stmt*> Parser::next_stmt(Arena& arena){
+    tree.arena=&arena;
+    return next_stmt(tree);
+}
+
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::next_stmt(Sink& sink){
+    if(at_end()){
+        return Sink::none;
+    }
+    auto stmt=parse_stmt(sink);
+    if (!stmt){
+        return std::unexpected(stmt.error());
+    }
+    auto end=end_top_level();
+    if(!end){
+        return std::unexpected(end.error());
+    }
+    return stmt.value();
+}
 
-    return Program(std::move(stmts));
+std::expected<bool,Diagnostic> Parser::end_top_level(){
+    if(!match_token_kind(TokenKind::SEMICOLON)){
+        return std::unexpected(diag(DiagCode::SemicolonExpected));
+    }
+    stmt_end=tokens.offsets[current]+1;
+    if(pull){
+        // nothing before the next statement is looked at again
+        if(stream) stream->release(stmt_end);
+        tokens=TokenBuffer();
+        current=0;
+        fetch_token();
+        return true;
+    }
+    return consume_token();
 }
 
-std::expected<Stmt*,Error*> Parser::parse_stmt(){
-    switch(current_token.value().kind){
-        case tua::TokenKind::LEFT_BRACE: return parse_block();
-        case tua::TokenKind::IF: return parse_if();
-        case tua::TokenKind::WHILE: return parse_while();
-        case tua::TokenKind::FUN: return parse_fct_decl();
-        case tua::TokenKind::CLASS: return parse_class();
-        case tua::TokenKind::LET: return parse_vardeclinit();
-        case tua::TokenKind::RETURN: return parse_return();
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_stmt(Sink& sink){
+    if(max_depth){
+        return parse_nested(sink);
+    }
+    switch(current_kind()){
+        case tua::TokenKind::LEFT_BRACE: return parse_block(sink);
+        case tua::TokenKind::IF: return parse_if(sink);
+        case tua::TokenKind::WHILE: return parse_while(sink);
+        case tua::TokenKind::FUN: return parse_fct_decl(sink);
+        case tua::TokenKind::CLASS: return parse_class(sink);
+        case tua::TokenKind::LET: return parse_vardeclinit(sink);
+        case tua::TokenKind::RETURN: return parse_return(sink);
         default:{
-                    auto expr= parse_expr();
+                    auto expr= parse_expr(sink);
                     if(!expr){
                         return std::unexpected(expr.error());
                     }
@@ -65,108 +239,355 @@ std::expected<Stmt*,Error*> Parser::parse_stmt(){
     }
 }
 
-std::expected<Block*,Error*> Parser::parse_block(){
+template<typename Sink>
+Parser::Parsed<typename Sink::BlockRef> Parser::parse_block(Sink& sink){
     consume_token();
-    auto stmts=std::vector<Stmt*>{};
-    std::expected<Stmt*,Error*> stmt;
+    auto stmts=sink.stmts();
+    Parsed<typename Sink::StmtRef> stmt;
     while(!match_token_kind(TokenKind::RIGHT_BRACE)){
-        stmt=parse_stmt();
+        stmt=parse_stmt(sink);
         if (!stmt){
+            if(recover(stmt.error())) continue;
             return std::unexpected(stmt.error());
         }
-        stmts.push_back(stmt.value());
+        sink.push(stmts,stmt.value());
 
         if(!match_token_kind(TokenKind::SEMICOLON)){
-            return std::unexpected(new ParseError("; expected",current_token->line));
+            auto error=diag(DiagCode::SemicolonExpected);
+            if(recover(error)) continue;
+            return std::unexpected(error);
         }
         consume_token();
     };
     consume_token();
 
-    return new Block(std::move(stmts));
+    return sink.block(std::move(stmts));
+}
+
+ParseResult Parser::parse_all(){
+    std::vector<Diagnostic> found;
+    diagnostics=&found;
+    auto program_arena=std::make_unique<Arena>();
+    auto stmts=Stmts(program_arena->resource());
+    std::vector<std::uint32_t> ends;
+    while(true){
+        auto stmt=next_stmt(*program_arena);
+        if(stmt){
+            if(!stmt.value()) break;
+            stmts.push_back(stmt.value());
+            ends.push_back(stmt_end);
+            continue;
+        }
+        if(!recover(stmt.error(),true)) break;
+    }
+    diagnostics=nullptr;
+    return ParseResult{make_program(std::move(program_arena),std::move(stmts),std::move(ends)),std::move(found)};
+}
+
+bool Parser::recover(Diagnostic& error,bool top_level){
+    if(!diagnostics){
+        return false;
+    }
+    if(!error.reported){
+        // error still has to leave the classes it's in
+        auto found=error;
+        found.class_depth+=class_bodies;
+        diagnostics->push_back(found);
+        error.reported=true;
+    }
+    return synchronize(top_level);
+}
+
+// panic mode: skips to just past the ; ending the statement that failed or
+// up to the } of the block around it, false at the end of the tokens. At
+// the top level that } closes nothing, it is skipped as well
+bool Parser::synchronize(bool top_level){
+    std::uint32_t depth=0;
+    while(true){
+        switch(current_kind()){
+            case TokenKind::Eof:
+            case TokenKind::Err: return false;
+            case TokenKind::LEFT_PAREN:
+            case TokenKind::LEFT_BRACE: depth++; break;
+            case TokenKind::RIGHT_PAREN:{
+                                            if(depth) depth--;
+                                            break;
+                                        }
+            case TokenKind::RIGHT_BRACE:{
+                                            if(!depth){
+                                                if(top_level) consume_token();
+                                                return true;
+                                            }
+                                            depth--;
+                                            break;
+                                        }
+            case TokenKind::SEMICOLON:{
+                                          if(!depth){
+                                              consume_token();
+                                              return true;
+                                          }
+                                          break;
+                                      }
+            default: break;
+        }
+        consume_token();
+    }
+}
+
+void Parser::use_explicit_stack(std::uint32_t max_depth){
+    this->max_depth=max_depth;
 }
 
-std::expected<IfElse*,Error*> Parser:: parse_if(){
+// parse_stmt() without recursing into blocks: the statements that own an
+// open block wait on nest_frames and their finished children on
+// nest_stmts. Lambda bodies in expressions start their own parse_nested()
+// above the frames of the enclosing statement
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_nested(Sink& sink){
+    auto& nest_frames=sink.nest_frames;
+    auto& nest_stmts=sink.nest_stmts;
+    auto base=nest_frames.size();
+    auto stmts_mark=nest_stmts.size();
+    auto fail=[&](Diagnostic error){
+        // classes wrap the errors of their body like parse_class() does
+        while(nest_frames.size()>base){
+            if(nest_frames.back().kind==NodeKind::ClassStmt){
+                error=class_body_error(error);
+                class_bodies--;
+            }
+            nest_frames.pop_back();
+        }
+        nest_stmts.resize(stmts_mark);
+        return std::unexpected(error);
+    };
+    auto open=[&](NestFrame<Sink>&& frame){
+        if(nest_frames.size()>=max_depth){
+            return false;
+        }
+        frame.mark=nest_stmts.size();
+        if(frame.kind==NodeKind::ClassStmt) class_bodies++;
+        nest_frames.push_back(std::move(frame));
+        consume_token();
+        return true;
+    };
+    auto too_deep=[&]{
+        auto error=diag(DiagCode::BlocksTooDeep);
+        error.limit=max_depth;
+        return error;
+    };
+    // parse_all() goes on with the next statement of the innermost open
+    // block, an error outside of them is left to the caller
+    auto resume=[&](Diagnostic& error){
+        return nest_frames.size()>base && recover(error);
+    };
+
+    typename Sink::StmtRef done=Sink::none;
+    while(true){
+        if(nest_frames.size()>base && match_token_kind(TokenKind::RIGHT_BRACE)){
+            consume_token();
+            auto frame=std::move(nest_frames.back());
+            nest_frames.pop_back();
+            if(frame.kind==NodeKind::ClassStmt) class_bodies--;
+            auto block=sink.nested_block(frame.mark);
+            nest_stmts.resize(frame.mark);
+            switch(frame.kind){
+                case NodeKind::Block: done=block; break;
+                case NodeKind::IfElse:{
+                                          if(frame.if_block!=Sink::none){
+                                              done=sink.if_else(frame.condition,frame.if_block,block);
+                                              break;
+                                          }
+                                          if(!match_token_kind(TokenKind::ELSE)){
+                                              done=sink.if_else(frame.condition,block,Sink::none);
+                                              break;
+                                          }
+                                          consume_token();
+                                          auto error=diag(DiagCode::LeftBraceExpected);
+                                          if(match_token_kind(TokenKind::LEFT_BRACE)){
+                                              frame.if_block=block;
+                                              if(open(std::move(frame))) continue;
+                                              error=too_deep();
+                                          }
+                                          if(resume(error)) continue;
+                                          return fail(error);
+                                      }
+                case NodeKind::WhileStmt: done=sink.while_stmt(frame.condition,block); break;
+                case NodeKind::FctDecl: done=sink.fct_decl(std::move(*frame.fct),block); break;
+                default: done=sink.class_stmt(std::move(frame.cls),block); break;
+            }
+        }else{
+            NestFrame<Sink> frame{};
+            switch(current_kind()){
+                case TokenKind::LEFT_BRACE: frame.kind=NodeKind::Block; break;
+                case TokenKind::IF:
+                case TokenKind::WHILE:{
+                                          frame.kind=match_token_kind(TokenKind::IF)?NodeKind::IfElse:NodeKind::WhileStmt;
+                                          auto condi=parse_condition(sink);
+                                          if(!condi){
+                                              if(resume(condi.error())) continue;
+                                              return fail(condi.error());
+                                          }
+                                          frame.condition=condi.value();
+                                          break;
+                                      }
+                case TokenKind::FUN:{
+                                        if(Sink::lazy_bodies && lazy){
+                                            auto fct=parse_fct_decl(sink);
+                                            if(!fct){
+                                                if(resume(fct.error())) continue;
+                                                return fail(fct.error());
+                                            }
+                                            done=fct.value();
+                                            break;
+                                        }
+                                        auto head=parse_fct_head(sink);
+                                        if(!head){
+                                            if(resume(head.error())) continue;
+                                            return fail(head.error());
+                                        }
+                                        frame.kind=NodeKind::FctDecl;
+                                        frame.fct.emplace(std::move(head.value()));
+                                        break;
+                                    }
+                case TokenKind::CLASS:{
+                                          auto head=parse_class_head(sink);
+                                          if(!head){
+                                              if(resume(head.error())) continue;
+                                              return fail(head.error());
+                                          }
+                                          frame.kind=NodeKind::ClassStmt;
+                                          frame.cls=head.value();
+                                          break;
+                                      }
+                default:{
+                            Parsed<typename Sink::StmtRef> stmt;
+                            switch(current_kind()){
+                                case TokenKind::LET: stmt=parse_vardeclinit(sink); break;
+                                case TokenKind::RETURN: stmt=parse_return(sink); break;
+                                default: stmt=parse_expr(sink); break;
+                            }
+                            if(!stmt){
+                                if(resume(stmt.error())) continue;
+                                return fail(stmt.error());
+                            }
+                            done=stmt.value();
+                        }
+            }
+            if(done==Sink::none){
+                if(open(std::move(frame))) continue;
+                auto error=too_deep();
+                if(resume(error)) continue;
+                return fail(error);
+            }
+        }
+
+        if(nest_frames.size()==base){
+            nest_stmts.resize(stmts_mark);
+            return done;
+        }
+        nest_stmts.push_back(done);
+        done=Sink::none;
+        if(!match_token_kind(TokenKind::SEMICOLON)){
+            auto error=diag(DiagCode::SemicolonExpected);
+            if(resume(error)) continue;
+            return fail(error);
+        }
+        consume_token();
+    }
+}
+
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_condition(Sink& sink){
     consume_token();
     if(!match_token_kind(TokenKind::LEFT_PAREN)){
-        return std::unexpected(new ParseError("( expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftParenExpected));
     }
     consume_token();
-    auto condi=parse_expr();
+    auto condi=parse_expr(sink);
     if(!condi){
-        return std::unexpected(condi.error());
+        return condi;
     }
     if(!match_token_kind(TokenKind::RIGHT_PAREN)){
-        return std::unexpected(new ParseError(") expected",current_token->line));
+        return std::unexpected(diag(DiagCode::RightParenExpected));
     }
     consume_token();
     if(!match_token_kind(TokenKind::LEFT_BRACE)){
-        return std::unexpected(new ParseError("{ expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftBraceExpected));
+    }
+    return condi;
+}
+
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_if(Sink& sink){
+    auto condi=parse_condition(sink);
+    if(!condi){
+        return std::unexpected(condi.error());
     }
-    auto if_block=parse_block();
+    auto if_block=parse_block(sink);
     if(!if_block){
         return std::unexpected(if_block.error());
     }
     if(!match_token_kind(TokenKind::ELSE)){
-        return new IfElse(condi.value(),if_block.value(),nullptr);
+        return sink.if_else(condi.value(),if_block.value(),Sink::none);
     }
 
     consume_token();
     if(!match_token_kind(TokenKind::LEFT_BRACE)){
-        return std::unexpected(new ParseError("{ expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftBraceExpected));
     }
-    auto else_block=parse_block();
+    auto else_block=parse_block(sink);
     if(!else_block){
         return std::unexpected(else_block.error());
     }
-    return new IfElse(condi.value(),if_block.value(),else_block.value());
+    return sink.if_else(condi.value(),if_block.value(),else_block.value());
 
 }
 
-std::expected<FctDecl*,Error*> Parser::parse_fct_decl(){
+template<typename Sink>
+Parser::Parsed<FctHead<Sink>> Parser::parse_fct_head(Sink& sink){
     consume_token();
     if(!match_token_kind(TokenKind::IDENT)){
-        return std::unexpected(new ParseError("return type identifier expected ",current_token->line));
+        return std::unexpected(diag(DiagCode::ReturnTypeExpected));
     }
     auto ret_type=parse_type();
     if(!ret_type){
         return std::unexpected(ret_type.error());
     }
     if(!match_token_kind(TokenKind::IDENT)){
-        return std::unexpected(new ParseError("function identifier expected",current_token->line));
+        return std::unexpected(diag(DiagCode::FunctionNameExpected));
     }
 
-    auto ident=parse_symbol_assign();
+    auto ident=parse_symbol_assign(sink);
 
     if(!match_token_kind(TokenKind::LEFT_PAREN)){
-        return std::unexpected(new ParseError("( expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftParenExpected));
     }
     consume_token();
-    Params params;
+    auto params=sink.params();
     uint16_t params_count=MAX_PARAMS;
     while(!match_token_kind(TokenKind::RIGHT_PAREN) && params_count){
         if(!match_token_kind(TokenKind::IDENT)){
-            return std::unexpected(new ParseError("parameter identifier expected",current_token->line));
+            return std::unexpected(diag(DiagCode::ParamNameExpected));
         }
-        auto param=parse_symbol_assign();
+        auto param=current_ident();
+        consume_token();
 
         if(!match_token_kind(TokenKind::COLLON)){
-            return std::unexpected(new ParseError(": expected",current_token->line));
+            return std::unexpected(diag(DiagCode::ColonExpected));
         }
         consume_token();
 
         if(!match_token_kind(TokenKind::IDENT)){
-            return std::unexpected(new ParseError("type identifier expected",current_token->line));
+            return std::unexpected(diag(DiagCode::TypeExpected));
         }
         auto type=parse_type();
         if(!type){
             return std::unexpected(type.error());
         }
-        auto tuple=std::make_tuple((Symbol*)param.value(),type.value());
-        params.push_back(tuple);
+        sink.param(params,param,type.value());
 
         if(!match_token_kind(TokenKind::COMMA)){
-            return std::unexpected(new ParseError(", expected",current_token->line));
+            return std::unexpected(diag(DiagCode::CommaExpected));
         }
         consume_token();
 
@@ -174,279 +595,366 @@ std::expected<FctDecl*,Error*> Parser::parse_fct_decl(){
     }
 
     if(!params_count){
-        return std::unexpected(new ParseError(") expected or overexceed params count",current_token->line));
+        return std::unexpected(diag(DiagCode::TooManyParams));
     }
     consume_token();
 
     if(!match_token_kind(TokenKind::LEFT_BRACE)){
-        return std::unexpected(new ParseError("{ expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftBraceExpected));
     }
+    if(!ident){
+        return std::unexpected(ident.error());
+    }
+    return FctHead<Sink>{ret_type.value(),sink.name(ident.value()),std::move(params)};
+}
 
-    auto block=parse_block();
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_fct_decl(Sink& sink){
+    auto head=parse_fct_head(sink);
+    if(!head){
+        return std::unexpected(head.error());
+    }
+    if constexpr(Sink::lazy_bodies){
+        if(lazy){
+            auto body_at=skip_body();
+            if(!body_at){
+                return std::unexpected(body_at.error());
+            }
+            auto fct=sink.fct_decl(std::move(head.value()),nullptr);
+            fct->lazy_=lazy_source_here();
+            fct->body_at=body_at.value();
+            skipped.push_back(fct);
+            return fct;
+        }
+    }
+    auto block=parse_block(sink);
     if(!block){
         return std::unexpected(block.error());
     }
+    return sink.fct_decl(std::move(head.value()),block.value());
+}
+
+std::expected<std::uint32_t,Diagnostic> Parser::skip_body(){
+    auto offset=tokens.offsets[current];
+    std::uint32_t depth=0;
+    do{
+        if(match_token_kind(TokenKind::LEFT_BRACE)) depth++;
+        else if(match_token_kind(TokenKind::RIGHT_BRACE)) depth--;
+        auto next=consume_token();
+        if(!next){
+            return std::unexpected(next.error());
+        }
+    }while(depth);
+    return offset;
+}
+
+const LazySource* Parser::lazy_source_here(){
+    if(!lazy_source || lazy_source->arena!=tree.arena){
+        lazy_source=std::make_shared<LazySource>(LazySource{_lexer,tree.arena,max_depth});
+        tree.arena->keep(lazy_source);
+    }
+    return lazy_source.get();
+}
 
-    return new FctDecl(ret_type.value(),(Symbol*)(ident.value()),std::move(params),block.value());
+void Parser::use_lazy_bodies(){
+    lazy=!stream;
 }
 
-std::expected<ClassStmt*,Error*> Parser::parse_class(){
+// the body is lexed again from its {, the functions in it are skipped in
+// turn
+std::expected<Block*,Error*> Parser::parse_body(const LazySource& source,std::uint32_t offset){
+    auto parser=Parser(source.lexer.at(offset),true);
+    parser.tree.arena=source.arena;
+    parser.max_depth=source.max_depth;
+    parser.lazy=true;
+    auto block=parser.parse_stmt(parser.tree);
+    if(!block){
+        return std::unexpected(parser.to_error(block.error()));
+    }
+    return static_cast<Block*>(block.value());
+}
+
+std::expected<Block*,Error*> FctDecl::body(){
+    if(!block_){
+        auto block=Parser::parse_body(*lazy_,body_at);
+        if(!block){
+            return block;
+        }
+        block_=block.value();
+    }
+    return block_;
+}
+
+std::expected<Block*,Error*> FctExpr::body(){
+    if(!block_){
+        auto block=Parser::parse_body(*lazy_,body_at);
+        if(!block){
+            return block;
+        }
+        block_=block.value();
+    }
+    return block_;
+}
+
+template<typename Sink>
+Parser::Parsed<ClassHead<Sink>> Parser::parse_class_head(Sink& sink){
     consume_token();
     if(!match_token_kind(TokenKind::IDENT)){
-        return std::unexpected(new ParseError("class identifier expected",current_token->line));
+        return std::unexpected(diag(DiagCode::ClassNameExpected));
     }
-    auto ident=parse_symbol_assign();
+    auto ident=parse_symbol_assign(sink);
 
-    Type* type=nullptr;
+    Type type=NoIdent;
 
     if(match_token_kind(TokenKind::COLLON)){
         consume_token();
         if(!match_token_kind(TokenKind::IDENT)){
-            return std::unexpected(new ParseError("parent class identifier expected",current_token->line));
+            return std::unexpected(diag(DiagCode::ParentClassExpected));
         }
         auto op_type=parse_type();
         type=op_type.value();
     }
 
     if(!match_token_kind(TokenKind::LEFT_BRACE)){
-        return std::unexpected(new ParseError("{ expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftBraceExpected));
+    }
+    if(!ident){
+        return std::unexpected(ident.error());
     }
+    return ClassHead<Sink>{sink.name(ident.value()),type};
+}
 
-    auto block=parse_block();
+Diagnostic Parser::class_body_error(Diagnostic error){
+    error.class_depth++;
+    return error;
+}
+
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_class(Sink& sink){
+    auto head=parse_class_head(sink);
+    if(!head){
+        return std::unexpected(head.error());
+    }
+
+    class_bodies++;
+    auto block=parse_block(sink);
+    class_bodies--;
     if(!block){
-        auto msg=std::string("couldn't parse class body : ")+block.error()->_msg;
-        return std::unexpected(new ParseError(std::move(msg),current_token->line));
+        return std::unexpected(class_body_error(block.error()));
     }
-    Expr* value=ident.value();
-    return new ClassStmt((Symbol*)(value),type,block.value());
+    return sink.class_stmt(std::move(head.value()),block.value());
 }
 
-std::expected<WhileStmt*,Error*> Parser::parse_while(){
-    consume_token();
-    if(!match_token_kind(TokenKind::LEFT_PAREN)){
-        return std::unexpected(new ParseError("( expected",current_token->line));
-    }
-    consume_token();
-    auto condi=parse_expr();
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_while(Sink& sink){
+    auto condi=parse_condition(sink);
     if(!condi){
         return std::unexpected(condi.error());
     }
-    if(!match_token_kind(TokenKind::RIGHT_PAREN)){
-        return std::unexpected(new ParseError(") expected",current_token->line));
-    }
-    consume_token();
-    if(!match_token_kind(TokenKind::LEFT_BRACE)){
-        return std::unexpected(new ParseError("{ expected",current_token->line));
-    }
-    auto while_block=parse_block();
+    auto while_block=parse_block(sink);
     if(!while_block){
         return std::unexpected(while_block.error());
     }
-    return new WhileStmt(condi.value(),while_block.value());
+    return sink.while_stmt(condi.value(),while_block.value());
 }
 
-std::expected<Type*,Error*> Parser::parse_type(){
-    auto ident=current_token.value().lexeme;
+Parser::Parsed<Type> Parser::parse_type(){
+    auto ident=current_ident();
     consume_token();
-    return new Type(std::move(ident));
+    return ident;
 }
 
-std::expected<VarDeclInit*,Error*> Parser::parse_vardeclinit(){
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_vardeclinit(Sink& sink){
     consume_token();
     if(!match_token_kind(TokenKind::IDENT)){
-        return std::unexpected(new ParseError("variable identifier expected",current_token->line));
+        return std::unexpected(diag(DiagCode::VariableNameExpected));
     }
 
-    auto ident=parse_symbol_assign();
+    auto ident=parse_symbol_assign(sink);
 
     if(!match_token_kind(TokenKind::COLLON)){
-        return std::unexpected(new ParseError(": expected",current_token->line));
+        return std::unexpected(diag(DiagCode::ColonExpected));
     }
     consume_token();
 
     if(!match_token_kind(TokenKind::IDENT)){
-        return std::unexpected(new ParseError("type identifier expected",current_token->line));
+        return std::unexpected(diag(DiagCode::TypeExpected));
     }
     auto type=parse_type();
     if(!type){
         return std::unexpected(type.error());
     }
+    if(!ident){
+        return std::unexpected(ident.error());
+    }
+    auto name=sink.name(ident.value());
 
     if(!match_token_kind(TokenKind::EQUAL)){
-        return new VarDeclInit((Symbol*)(ident.value()),nullptr,type.value());
+        return sink.var_decl(name,Sink::none,type.value());
     }
 
     consume_token();
-    auto value=parse_expr();
+    auto value=parse_expr(sink);
     if(!value){
         return std::unexpected(value.error());
     }
-    return new VarDeclInit((Symbol*)(ident.value()),value.value(),type.value());
+    return sink.var_decl(name,value.value(),type.value());
 }
 
-std::expected<Return*,Error*> Parser::parse_return(){
+template<typename Sink>
+Parser::Parsed<typename Sink::StmtRef> Parser::parse_return(Sink& sink){
     consume_token();
-    auto value=parse_expr();
+    auto value=parse_expr(sink);
     if(!value){
         return std::unexpected(value.error());
     }
-    return new Return(value.value());
+    return sink.return_stmt(value.value());
 }
 
-std::expected<Expr*,Error*> Parser::parse_expr(){
-    return  parse_term();
-}
-
-std::expected<Expr*,Error*> Parser::parse_term(){
-    auto left_expr=parse_factor();
-    if (left_expr){
-        switch(current_token.value().kind){
-            case TokenKind::PLUS:{
-                                     consume_token();
-                                     auto right_expr=parse_expr();
-                                     if (!right_expr){
-                                         return right_expr;
-                                     }
-                                     return new Add(left_expr.value(),right_expr.value());
-                                 }
-
-            case TokenKind::MINUS:{
-                                      consume_token();
-                                      auto right_expr=parse_expr();
-                                      if (!right_expr){
-                                          return right_expr;
-                                      }
-                                      return new Sub(left_expr.value(),right_expr.value());
-                                  }
-            default:break;
-        }
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_expr(Sink& sink){
+    auto climb_expr=[&]{
+        return climb(sink.operands,[&]{return parse_unary(sink);},
+                [&](TokenKind op,auto left,auto right){return sink.binary(op,left,right);});
+    };
+    if(!max_depth){
+        return climb_expr();
     }
-    return left_expr;
+    // parentheses, call arguments and lambda bodies still recurse
+    if(expr_depth>=MAX_EXPR_DEPTH){
+        auto error=diag(DiagCode::ExprTooDeep);
+        error.limit=MAX_EXPR_DEPTH;
+        return std::unexpected(error);
+    }
+    expr_depth++;
+    auto expr=climb_expr();
+    expr_depth--;
+    return expr;
 }
 
-std::expected<Expr*,Error*> Parser::parse_factor(){
-    auto left_expr=parse_fctcalls();
-    if (left_expr){
-        switch(current_token.value().kind){
-            case tua::TokenKind::STAR:{
-
-                                          consume_token();
-                                          auto right_expr=parse_expr();
-                                          if (!right_expr){
-                                              return right_expr;
-                                          }
-                                          return new Mul(left_expr.value(),right_expr.value());
-                                      }
-
-            case TokenKind::SLASH :{
-                                       consume_token();
-                                       auto right_expr=parse_expr();
-                                       if (!right_expr){
-                                           return right_expr;
-                                       }
-                                       return new Div(left_expr.value(),right_expr.value());
-                                   }
-            default:break;
-        }
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_unary(Sink& sink){
+    // prefix operators wait on the operator stack for their operand
+    auto base=operators.size();
+    while(match_token_kind(TokenKind::MINUS) || match_token_kind(TokenKind::BANG)){
+        operators.push_back(current_kind());
+        consume_token();
     }
-    return left_expr;
+    auto expr=parse_fctcalls(sink);
+    if(!expr){
+        operators.resize(base);
+        return expr;
+    }
+    auto value=expr.value();
+    while(operators.size()>base){
+        value=sink.unary(operators.back(),value);
+        operators.pop_back();
+    }
+    return value;
 }
 
-std::expected<Expr*,Error*> Parser::parse_fctcalls(){
-    auto expr=parse_terminals();
-    if(expr){
-        while(match_token_kind(TokenKind::LEFT_PAREN)){
-            expr=parse_fctcall(expr.value());
-        }
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_fctcalls(Sink& sink){
+    auto expr=parse_terminals(sink);
+    while(expr && match_token_kind(TokenKind::LEFT_PAREN)){
+        expr=parse_fctcall(sink,expr.value());
     }
 
     return expr;
 }
 
-std::expected<Expr*,Error*> Parser::parse_fctcall(Expr* expr){
-    auto args=std::vector<Expr*>();
-    std::expected<Expr*,Error*> arg;
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_fctcall(Sink& sink,typename Sink::ExprRef expr){
+    auto args=sink.args();
+    Parsed<typename Sink::ExprRef> arg;
     consume_token();
     if(!match_token_kind(TokenKind::RIGHT_PAREN)){
-        arg=parse_expr();
+        arg=parse_expr(sink);
         if(!arg){
             return arg;
         }
-        args.push_back(arg.value());
+        sink.push(args,arg.value());
         while(!match_token_kind(TokenKind::RIGHT_PAREN)){
             if(!match_token_kind(TokenKind::COMMA)){
-                return std::unexpected(new ParseError(", expected",current_token->line));
+                return std::unexpected(diag(DiagCode::CommaExpected));
             }
             consume_token();
-            arg=parse_expr();
+            arg=parse_expr(sink);
             if(!arg){
                 return arg;
             }
-            args.push_back(arg.value());
+            sink.push(args,arg.value());
         }
     }
     consume_token();
-    return new FctCall(expr,std::move(args));
+    return sink.fct_call(expr,std::move(args));
 }
 
-std::expected<Expr*,Error*> Parser::parse_terminals(){
-    switch(current_token.value().kind){
-        case TokenKind::DOUBLE:  return parse_double();
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_terminals(Sink& sink){
+    switch(current_kind()){
+        case TokenKind::DOUBLE:  return parse_double(sink);
 
-        case TokenKind::INT: return parse_int();
+        case TokenKind::INT: return parse_int(sink);
 
-        case TokenKind::STRING: return parse_str();
+        case TokenKind::STRING: return parse_str(sink);
 
         case TokenKind::FALSE: 
-        case TokenKind::TRUE: return parse_bool();
+        case TokenKind::TRUE: return parse_bool(sink);
+
+        case TokenKind::LEFT_PAREN: return parse_group(sink);
+        case TokenKind::IDENT: return parse_symbol_assign(sink);
+        case TokenKind::LAMBDA: return parse_fct_expr(sink);
 
-        case TokenKind::LEFT_PAREN: return parse_group();
-        case TokenKind::IDENT: return parse_symbol_assign();
-        case TokenKind::LAMBDA: return parse_fct_expr();
+        case TokenKind::Err: return std::unexpected(lex_error());
 
         default: break;
     };
-    auto token_lexeme=current_token.value().lexeme;
-    std::string msg=std::string("unknown Terminal token : ")+token_lexeme;
-    return std::unexpected(new ParseError(std::move(msg),current_token->line));
+    return std::unexpected(diag(DiagCode::UnknownTerminal));
 }
 
-std::expected<Expr*,Error*> Parser::parse_group(){
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_group(Sink& sink){
     consume_token();
-    auto expr=parse_expr();
+    auto expr=parse_expr(sink);
     if(!expr){
         return expr;
     }
     if(!match_token_kind(TokenKind::RIGHT_PAREN)){
-        return std::unexpected(new ParseError(") expected",current_token->line));
+        return std::unexpected(diag(DiagCode::RightParenExpected));
     }
     consume_token();
-    return new Group(expr.value());
+    return sink.group(expr.value());
 }
 
-std::expected<Expr*,Error*> Parser::parse_int(){
-    int value=std::atoi(current_token.value().lexeme.c_str());
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_int(Sink& sink){
+    auto value=tokens.numbers[tokens.payloads[current]].int_value;
     consume_token();
-    return new Int(value);
+    return sink.int_value(value);
 }
 
-std::expected<Expr*,Error*> Parser::parse_double(){
-    double value=std::stod(current_token.value().lexeme.c_str());
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_double(Sink& sink){
+    auto value=tokens.numbers[tokens.payloads[current]].double_value;
     consume_token();
-    return new Double(value);
+    return sink.double_value(value);
 }
 
-std::expected<Expr*,Error*> Parser::parse_bool(){
-    TokenKind tkind=current_token.value().kind;
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_bool(Sink& sink){
+    TokenKind tkind=current_kind();
     bool value=(tkind==TokenKind::TRUE)?true:false;
     consume_token();
-    return new Bool(value);
+    return sink.bool_value(value);
 }
 
-std::expected<Expr*,Error*> Parser::parse_fct_expr(){
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_fct_expr(Sink& sink){
     consume_token();
     if(!match_token_kind(TokenKind::IDENT)){
-        return std::unexpected(new ParseError("return type identifier expected ",current_token->line));
+        return std::unexpected(diag(DiagCode::ReturnTypeExpected));
     }
     auto ret_type=parse_type();
     if(!ret_type){
@@ -454,34 +962,34 @@ std::expected<Expr*,Error*> Parser::parse_fct_expr(){
     }
 
     if(!match_token_kind(TokenKind::LEFT_PAREN)){
-        return std::unexpected(new ParseError("( expected",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftParenExpected));
     }
     consume_token();
-    Params params;
+    auto params=sink.params();
     uint16_t params_count=MAX_PARAMS;
     while(!match_token_kind(TokenKind::RIGHT_PAREN) && params_count){
         if(!match_token_kind(TokenKind::IDENT)){
-            return std::unexpected(new ParseError("parameter identifier expected ",current_token->line));
+            return std::unexpected(diag(DiagCode::ParamNameExpected,true));
         }
-        auto param=parse_symbol_assign();
+        auto param=current_ident();
+        consume_token();
 
         if(!match_token_kind(TokenKind::COLLON)){
-            return std::unexpected(new ParseError(": expected ",current_token->line));
+            return std::unexpected(diag(DiagCode::ColonExpected,true));
         }
         consume_token();
         if(!match_token_kind(TokenKind::IDENT)){
-            return std::unexpected(new ParseError("type identifier expected ",current_token->line));
+            return std::unexpected(diag(DiagCode::TypeExpected,true));
         }
 
         auto type=parse_type();
         if(!type){
             return std::unexpected(type.error());
         }
-        auto tuple=std::make_tuple((Symbol*)param.value(),type.value());
-        params.push_back(tuple);
+        sink.param(params,param,type.value());
 
         if(!match_token_kind(TokenKind::COMMA)){
-            return std::unexpected(new ParseError(", expected ",current_token->line));
+            return std::unexpected(diag(DiagCode::CommaExpected,true));
         }
         consume_token();
 
@@ -489,44 +997,101 @@ std::expected<Expr*,Error*> Parser::parse_fct_expr(){
     }
 
     if(!params_count){
-        return std::unexpected(new ParseError(") expected or overexceed params count",current_token->line));
+        return std::unexpected(diag(DiagCode::TooManyParams));
     }
     consume_token();
 
     if(!match_token_kind(TokenKind::LEFT_BRACE)){
-        return std::unexpected(new ParseError("{ expected ",current_token->line));
+        return std::unexpected(diag(DiagCode::LeftBraceExpected,true));
     }
 
-    auto block=parse_block();
+    if constexpr(Sink::lazy_bodies){
+        if(lazy){
+            auto body_at=skip_body();
+            if(!body_at){
+                return std::unexpected(body_at.error());
+            }
+            auto fct=sink.fct_expr(ret_type.value(),std::move(params),nullptr);
+            fct->lazy_=lazy_source_here();
+            fct->body_at=body_at.value();
+            skipped.push_back(fct);
+            return fct;
+        }
+    }
+    auto block=parse_block(sink);
     if(!block){
         return std::unexpected(block.error());
     }
 
-    return new FctExpr(ret_type.value(),std::move(params),block.value());
+    return sink.fct_expr(ret_type.value(),std::move(params),block.value());
 }
 
-std::expected<Expr*,Error*> Parser::parse_str(){
-    auto value=current_token.value().lexeme;
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_str(Sink& sink){
+    auto value=current_lexeme();
     consume_token();
-    return new Str(value);
+    return sink.str(value);
 }
 
-std::expected<Expr*,Error*> Parser::parse_symbol_assign(){
-    auto ident=current_token.value().lexeme;
+template<typename Sink>
+Parser::Parsed<typename Sink::ExprRef> Parser::parse_symbol_assign(Sink& sink){
+    auto ident=current_ident();
     consume_token();
     if(!match_token_kind(TokenKind::EQUAL)){
-        return new Symbol(std::move(ident));
+        return sink.symbol(ident);
     }
     consume_token();
-    auto value=parse_expr();
+    auto value=parse_expr(sink);
     if(!value){
         return value;
     }
-    return new Assign(std::move(ident),value.value());
+    return sink.assign(ident,value.value());
 }
 
 bool Parser::at_end() const noexcept {return match_token_kind(TokenKind::Eof);}
 
-bool Parser::match_token_kind(TokenKind kind) const { return current_token.value().kind==kind; }
+Diagnostic Parser::lex_error() const {
+    switch(static_cast<LexError>(tokens.payloads[current])){
+        case LexError::Malformed: return diag(DiagCode::MalformedNumber);
+        case LexError::OutOfRange: return diag(DiagCode::NumberOutOfRange);
+        default: break;
+    }
+    return diag(DiagCode::UnknownToken);
+}
+
+Diagnostic Parser::diag(DiagCode code,bool lambda) const {
+    return Diagnostic{.code=code,.lambda=lambda,.offset=tokens.offsets[current],.length=tokens.lengths[current],.line=current_line()};
+}
+
+std::string Parser::message(const Diagnostic& diagnostic) const {
+    if(stream){
+        return tua::message(diagnostic,stream->text(diagnostic.offset,diagnostic.length));
+    }
+    return tua::message(diagnostic,_lexer.source().substr(diagnostic.offset,diagnostic.length));
+}
+
+Error* Parser::to_error(const Diagnostic& diagnostic) const {
+    return new ParseError(message(diagnostic),diagnostic.line);
+}
+
+bool Parser::match_token_kind(TokenKind kind) const { return current_kind()==kind; }
+
+TokenKind Parser::current_kind() const noexcept { return tokens.kinds[current]; }
+
+IdentId Parser::current_ident() const noexcept { return tokens.payloads[current]; }
+
+std::string_view Parser::current_lexeme() const noexcept {
+    if(stream){
+        return stream->text(tokens.offsets[current],tokens.lengths[current]);
+    }
+    return _lexer.source().substr(tokens.offsets[current],tokens.lengths[current]);
+}
+
+std::uint32_t Parser::current_line() const noexcept {
+    if(stream){
+        return stream->line_of(tokens.offsets[current]);
+    }
+    return _lexer.line_of(tokens.offsets[current]);
+}
 
 };
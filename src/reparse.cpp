@@ -0,0 +1,149 @@
+#include<algorithm>
+#include<cstdint>
+#include<expected>
+#include<memory>
+#include<memory_resource>
+#include<string_view>
+#include<vector>
+
+#include"parser.h"
+#include"lexer.h"
+#include"ast.h"
+#include"ast_visitor.h"
+#include"error.h"
+
+namespace tua{
+
+static constexpr std::size_t EDIT_ARENA_SIZE=1<<12;
+
+namespace {
+    // the functions skipped in the body of a function body() parsed
+    void skipped_in(Block* block,std::vector<Stmt*>& found){
+        std::vector<Stmt*> stack{block};
+        while(!stack.empty()){
+            auto at=stack.back();
+            stack.pop_back();
+            auto skipped=[](auto fct){return !fct->block_ && fct->lazy_;};
+            if((at->kind==NodeKind::FctDecl && skipped(static_cast<FctDecl*>(at)))
+                    || (at->kind==NodeKind::FctExpr && skipped(static_cast<FctExpr*>(at)))){
+                found.push_back(at);
+                continue;
+            }
+            each_child(at,[&](Stmt* child){stack.push_back(child);});
+        }
+    }
+};
+
+// a top level statement ends with a ; and the lexer keeps no state from
+// one token to the next, so lexing from just past an old ; gives the
+// tokens a full lex would. Statements ending at or before the edit keep
+// their tokens, statements starting at an old end past it read the same
+// text as before
+std::expected<Program,Error*> Parser::reparse(Program&& previous,std::string_view text,const Edit& edit){
+    if(previous.reparses>=MAX_REPARSES){
+        auto parser=Parser(Lexer::view(text),false);
+        parser.max_depth=previous.max_depth;
+        parser.lazy=previous.lazy;
+        return parser.parse();
+    }
+    const auto& old_ends=previous.ends;
+    std::int64_t delta=static_cast<std::int64_t>(edit.inserted.size())-edit.removed;
+    std::uint32_t edit_end=edit.offset+edit.inserted.size();
+
+    // the first statement the edit can reach, an edit just past a ; leaves
+    // its statement alone
+    std::size_t first=std::upper_bound(old_ends.begin(),old_ends.end(),edit.offset)-old_ends.begin();
+    std::uint32_t kept_end=first?old_ends[first-1]:0;
+    auto parser=Parser(Lexer::view(text,kept_end),true);
+    parser.max_depth=previous.max_depth;
+    parser.lazy=previous.lazy;
+
+    // an edit replaces a few statements, the arena starts small and the
+    // list of every statement is on the heap so neither is left over for
+    // long once the next edit replaces this program
+    auto program_arena=std::make_unique<Arena>(EDIT_ARENA_SIZE);
+    auto stmts=Stmts(std::pmr::new_delete_resource());
+    std::vector<std::uint32_t> ends;
+    stmts.reserve(previous.stmts.size()+1);
+    ends.reserve(old_ends.size()+1);
+    stmts.insert(stmts.end(),previous.stmts.begin(),previous.stmts.begin()+first);
+    ends.insert(ends.end(),old_ends.begin(),old_ends.begin()+first);
+
+    std::expected<Stmt*,Diagnostic> stmt;
+    // where the statements taken over past the edit start in the old text
+    std::uint32_t taken_at=UINT32_MAX;
+    while((stmt=parser.next_stmt(*program_arena)) && stmt.value()){
+        stmts.push_back(stmt.value());
+        ends.push_back(parser.stmt_end);
+        if(parser.stmt_end<edit_end){
+            continue;
+        }
+        // past the edit the text is the old one, moved by delta
+        auto old_end=parser.stmt_end-delta;
+        auto same=std::lower_bound(old_ends.begin()+first,old_ends.end(),old_end);
+        if(same!=old_ends.end() && *same==old_end){
+            auto next=same-old_ends.begin()+1;
+            taken_at=old_end;
+            stmts.insert(stmts.end(),previous.stmts.begin()+next,previous.stmts.end());
+            for(auto end=old_ends.begin()+next;end!=old_ends.end();end++){
+                ends.push_back(*end+delta);
+            }
+            break;
+        }
+    }
+    if(!stmt){
+        return std::unexpected(parser.to_error(stmt.error()));
+    }
+
+    // text replaces the old one, the bodies left to parse in the
+    // statements taken over are read from it, moved by delta past the
+    // edit. Those in the statements replaced go with them
+    std::shared_ptr<LazySource> source;
+    std::vector<Stmt*> lazy_bodies;
+    auto pending=std::move(previous.lazy_bodies);
+    auto rebind=[&](auto fct){
+        std::int64_t moved=0;
+        if(fct->body_at>=taken_at){
+            moved=delta;
+        }else if(fct->body_at>=kept_end){
+            return;
+        }
+        if(fct->block_){
+            skipped_in(fct->block_,pending);
+            return;
+        }
+        if(!source){
+            source=std::make_shared<LazySource>(LazySource{Lexer::view(text),program_arena.get(),fct->lazy_->max_depth});
+            program_arena->keep(source);
+        }
+        fct->lazy_=source.get();
+        fct->body_at+=moved;
+        lazy_bodies.push_back(fct);
+    };
+    while(!pending.empty()){
+        auto fct=pending.back();
+        pending.pop_back();
+        if(fct->kind==NodeKind::FctDecl){
+            rebind(static_cast<FctDecl*>(fct));
+        }else{
+            rebind(static_cast<FctExpr*>(fct));
+        }
+    }
+    lazy_bodies.insert(lazy_bodies.end(),parser.skipped.begin(),parser.skipped.end());
+
+    // the nodes taken over stay in the old arena, previous lets go of its
+    // vector before the arena it lives in can go with the new program
+    auto reparses=previous.reparses+1;
+    previous.stmts.clear();
+    previous.stmts.shrink_to_fit();
+    previous.ends.clear();
+    program_arena->adopt(std::move(previous.arena));
+    auto program=Program(std::move(program_arena),std::move(stmts),std::move(ends));
+    program.reparses=reparses;
+    program.max_depth=previous.max_depth;
+    program.lazy=previous.lazy;
+    program.lazy_bodies=std::move(lazy_bodies);
+    return program;
+}
+
+};
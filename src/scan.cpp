@@ -0,0 +1,195 @@
+#include<bit>
+#include<cstdint>
+
+#include"scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TUA_SCAN_X86
+#include<immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include<intrin.h>
+#define TUA_AVX2
+#else
+#include<cpuid.h>
+#define TUA_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace tua::scan{
+    namespace {
+        struct Kernels{
+            const char* (*skip_space)(const char*,const char*);
+            const char* (*skip_alnum)(const char*,const char*);
+            const char* (*find_byte)(const char*,const char*,char);
+        };
+
+        const char* skip_space_scalar(const char* p,const char* end){
+            while(p!=end && is_space(*p)) p++;
+            return p;
+        }
+
+        const char* skip_alnum_scalar(const char* p,const char* end){
+            while(p!=end && is_alnum(*p)) p++;
+            return p;
+        }
+
+        const char* find_byte_scalar(const char* p,const char* end,char c){
+            while(p!=end && *p!=c) p++;
+            return p;
+        }
+
+#ifdef TUA_SCAN_X86
+        // bytes >= 0x80 are negative for the signed compares, so they never
+        // classify as spaces, letters or digits
+
+        __m128i space_mask(__m128i chunk){
+            auto blank=_mm_cmpeq_epi8(chunk,_mm_set1_epi8(' '));
+            auto ctrl=_mm_and_si128(_mm_cmpgt_epi8(chunk,_mm_set1_epi8('\t'-1)),_mm_cmplt_epi8(chunk,_mm_set1_epi8('\r'+1)));
+            return _mm_or_si128(blank,ctrl);
+        }
+
+        __m128i alnum_mask(__m128i chunk){
+            auto digit=_mm_and_si128(_mm_cmpgt_epi8(chunk,_mm_set1_epi8('0'-1)),_mm_cmplt_epi8(chunk,_mm_set1_epi8('9'+1)));
+            auto lower=_mm_or_si128(chunk,_mm_set1_epi8(0x20));
+            auto alpha=_mm_and_si128(_mm_cmpgt_epi8(lower,_mm_set1_epi8('a'-1)),_mm_cmplt_epi8(lower,_mm_set1_epi8('z'+1)));
+            return _mm_or_si128(digit,alpha);
+        }
+
+        const char* skip_space_sse2(const char* p,const char* end){
+            while(end-p>=16){
+                auto chunk=_mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                unsigned spaces=_mm_movemask_epi8(space_mask(chunk));
+                if(spaces!=0xFFFFu){
+                    return p+std::countr_one(spaces);
+                }
+                p+=16;
+            }
+            return skip_space_scalar(p,end);
+        }
+
+        const char* skip_alnum_sse2(const char* p,const char* end){
+            while(end-p>=16){
+                auto chunk=_mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                unsigned alnums=_mm_movemask_epi8(alnum_mask(chunk));
+                if(alnums!=0xFFFFu){
+                    return p+std::countr_one(alnums);
+                }
+                p+=16;
+            }
+            return skip_alnum_scalar(p,end);
+        }
+
+        const char* find_byte_sse2(const char* p,const char* end,char c){
+            auto needle=_mm_set1_epi8(c);
+            while(end-p>=16){
+                auto chunk=_mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                unsigned found=_mm_movemask_epi8(_mm_cmpeq_epi8(chunk,needle));
+                if(found){
+                    return p+std::countr_zero(found);
+                }
+                p+=16;
+            }
+            return find_byte_scalar(p,end,c);
+        }
+
+        TUA_AVX2 __m256i space_mask_avx2(__m256i chunk){
+            auto blank=_mm256_cmpeq_epi8(chunk,_mm256_set1_epi8(' '));
+            auto ctrl=_mm256_and_si256(_mm256_cmpgt_epi8(chunk,_mm256_set1_epi8('\t'-1)),_mm256_cmpgt_epi8(_mm256_set1_epi8('\r'+1),chunk));
+            return _mm256_or_si256(blank,ctrl);
+        }
+
+        TUA_AVX2 __m256i alnum_mask_avx2(__m256i chunk){
+            auto digit=_mm256_and_si256(_mm256_cmpgt_epi8(chunk,_mm256_set1_epi8('0'-1)),_mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1),chunk));
+            auto lower=_mm256_or_si256(chunk,_mm256_set1_epi8(0x20));
+            auto alpha=_mm256_and_si256(_mm256_cmpgt_epi8(lower,_mm256_set1_epi8('a'-1)),_mm256_cmpgt_epi8(_mm256_set1_epi8('z'+1),lower));
+            return _mm256_or_si256(digit,alpha);
+        }
+
+        TUA_AVX2 const char* skip_space_avx2(const char* p,const char* end){
+            while(end-p>=32){
+                auto chunk=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                unsigned spaces=_mm256_movemask_epi8(space_mask_avx2(chunk));
+                if(spaces!=0xFFFFFFFFu){
+                    return p+std::countr_one(spaces);
+                }
+                p+=32;
+            }
+            return skip_space_sse2(p,end);
+        }
+
+        TUA_AVX2 const char* skip_alnum_avx2(const char* p,const char* end){
+            while(end-p>=32){
+                auto chunk=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                unsigned alnums=_mm256_movemask_epi8(alnum_mask_avx2(chunk));
+                if(alnums!=0xFFFFFFFFu){
+                    return p+std::countr_one(alnums);
+                }
+                p+=32;
+            }
+            return skip_alnum_sse2(p,end);
+        }
+
+        TUA_AVX2 const char* find_byte_avx2(const char* p,const char* end,char c){
+            auto needle=_mm256_set1_epi8(c);
+            while(end-p>=32){
+                auto chunk=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                unsigned found=_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk,needle));
+                if(found){
+                    return p+std::countr_zero(found);
+                }
+                p+=32;
+            }
+            return find_byte_sse2(p,end,c);
+        }
+
+        // AVX2 needs the cpu flag and the OS saving the ymm registers
+        bool has_avx2(){
+#if defined(_MSC_VER) && !defined(__clang__)
+            int regs[4];
+            __cpuid(regs,1);
+            if(!(regs[2]&(1<<27)) || !(regs[2]&(1<<28))) return false;
+            if((_xgetbv(0)&6)!=6) return false;
+            __cpuidex(regs,7,0);
+            return regs[1]&(1<<5);
+#else
+            unsigned eax,ebx,ecx,edx;
+            if(!__get_cpuid(1,&eax,&ebx,&ecx,&edx)) return false;
+            if(!(ecx&(1u<<27)) || !(ecx&(1u<<28))) return false;
+            unsigned xcr0_lo,xcr0_hi;
+            __asm__("xgetbv":"=a"(xcr0_lo),"=d"(xcr0_hi):"c"(0));
+            if((xcr0_lo&6)!=6) return false;
+            if(!__get_cpuid_count(7,0,&eax,&ebx,&ecx,&edx)) return false;
+            return ebx&(1u<<5);
+#endif
+        }
+#endif
+
+        Kernels select_kernels(){
+#ifdef TUA_SCAN_X86
+            if(has_avx2()){
+                return Kernels{skip_space_avx2,skip_alnum_avx2,find_byte_avx2};
+            }
+            return Kernels{skip_space_sse2,skip_alnum_sse2,find_byte_sse2};
+#else
+            return Kernels{skip_space_scalar,skip_alnum_scalar,find_byte_scalar};
+#endif
+        }
+
+        const Kernels& kernels(){
+            static const Kernels selected=select_kernels();
+            return selected;
+        }
+    };
+
+    const char* skip_space(const char* p,const char* end) noexcept{
+        return kernels().skip_space(p,end);
+    }
+
+    const char* skip_alnum(const char* p,const char* end) noexcept{
+        return kernels().skip_alnum(p,end);
+    }
+
+    const char* find_byte(const char* p,const char* end,char c) noexcept{
+        return kernels().find_byte(p,end,c);
+    }
+};
@@ -0,0 +1,569 @@
+#include<algorithm>
+#include<cstddef>
+#include<cstdint>
+#include<string>
+#include<unordered_set>
+#include<vector>
+
+#include"ast.h"
+#include"ast_visitor.h"
+#include"interner.h"
+#include"sema.h"
+
+namespace tua{
+
+BuiltinTypes builtin_types(){
+    auto& interner=Interner::global();
+    return BuiltinTypes{
+        interner.intern("int"),
+        interner.intern("double"),
+        interner.intern("bool"),
+        interner.intern("str"),
+        interner.intern("fn")};
+}
+
+namespace {
+
+const char* operator_text(NodeKind kind){
+    switch(kind){
+        case NodeKind::Add: return "+";
+        case NodeKind::Sub: return "-";
+        case NodeKind::Mul: return "*";
+        case NodeKind::Div: return "/";
+        case NodeKind::Less: return "<";
+        case NodeKind::Great: return ">";
+        case NodeKind::LessEq: return "<=";
+        case NodeKind::GreatEq: return ">=";
+        case NodeKind::BitOr: return "|";
+        case NodeKind::BitAnd: return "&";
+        case NodeKind::RShift: return ">>";
+        default: return "<<";
+    }
+}
+
+class TypeChecker:public AstVisitor<TypeChecker,Type>{
+    public:
+        TypeChecker():types(builtin_types()),float_type(Interner::global().intern("float")),depth(0){}
+
+        std::vector<Error*> check(Program& program){
+            // top level names are globals, found when the code runs, every
+            // fun body sees all of them
+            for(auto stmt:program.stmts){
+                if(auto cls=node_cast<ClassStmt>(stmt)) classes.insert(cls->ident_->ident_);
+            }
+            for(auto stmt:program.stmts){
+                if(auto fct=node_cast<FctDecl>(stmt)) declare(fct);
+            }
+            std::vector<FctDecl*> bodies;
+            for(auto stmt:program.stmts){
+                if(auto fct=node_cast<FctDecl>(stmt)) bodies.push_back(fct);
+                else dispatch(stmt);
+            }
+            for(auto fct:bodies) body(fct);
+            return std::move(errors);
+        }
+
+        Type visit(Block* block){
+            open();
+            for(auto stmt:block->stmts) dispatch(stmt);
+            close();
+            return NoIdent;
+        }
+
+        Type visit(ClassStmt* cls){
+            classes.insert(cls->ident_->ident_);
+            if(cls->parent_ && !classes.count(cls->parent_)){
+                fail("class "+std::string(ident_name(cls->ident_->ident_))+" : unknown class "+std::string(ident_name(cls->parent_)));
+            }
+            return visit(cls->block_);
+        }
+
+        Type visit(FctDecl* fct){
+            declare(fct);
+            body(fct);
+            return NoIdent;
+        }
+
+        Type visit(VarDeclInit* var){
+            auto declared=resolve(var->type_);
+            if(var->value_){
+                auto value=dispatch(var->value_);
+                if(mismatch(declared,value)){
+                    fail("let "+std::string(ident_name(var->ident_->ident_))+" : declared "+name(declared)+", given "+name(value));
+                }
+            }
+            scope.push_back(Binding{var->ident_->ident_,declared,nullptr,depth});
+            return NoIdent;
+        }
+
+        Type visit(IfElse* ifelse){
+            dispatch(ifelse->condition_);
+            visit(ifelse->if_);
+            if(ifelse->else_) visit(ifelse->else_);
+            return NoIdent;
+        }
+
+        Type visit(WhileStmt* loop){
+            dispatch(loop->condition_);
+            return visit(loop->block_);
+        }
+
+        Type visit(Return* ret){
+            auto value=dispatch(ret->value_);
+            if(mismatch(fct_ret,value)){
+                fail("return : declared "+name(fct_ret)+", given "+name(value));
+            }
+            return NoIdent;
+        }
+
+        // operator chains are as long as the source, see walk_operators()
+        Type visit(BinExpr* node){return chain(node);}
+        Type visit(UnaryExpr* node){return chain(node);}
+
+        Type visit(Int* node){return typed(node,types.int_type);}
+        Type visit(Double* node){return typed(node,types.double_type);}
+        Type visit(Str* node){return typed(node,types.str_type);}
+        Type visit(Bool* node){return typed(node,types.bool_type);}
+
+        Type visit(Symbol* node){
+            auto binding=find(node->ident_);
+            return typed(node,binding?binding->type:NoIdent);
+        }
+
+        Type visit(Assign* assign){
+            auto value=dispatch(assign->value_);
+            auto binding=find(assign->ident_);
+            if(!binding) return typed(assign,value);
+            if(mismatch(binding->type,value)){
+                fail(std::string(ident_name(assign->ident_))+" : declared "+name(binding->type)+", given "+name(value));
+            }
+            return typed(assign,binding->type);
+        }
+
+        Type visit(FctCall* call){
+            auto callee=dispatch(call->expr_);
+            std::vector<Type> args;
+            for(auto arg:call->exprs_) args.push_back(dispatch(arg));
+            auto symbol=node_cast<Symbol>(call->expr_);
+            auto binding=symbol?find(symbol->ident_):nullptr;
+            if(!binding || !binding->fct){
+                if(callee && callee!=types.fn_type) fail("can't call a "+name(callee));
+                return typed(call,NoIdent);
+            }
+            auto fct=binding->fct;
+            auto callee_name=std::string(ident_name(fct->ident_->ident_));
+            if(args.size()!=fct->params_.size()){
+                fail(callee_name+" takes "+std::to_string(fct->params_.size())+" arguments, got "+std::to_string(args.size()));
+                return typed(call,fct->ret_type_);
+            }
+            for(std::size_t i=0;i<args.size();i++){
+                auto& [param,type]=fct->params_[i];
+                if(mismatch(type,args[i])){
+                    fail("argument "+std::string(ident_name(param))+" of "+callee_name+" : declared "+name(type)+", given "+name(args[i]));
+                }
+            }
+            return typed(call,fct->ret_type_);
+        }
+
+        Type visit(FctExpr* fct){
+            for(auto& [param,type]:fct->params_) resolve(type);
+            resolve(fct->ret_type);
+            auto block=fct->body();
+            if(!block){
+                errors.push_back(block.error());
+                return typed(fct,types.fn_type);
+            }
+            function(NoIdent,fct->ret_type,fct->params_,block.value());
+            return typed(fct,types.fn_type);
+        }
+
+    private:
+        Type chain(Expr* expr){
+            std::vector<Type> values;
+            walk_operators(expr,[&](Expr* operand){
+                        values.push_back(dispatch(operand));
+                        return true;
+                    },[&](Expr* op){
+                        if(is_binary(op->kind)){
+                            auto right=values.back();
+                            values.pop_back();
+                            values.back()=binary(static_cast<BinExpr*>(op),values.back(),right);
+                        }else{
+                            values.back()=unary(static_cast<UnaryExpr*>(op),values.back());
+                        }
+                        return true;
+                    });
+            return values.back();
+        }
+
+        Type binary(BinExpr* node,Type left,Type right){
+            auto op=std::string(operator_text(node->kind));
+            auto known=left && right;
+            auto ints=left==types.int_type && right==types.int_type;
+            auto numbers=number(left) && number(right);
+            auto strings=left==types.str_type && right==types.str_type;
+            switch(node->kind){
+                case NodeKind::Equality:
+                case NodeKind::NotEq: return typed(node,types.bool_type);
+                case NodeKind::Less:
+                case NodeKind::Great:
+                case NodeKind::LessEq:
+                case NodeKind::GreatEq:
+                    if(known && !numbers && !strings) operands(op,"numbers or strings",left,right);
+                    return typed(node,types.bool_type);
+                case NodeKind::BitOr:
+                case NodeKind::BitAnd:
+                case NodeKind::RShift:
+                case NodeKind::LShift:
+                    if((left && left!=types.int_type) || (right && right!=types.int_type)){
+                        operands(op,"ints",left,right);
+                        return typed(node,NoIdent);
+                    }
+                    return typed(node,types.int_type);
+                default:
+                    if(!known) return typed(node,NoIdent);
+                    if(ints) return typed(node,types.int_type);
+                    if(numbers) return typed(node,types.double_type);
+                    if(strings && node->kind==NodeKind::Add) return typed(node,types.str_type);
+                    operands(op,node->kind==NodeKind::Add?"numbers or strings":"numbers",left,right);
+                    return typed(node,NoIdent);
+            }
+        }
+
+        Type unary(UnaryExpr* node,Type value){
+            switch(node->kind){
+                case NodeKind::Negate: return typed(node,types.bool_type);
+                case NodeKind::Minus:
+                    if(value && !number(value)){
+                        fail("operand of - must be a number, got "+name(value));
+                        return typed(node,NoIdent);
+                    }
+                    return typed(node,value);
+                default: return typed(node,value);
+            }
+        }
+
+        struct Binding{
+            IdentId name;
+            Type type;
+            // the fun declaring name, calls to it are checked
+            FctDecl* fct;
+            std::uint32_t depth;
+        };
+
+        bool number(Type type) const {return type==types.int_type || type==types.double_type;}
+        // both known and not the same
+        bool mismatch(Type declared,Type value) const {return declared && value && declared!=value;}
+
+        std::string name(Type type) const {return type?std::string(ident_name(type)):"unknown";}
+
+        Type typed(Expr* node,Type type){
+            node->type=type;
+            return type;
+        }
+
+        // type as a builtin or a class name, NoIdent when it is neither
+        Type resolve(Type& type){
+            if(type==float_type) type=types.double_type;
+            if(!type || type==types.int_type || type==types.double_type || type==types.bool_type ||
+                    type==types.str_type || type==types.fn_type || classes.count(type)) return type;
+            fail("unknown type "+name(type));
+            return NoIdent;
+        }
+
+        const Binding* find(IdentId name) const {
+            for(auto binding=scope.rbegin();binding!=scope.rend();binding++){
+                if(binding->name==name) return &*binding;
+            }
+            return nullptr;
+        }
+
+        void open(){depth++;}
+        void close(){
+            depth--;
+            while(!scope.empty() && scope.back().depth>depth) scope.pop_back();
+        }
+
+        void declare(FctDecl* fct){
+            for(auto& [param,type]:fct->params_) resolve(type);
+            resolve(fct->ret_type_);
+            scope.push_back(Binding{fct->ident_->ident_,types.fn_type,fct,depth});
+        }
+
+        void body(FctDecl* fct){
+            auto block=fct->body();
+            if(!block){
+                errors.push_back(block.error());
+                return;
+            }
+            function(fct->ident_->ident_,fct->ret_type_,fct->params_,block.value());
+        }
+
+        void function(IdentId fct,Type ret,const Params& params,Block* block){
+            auto enclosing=fct_name;
+            auto enclosing_ret=fct_ret;
+            fct_name=fct;
+            fct_ret=ret;
+            open();
+            for(auto& [param,type]:params) scope.push_back(Binding{param,type,nullptr,depth});
+            for(auto stmt:block->stmts) dispatch(stmt);
+            close();
+            fct_name=enclosing;
+            fct_ret=enclosing_ret;
+        }
+
+        void operands(const std::string& op,const char* expected,Type left,Type right){
+            fail("operands of "+op+" must be "+expected+", got "+name(left)+" and "+name(right));
+        }
+
+        void fail(std::string&& msg){
+            if(fct_name) msg+=" in "+std::string(ident_name(fct_name));
+            errors.push_back(new TypeError(std::move(msg)));
+        }
+
+        const BuiltinTypes types;
+        Type float_type;
+        std::unordered_set<Type> classes;
+        std::vector<Binding> scope;
+        std::uint32_t depth;
+        // the function being checked, NoIdent at the top level and in lambdas
+        IdentId fct_name=NoIdent;
+        // its return type, NoIdent at the top level
+        Type fct_ret=NoIdent;
+        std::vector<Error*> errors;
+};
+
+
+class Resolver:public AstVisitor<Resolver>{
+    public:
+        Resolver(Program& program):program(program),state(nullptr){}
+
+        std::vector<Error*> resolve(){
+            for(auto stmt:program.stmts){
+                if(auto name=global_name(stmt)) globals.insert(name);
+            }
+            FunctionState script(nullptr,NoIdent);
+            state=&script;
+            for(auto stmt:program.stmts){
+                dispatch(stmt);
+                if(auto name=global_name(stmt)) defined.insert(name);
+            }
+            program.captured.assign(script.captured.begin(),script.captured.end());
+
+            for(auto& read:reads){
+                auto name=std::string(ident_name(read.name));
+                std::string msg;
+                if(!globals.count(read.name) && !assigned.count(read.name)){
+                    msg=name+(read.declared_after?" used before its declaration":" isn't declared");
+                }else if(read.top_level && !read.defined && !assigned.count(read.name)){
+                    msg=name+" used before its declaration";
+                }else{
+                    continue;
+                }
+                if(read.fct) msg+=" in "+std::string(ident_name(read.fct));
+                errors.push_back(new ResolveError(std::move(msg)));
+            }
+            return std::move(errors);
+        }
+
+        void visit(Block* block){
+            open();
+            for(auto stmt:block->stmts) dispatch(stmt);
+            close();
+        }
+
+        void visit(ClassStmt* cls){visit(cls->block_);}
+
+        void visit(FctDecl* fct){
+            auto name=fct->ident_->ident_;
+            // visible to its own body as a slot, the body knows it as Self
+            if(state->depth) declare(name);
+            auto block=fct->body();
+            if(!block){
+                errors.push_back(block.error());
+                return;
+            }
+            function(name,fct->params_,block.value(),fct->captured_);
+        }
+
+        void visit(VarDeclInit* var){
+            if(var->value_) dispatch(var->value_);
+            if(state->depth) declare(var->ident_->ident_);
+        }
+
+        void visit(IfElse* ifelse){
+            dispatch(ifelse->condition_);
+            visit(ifelse->if_);
+            if(ifelse->else_) visit(ifelse->else_);
+        }
+
+        void visit(WhileStmt* loop){
+            dispatch(loop->condition_);
+            visit(loop->block_);
+        }
+
+        void visit(Return* ret){dispatch(ret->value_);}
+        void visit(BinExpr* node){operands(node);}
+        void visit(UnaryExpr* node){operands(node);}
+        void visit(Expr*){}
+
+        void visit(Symbol* symbol){
+            symbol->resolved=find(*state,symbol->ident_);
+            if(symbol->resolved.scope!=Scope::Global) return;
+            state->pending.push_back(Pending{symbol->ident_,state->depth,reads.size()});
+            reads.push_back(Read{symbol->ident_,state->name,!state->enclosing,defined.count(symbol->ident_)>0,false});
+        }
+
+        void visit(Assign* assign){
+            dispatch(assign->value_);
+            assign->resolved=find(*state,assign->ident_);
+            if(assign->resolved.scope==Scope::Global) assigned.insert(assign->ident_);
+        }
+
+        void visit(FctCall* call){
+            dispatch(call->expr_);
+            for(auto arg:call->exprs_) dispatch(arg);
+        }
+
+        void visit(FctExpr* fct){
+            auto block=fct->body();
+            if(!block){
+                errors.push_back(block.error());
+                return;
+            }
+            function(NoIdent,fct->params_,block.value(),fct->captured_);
+        }
+
+    private:
+        // the leaves of an operator chain, without recursing into it
+        void operands(Expr* expr){
+            walk_operators(expr,[&](Expr* operand){
+                        dispatch(operand);
+                        return true;
+                    },[](Expr*){return true;});
+        }
+
+        struct Local{
+            IdentId name;
+            std::uint32_t depth;
+            std::uint16_t slot;
+        };
+
+        // a global read in a scope still open, depth is the innermost
+        // of them
+        struct Pending{
+            IdentId name;
+            std::uint32_t depth;
+            std::size_t read;
+        };
+
+        struct FunctionState{
+            FunctionState(FunctionState* enclosing,IdentId name):enclosing(enclosing),name(name),depth(0){}
+            FunctionState* enclosing;
+            // what the function calls itself by, NoIdent for lambdas
+            IdentId name;
+            std::vector<Local> locals;
+            std::uint32_t depth;
+            std::vector<std::uint16_t> captured;
+            std::vector<Pending> pending;
+        };
+
+        struct Read{
+            IdentId name;
+            // the function reading it
+            IdentId fct;
+            // run in the order of the top level statements
+            bool top_level;
+            // a top level statement before made it a global
+            bool defined;
+            // a local of the same name is declared after it in a scope
+            // around it
+            bool declared_after;
+        };
+
+        static IdentId global_name(Stmt* stmt){
+            if(auto var=node_cast<VarDeclInit>(stmt)) return var->ident_->ident_;
+            if(auto fct=node_cast<FctDecl>(stmt)) return fct->ident_->ident_;
+            if(auto cls=node_cast<ClassStmt>(stmt)) return cls->ident_->ident_;
+            return NoIdent;
+        }
+
+        void open(){state->depth++;}
+
+        // the slots of the locals going out of scope are used again
+        void close(){
+            auto& in=*state;
+            in.depth--;
+            while(!in.locals.empty() && in.locals.back().depth>in.depth) in.locals.pop_back();
+            for(auto& pending:in.pending){
+                if(pending.depth>in.depth) pending.depth=in.depth;
+            }
+        }
+
+        void declare(IdentId name){
+            auto& in=*state;
+            in.locals.push_back(Local{name,in.depth,static_cast<std::uint16_t>(in.locals.size())});
+            for(auto& pending:in.pending){
+                if(pending.name==name && pending.depth>=in.depth) reads[pending.read].declared_after=true;
+            }
+        }
+
+        static const Local* find_local(const FunctionState& in,IdentId name){
+            for(auto local=in.locals.rbegin();local!=in.locals.rend();local++){
+                if(local->name==name) return &*local;
+            }
+            return nullptr;
+        }
+
+        // the same order as the compiler: locals, the function itself, then
+        // the functions around it out to the globals
+        Resolution find(FunctionState& in,IdentId name){
+            std::uint16_t depth=0;
+            for(auto fct=&in;fct;fct=fct->enclosing,depth++){
+                if(auto local=find_local(*fct,name)){
+                    if(depth){
+                        auto& captured=fct->captured;
+                        if(std::find(captured.begin(),captured.end(),local->slot)==captured.end()) captured.push_back(local->slot);
+                        return Resolution{Scope::Capture,depth,local->slot};
+                    }
+                    return Resolution{Scope::Local,0,local->slot};
+                }
+                if(fct->name==name) return Resolution{Scope::Self,depth,0};
+            }
+            return Resolution{Scope::Global,0,0};
+        }
+
+        void function(IdentId name,const Params& params,Block* block,Slots& captured){
+            FunctionState fct(state,name);
+            fct.depth=1;
+            state=&fct;
+            for(auto& [param,type]:params) declare(param);
+            for(auto stmt:block->stmts) dispatch(stmt);
+            state=fct.enclosing;
+            captured.assign(fct.captured.begin(),fct.captured.end());
+        }
+
+        Program& program;
+        FunctionState* state;
+        // declared by a top level let, fun or class
+        std::unordered_set<IdentId> globals;
+        // the ones of them the top level statements walked so far declare
+        std::unordered_set<IdentId> defined;
+        // assigned without a let anywhere, such a global exists once the
+        // assignment runs
+        std::unordered_set<IdentId> assigned;
+        std::vector<Read> reads;
+        std::vector<Error*> errors;
+};
+
+};
+
+std::vector<Error*> check_types(Program& program){
+    return TypeChecker().check(program);
+}
+
+std::vector<Error*> resolve(Program& program){
+    return Resolver(program).resolve();
+}
+
+};
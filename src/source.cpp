@@ -0,0 +1,135 @@
+#include<fstream>
+#include<optional>
+#include<string>
+#include<string_view>
+#include<utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+#include"source.h"
+
+namespace tua{
+    namespace {
+        std::optional<std::string> read_file(std::string_view path){
+            std::ifstream file(std::string(path),std::ios::binary|std::ios::ate);
+            if(!file.is_open()){
+                return std::nullopt;
+            }
+            std::string text(static_cast<std::size_t>(file.tellg()),'\0');
+            file.seekg(0);
+            file.read(text.data(),text.size());
+            return text;
+        }
+
+#ifdef _WIN32
+        std::size_t page_size(){
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwPageSize;
+        }
+
+        // nullptr when the file can't be mapped with a sentinel after its end
+        const char* map_view(std::string_view path,std::size_t& size){
+            HANDLE file=CreateFileA(std::string(path).c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+            if(file==INVALID_HANDLE_VALUE) return nullptr;
+            LARGE_INTEGER file_size;
+            const char* view=nullptr;
+            if(GetFileSizeEx(file,&file_size) && file_size.QuadPart>0 && file_size.QuadPart%page_size()!=0){
+                HANDLE mapping=CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+                if(mapping){
+                    view=static_cast<const char*>(MapViewOfFile(mapping,FILE_MAP_READ,0,0,0));
+                    CloseHandle(mapping);
+                    size=static_cast<std::size_t>(file_size.QuadPart);
+                }
+            }
+            CloseHandle(file);
+            return view;
+        }
+
+        void unmap_view(const char* view,std::size_t){
+            UnmapViewOfFile(view);
+        }
+#else
+        std::size_t page_size(){
+            return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        }
+
+        // nullptr when the file can't be mapped with a sentinel after its end
+        const char* map_view(std::string_view path,std::size_t& size){
+            int fd=open(std::string(path).c_str(),O_RDONLY);
+            if(fd<0) return nullptr;
+            struct stat info;
+            const char* view=nullptr;
+            if(fstat(fd,&info)==0 && info.st_size>0 && static_cast<std::size_t>(info.st_size)%page_size()!=0){
+                void* addr=mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+                if(addr!=MAP_FAILED){
+                    view=static_cast<const char*>(addr);
+                    size=static_cast<std::size_t>(info.st_size);
+                }
+            }
+            close(fd);
+            return view;
+        }
+
+        void unmap_view(const char* view,std::size_t size){
+            munmap(const_cast<char*>(view),size);
+        }
+#endif
+    };
+
+    Source::Source(Source&& other) noexcept:
+        owned(std::move(other.owned)),
+        mapped(std::exchange(other.mapped,nullptr)),
+        mapped_size(std::exchange(other.mapped_size,0)){}
+
+    Source& Source::operator=(Source&& other) noexcept{
+        if(this!=&other){
+            unmap();
+            owned=std::move(other.owned);
+            mapped=std::exchange(other.mapped,nullptr);
+            mapped_size=std::exchange(other.mapped_size,0);
+        }
+        return *this;
+    }
+
+    Source::~Source(){
+        unmap();
+    }
+
+    void Source::unmap() noexcept{
+        if(mapped){
+            unmap_view(mapped,mapped_size);
+            mapped=nullptr;
+            mapped_size=0;
+        }
+    }
+
+    std::optional<Source> Source::map_file(std::string_view path){
+        Source source;
+        source.mapped=map_view(path,source.mapped_size);
+        if(source.mapped){
+            return source;
+        }
+        auto text=read_file(path);
+        if(!text){
+            return std::nullopt;
+        }
+        return Source(std::move(text.value()));
+    }
+
+    std::string_view Source::text() const noexcept{
+        if(mapped){
+            return std::string_view(mapped,mapped_size);
+        }
+        return owned;
+    }
+};
@@ -0,0 +1,92 @@
+#include<algorithm>
+#include<istream>
+#include<string>
+#include<string_view>
+
+#include"lexer.h"
+#include"scan.h"
+#include"stream_lexer.h"
+
+namespace tua{
+
+    StreamLexer::StreamLexer(std::istream& input,std::size_t chunk_size):
+        input(input),chunk_size(chunk_size),base(0),base_line(0),pos(0),token_end(0),released(0),lexer(Lexer::view(std::string_view())),in_comment(false),eof(false){}
+
+    bool StreamLexer::refill(){
+        if(eof) return false;
+        // once every token is released the spaces and comments skipped since
+        // the last one can go as well
+        auto keep=released==token_end?pos:released;
+        if(keep>base){
+            auto drop=keep-base;
+            base_line+=std::count(window.begin(),window.begin()+drop,'\n');
+            window.erase(0,drop);
+            base=keep;
+        }
+        auto size=window.size();
+        window.resize(size+chunk_size);
+        input.read(window.data()+size,chunk_size);
+        auto read=static_cast<std::size_t>(input.gcount());
+        window.resize(size+read);
+        if(!input) eof=true;
+        return read>0;
+    }
+
+    void StreamLexer::release(std::uint32_t offset) noexcept{
+        released=std::max(released,std::min(offset,pos));
+    }
+
+    std::string_view StreamLexer::text(std::uint32_t offset,std::uint32_t length) const noexcept{
+        return std::string_view(window).substr(offset-base,length);
+    }
+
+    std::uint32_t StreamLexer::line_of(std::uint32_t offset) const noexcept{
+        return base_line+std::count(window.begin(),window.begin()+(offset-base),'\n');
+    }
+
+    const Token StreamLexer::get_token(){
+        auto eof_token=[this]{
+            return Token(TokenKind::Eof,pos);
+        };
+        while(true){
+            const char* begin=window.data();
+            const char* end=begin+window.size();
+            const char* p=begin+(pos-base);
+            if(in_comment){
+                p=scan::find_byte(p,end,'\n');
+                pos=base+(p-begin);
+                if(p==end){
+                    if(refill()) continue;
+                    return eof_token();
+                }
+                in_comment=false;
+            }
+            p=scan::skip_space(p,end);
+            pos=base+(p-begin);
+            if(p==end){
+                if(refill()) continue;
+                return eof_token();
+            }
+            if(*p=='/'){
+                // a '/' ending the window may start a comment
+                if(p+1==end && refill()) continue;
+                if(p+1!=end && p[1]=='/'){
+                    in_comment=true;
+                    pos+=2;
+                    continue;
+                }
+            }
+
+            lexer.src=window;
+            lexer.pos=p-begin;
+            auto token=lexer.get_token();
+            // the token may go on in the next chunk
+            if(lexer.pos==window.size() && refill()) continue;
+
+            pos=base+lexer.pos;
+            token_end=pos;
+            token.offset+=base;
+            return token;
+        }
+    }
+};
@@ -0,0 +1,67 @@
+#include<functional>
+#include<mutex>
+#include<thread>
+
+#include"thread_pool.h"
+
+namespace tua{
+
+    ThreadPool::ThreadPool(unsigned threads){
+        for(unsigned i=1;i<threads;i++){
+            workers.emplace_back([this]{work();});
+        }
+    }
+
+    ThreadPool::~ThreadPool(){
+        {
+            std::lock_guard lock(mutex);
+            stop=true;
+        }
+        wake.notify_all();
+        for(auto& worker:workers){
+            worker.join();
+        }
+    }
+
+    void ThreadPool::run_tasks(){
+        for(auto i=next++;i<count;i=next++){
+            (*task)(i);
+        }
+    }
+
+    void ThreadPool::work(){
+        std::size_t seen=0;
+        while(true){
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock,[&]{return stop || generation!=seen;});
+                if(stop) return;
+                seen=generation;
+            }
+            run_tasks();
+            {
+                std::lock_guard lock(mutex);
+                finished++;
+            }
+            done.notify_all();
+        }
+    }
+
+    void ThreadPool::parallel_for(std::size_t count,const std::function<void(std::size_t)>& task){
+        {
+            std::lock_guard lock(mutex);
+            this->task=&task;
+            this->count=count;
+            next=0;
+            finished=0;
+            generation++;
+        }
+        wake.notify_all();
+        run_tasks();
+        // every worker goes through the job once, so none of them can pick
+        // it up after it returned
+        std::unique_lock lock(mutex);
+        done.wait(lock,[&]{return finished==workers.size();});
+        this->task=nullptr;
+    }
+};
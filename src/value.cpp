@@ -0,0 +1,45 @@
+#include<charconv>
+#include<string>
+
+#include"bytecode.h"
+#include"interner.h"
+#include"value.h"
+
+namespace tua{
+
+    bool operator==(const Value& left,const Value& right) noexcept{
+        if(left.kind!=right.kind){
+            if(left.kind==ValueKind::Int && right.kind==ValueKind::Double) return static_cast<double>(left.i)==right.d;
+            if(left.kind==ValueKind::Double && right.kind==ValueKind::Int) return left.d==static_cast<double>(right.i);
+            return false;
+        }
+        switch(left.kind){
+            case ValueKind::Bool: return left.b==right.b;
+            case ValueKind::Int: return left.i==right.i;
+            case ValueKind::Double: return left.d==right.d;
+            case ValueKind::Str: return left.str()==right.str();
+            case ValueKind::Fct: return left.obj==right.obj;
+            default: return true;
+        }
+    }
+
+    std::string to_string(const Value& value){
+        switch(value.kind){
+            case ValueKind::Nil: return "nil";
+            case ValueKind::Bool: return value.b?"true":"false";
+            case ValueKind::Int: return std::to_string(value.i);
+            case ValueKind::Double:{
+                                       // shortest text that reads back the same
+                                       char text[32];
+                                       auto end=std::to_chars(text,text+sizeof(text),value.d).ptr;
+                                       return std::string(text,end);
+                                   }
+            case ValueKind::Str: return std::string(value.str());
+            case ValueKind::Fct:{
+                                    auto name=value.closure()->fct->name;
+                                    return name?"<fun "+std::string(ident_name(name))+">":"<lambda>";
+                                }
+            default: return "undefined";
+        }
+    }
+};
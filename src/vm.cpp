@@ -0,0 +1,355 @@
+#include<algorithm>
+#include<cstdint>
+#include<expected>
+#include<string>
+
+#include"bytecode.h"
+#include"error.h"
+#include"interner.h"
+#include"value.h"
+#include"vm.h"
+
+// dispatch jumps through a table of label addresses where the compiler
+// has them, define it to 0 for the portable switch
+#ifndef TUA_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define TUA_COMPUTED_GOTO 1
+#else
+#define TUA_COMPUTED_GOTO 0
+#endif
+#endif
+
+namespace tua{
+
+static constexpr std::size_t MIN_COLLECT=1<<20;
+
+static bool is_number(const Value& value) noexcept {
+    return value.kind==ValueKind::Int || value.kind==ValueKind::Double;
+}
+
+static double as_double(const Value& value) noexcept {
+    return value.kind==ValueKind::Int?static_cast<double>(value.i):value.d;
+}
+
+// int arithmetic wraps around
+static std::int64_t wrap(std::uint64_t value) noexcept {return static_cast<std::int64_t>(value);}
+
+static std::size_t size_of(const Obj* obj) noexcept {
+    if(obj->kind==ObjKind::Str){
+        return sizeof(StrObj)+static_cast<const StrObj*>(obj)->value.capacity();
+    }
+    return sizeof(ClosureObj)+static_cast<const ClosureObj*>(obj)->captures.capacity()*sizeof(Value);
+}
+
+static std::unexpected<Error*> runtime_error(const Function* fct,std::string&& message){
+    if(fct->name){
+        message+=" in "+std::string(ident_name(fct->name));
+    }
+    return std::unexpected<Error*>(new RuntimeError(std::move(message)));
+}
+
+VM::VM():stack(std::make_unique<Value[]>(STACK_SIZE)),frames(std::make_unique<Frame[]>(MAX_FRAMES)),objects(nullptr),allocated(0),next_collect(MIN_COLLECT){}
+
+VM::~VM(){
+    free_objects();
+}
+
+void VM::free_objects(){
+    while(objects){
+        auto obj=objects;
+        objects=obj->next;
+        if(obj->kind==ObjKind::Str) delete static_cast<StrObj*>(obj);
+        else delete static_cast<ClosureObj*>(obj);
+    }
+    allocated=0;
+    next_collect=MIN_COLLECT;
+}
+
+StrObj* VM::new_str(std::string&& value,Value* top){
+    auto str=new StrObj(std::move(value));
+    track(str,size_of(str),top);
+    return str;
+}
+
+ClosureObj* VM::new_closure(const Function* fct,Value* top){
+    auto closure=new ClosureObj(fct);
+    closure->captures.resize(fct->captures);
+    track(closure,size_of(closure),top);
+    return closure;
+}
+
+// obj isn't linked yet, a collection here leaves it alone
+void VM::track(Obj* obj,std::size_t size,Value* top){
+    allocated+=size;
+    if(allocated>next_collect){
+        collect(top);
+    }
+    obj->next=objects;
+    objects=obj;
+}
+
+void VM::collect(Value* top){
+    // literals of the Module are made marked and never swept
+    auto mark=[this](const Value& value){
+        if((value.kind==ValueKind::Str || value.kind==ValueKind::Fct) && !value.obj->marked){
+            value.obj->marked=true;
+            gray.push_back(value.obj);
+        }
+    };
+    for(auto value=stack.get();value<top;value++){
+        mark(*value);
+    }
+    for(auto& value:globals){
+        mark(value);
+    }
+    while(!gray.empty()){
+        auto obj=gray.back();
+        gray.pop_back();
+        if(obj->kind==ObjKind::Closure){
+            for(auto& value:static_cast<ClosureObj*>(obj)->captures) mark(value);
+        }
+    }
+
+    auto link=&objects;
+    while(auto obj=*link){
+        if(obj->marked){
+            obj->marked=false;
+            link=&obj->next;
+            continue;
+        }
+        *link=obj->next;
+        allocated-=size_of(obj);
+        if(obj->kind==ObjKind::Str) delete static_cast<StrObj*>(obj);
+        else delete static_cast<ClosureObj*>(obj);
+    }
+    next_collect=std::max(MIN_COLLECT,allocated*2);
+}
+
+std::expected<Value,Error*> VM::run(const Module& module){
+    free_objects();
+    globals.assign(module.globals.size(),Value::undefined());
+    auto stack_end=stack.get()+STACK_SIZE;
+    auto frames_end=frames.get()+MAX_FRAMES;
+
+    Value* sp=stack.get();
+    Frame* frame=frames.get();
+    auto script=new_closure(module.functions[0].get(),sp);
+    *sp++=Value(script);
+    frame->closure=script;
+    Value* base=sp;
+    frame->base=base;
+    const Function* fct=script->fct;
+    if(base+fct->slots+fct->max_stack>stack_end){
+        return std::unexpected(new RuntimeError("stack overflow"));
+    }
+    for(std::size_t i=0;i<fct->slots;i++) *sp++=Value();
+    const std::uint8_t* ip=fct->code.data();
+    const Value* constants=fct->constants.data();
+
+    auto error=[&](std::string&& message){
+        return runtime_error(frame->closure->fct,std::move(message));
+    };
+    auto read16=[&]{
+        ip+=2;
+        return static_cast<std::uint16_t>(ip[-2]|ip[-1]<<8);
+    };
+
+#if TUA_COMPUTED_GOTO
+    #define TUA_OPCODE_LABEL(name) &&op_##name,
+    static void* const labels[OPCODE_COUNT]={TUA_OPCODES(TUA_OPCODE_LABEL)};
+    #undef TUA_OPCODE_LABEL
+    #define CASE(name) op_##name
+    #define NEXT() goto *labels[*ip++]
+    NEXT();
+#else
+    #define CASE(name) case OpCode::name
+    #define NEXT() continue
+    while(true) switch(static_cast<OpCode>(*ip++)){
+#endif
+
+    // ints stay ints, an int with a double gives a double
+    #define ARITH(int_value,op) { \
+        auto& a=sp[-2]; \
+        auto& b=sp[-1]; \
+        if(a.kind==ValueKind::Int && b.kind==ValueKind::Int) a.i=int_value; \
+        else if(is_number(a) && is_number(b)) a=Value(as_double(a) op as_double(b)); \
+        else return error("operands of "#op" must be numbers"); \
+        sp--; \
+        NEXT(); \
+    }
+    #define COMPARE(op) { \
+        auto& a=sp[-2]; \
+        auto& b=sp[-1]; \
+        if(a.kind==ValueKind::Int && b.kind==ValueKind::Int) a=Value(a.i op b.i); \
+        else if(is_number(a) && is_number(b)) a=Value(as_double(a) op as_double(b)); \
+        else if(a.kind==ValueKind::Str && b.kind==ValueKind::Str) a=Value(a.str() op b.str()); \
+        else return error("operands of "#op" must be numbers or strings"); \
+        sp--; \
+        NEXT(); \
+    }
+    #define BITWISE(int_value,op) { \
+        auto& a=sp[-2]; \
+        auto& b=sp[-1]; \
+        if(a.kind!=ValueKind::Int || b.kind!=ValueKind::Int) return error("operands of "#op" must be ints"); \
+        a.i=int_value; \
+        sp--; \
+        NEXT(); \
+    }
+
+    CASE(Const): *sp++=constants[read16()]; NEXT();
+    CASE(Nil): *sp++=Value(); NEXT();
+    CASE(True): *sp++=Value(true); NEXT();
+    CASE(False): *sp++=Value(false); NEXT();
+    CASE(Pop): sp--; NEXT();
+
+    CASE(GetLocal): *sp++=base[*ip++]; NEXT();
+    CASE(SetLocal): base[*ip++]=sp[-1]; NEXT();
+    CASE(StoreLocal): base[*ip++]=*--sp; NEXT();
+    CASE(GetCapture): *sp++=frame->closure->captures[*ip++]; NEXT();
+    CASE(SetCapture): frame->closure->captures[*ip++]=sp[-1]; NEXT();
+    CASE(StoreCapture): frame->closure->captures[*ip++]=*--sp; NEXT();
+    CASE(GetGlobal):{
+                        auto slot=read16();
+                        if(globals[slot].kind==ValueKind::Undefined){
+                            return error(std::string(ident_name(module.globals[slot]))+" isn't defined");
+                        }
+                        *sp++=globals[slot];
+                        NEXT();
+                    }
+    CASE(SetGlobal): globals[read16()]=sp[-1]; NEXT();
+    CASE(StoreGlobal): globals[read16()]=*--sp; NEXT();
+
+    CASE(Add):{
+                  auto& a=sp[-2];
+                  auto& b=sp[-1];
+                  if(a.kind==ValueKind::Str && b.kind==ValueKind::Str){
+                      std::string text;
+                      text.reserve(a.str().size()+b.str().size());
+                      text+=a.str();
+                      text+=b.str();
+                      // a and b stay on the stack until the new string is made
+                      auto str=new_str(std::move(text),sp);
+                      sp--;
+                      sp[-1]=Value(str);
+                      NEXT();
+                  }
+                  ARITH(wrap(static_cast<std::uint64_t>(a.i)+static_cast<std::uint64_t>(b.i)),+)
+              }
+    CASE(Sub): ARITH(wrap(static_cast<std::uint64_t>(a.i)-static_cast<std::uint64_t>(b.i)),-)
+    CASE(Mul): ARITH(wrap(static_cast<std::uint64_t>(a.i)*static_cast<std::uint64_t>(b.i)),*)
+    CASE(Div):{
+                  auto& b=sp[-1];
+                  if(b.kind==ValueKind::Int && !b.i && sp[-2].kind==ValueKind::Int){
+                      return error("division by zero");
+                  }
+                  // INT64_MIN/-1 wraps like the other operators
+                  ARITH(b.i==-1?wrap(0-static_cast<std::uint64_t>(a.i)):a.i/b.i,/)
+              }
+
+    CASE(Equal): sp[-2]=Value(sp[-2]==sp[-1]); sp--; NEXT();
+    CASE(NotEqual): sp[-2]=Value(!(sp[-2]==sp[-1])); sp--; NEXT();
+    CASE(Less): COMPARE(<)
+    CASE(Greater): COMPARE(>)
+    CASE(LessEqual): COMPARE(<=)
+    CASE(GreaterEqual): COMPARE(>=)
+
+    // shift counts are taken modulo 64
+    CASE(BitOr): BITWISE(a.i|b.i,|)
+    CASE(BitAnd): BITWISE(a.i&b.i,&)
+    CASE(RShift): BITWISE(a.i>>(b.i&63),>>)
+    CASE(LShift): BITWISE(wrap(static_cast<std::uint64_t>(a.i)<<(b.i&63)),<<)
+
+    CASE(Neg):{
+                  auto& a=sp[-1];
+                  if(a.kind==ValueKind::Int) a.i=wrap(0-static_cast<std::uint64_t>(a.i));
+                  else if(a.kind==ValueKind::Double) a.d=-a.d;
+                  else return error("operand of - must be a number");
+                  NEXT();
+              }
+    CASE(Not): sp[-1]=Value(!truthy(sp[-1])); NEXT();
+
+    CASE(Jump):{
+                   auto offset=read16();
+                   ip+=offset;
+                   NEXT();
+               }
+    CASE(JumpIfFalse):{
+                          auto offset=read16();
+                          if(!truthy(*--sp)) ip+=offset;
+                          NEXT();
+                      }
+    CASE(Loop):{
+                   auto offset=read16();
+                   ip-=offset;
+                   NEXT();
+               }
+
+    CASE(Call):{
+                   auto argc=*ip++;
+                   auto& callee=sp[-1-argc];
+                   if(callee.kind!=ValueKind::Fct){
+                       return error("can't call a "+to_string(callee));
+                   }
+                   auto closure=callee.closure();
+                   auto target=closure->fct;
+                   if(argc!=target->arity){
+                       return error(to_string(callee)+" takes "+std::to_string(target->arity)+" arguments, got "+std::to_string(argc));
+                   }
+                   if(target->native && target->native(sp-argc,sp-1-argc,frame-frames.get()+1)){
+                       sp-=argc;
+                       NEXT();
+                   }
+                   if(frame+1==frames_end || sp-argc+target->slots+target->max_stack>stack_end){
+                       return error("stack overflow");
+                   }
+                   frame->ip=ip;
+                   frame++;
+                   frame->closure=closure;
+                   base=sp-argc;
+                   frame->base=base;
+                   for(auto i=argc;i<target->slots;i++) *sp++=Value();
+                   ip=target->code.data();
+                   constants=target->constants.data();
+                   NEXT();
+               }
+    CASE(Closure):{
+                      auto target=module.functions[read16()].get();
+                      auto closure=new_closure(target,sp);
+                      for(auto& capture:closure->captures){
+                          auto from=static_cast<CaptureFrom>(*ip++);
+                          auto index=*ip++;
+                          switch(from){
+                              case CaptureFrom::Local: capture=base[index]; break;
+                              case CaptureFrom::Capture: capture=frame->closure->captures[index]; break;
+                              case CaptureFrom::Itself: capture=Value(closure); break;
+                          }
+                      }
+                      *sp++=Value(closure);
+                      NEXT();
+                  }
+    CASE(Return):{
+                     auto result=sp[-1];
+                     // the callee and its arguments go too
+                     sp=base-1;
+                     if(frame==frames.get()){
+                         return result;
+                     }
+                     frame--;
+                     base=frame->base;
+                     ip=frame->ip;
+                     constants=frame->closure->fct->constants.data();
+                     *sp++=result;
+                     NEXT();
+                 }
+
+#if !TUA_COMPUTED_GOTO
+    }
+#endif
+    #undef ARITH
+    #undef COMPARE
+    #undef BITWISE
+    #undef CASE
+    #undef NEXT
+}
+
+};
@@ -0,0 +1,68 @@
+#include<chrono>
+#include<iostream>
+#include<string>
+
+#include "bytecode.h"
+#include "jit.h"
+#include "lexer.h"
+#include "parser.h"
+#include "vm.h"
+
+using namespace tua;
+
+// runs src rounds times on one VM with and without the native code, the
+// parse and compiles aren't timed
+static bool bench(const char* name,const std::string& src,int rounds=3){
+    auto program=Parser(Lexer(std::string(src))).parse();
+    if(!program){
+        std::cerr<<std::string(*program.error())<<std::endl;
+        return false;
+    }
+    auto module=compile(program.value());
+    if(!module){
+        std::cerr<<std::string(*module.error())<<std::endl;
+        return false;
+    }
+    auto jit=Jit::create();
+    if(!jit){
+        std::cerr<<std::string(*jit.error())<<std::endl;
+        return false;
+    }
+    VM vm;
+    double ns[2]={0,0};
+    std::string result[2];
+    for(int native=0;native<2;native++){
+        if(native){
+            auto start=std::chrono::steady_clock::now();
+            auto compiled=jit->compile(program.value(),module.value());
+            if(!compiled){
+                std::cerr<<std::string(*compiled.error())<<std::endl;
+                return false;
+            }
+            std::cout<<name<<" : jit "<<compiled->size()<<" functions in "
+                <<std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count()<<" ms"<<std::endl;
+        }
+        for(int round=0;round<rounds;round++){
+            auto start=std::chrono::steady_clock::now();
+            auto value=vm.run(module.value());
+            ns[native]+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+            if(!value){
+                std::cerr<<std::string(*value.error())<<std::endl;
+                return false;
+            }
+            result[native]=to_string(value.value());
+        }
+    }
+    std::cout<<name<<" : vm "<<ns[0]/rounds/1e6<<" ms, native "<<ns[1]/rounds/1e6<<" ms"<<std::endl;
+    return result[0]==result[1];
+}
+
+int main(){
+    auto fib=bench("fib(30)",
+            "fun int fib(n:int,){ if(n<2){return n;}; return fib(n-1)+fib(n-2); };\n"
+            "return fib(30);");
+    auto loop=bench("while 10M",
+            "fun int sum(n:int,){ let j:int=0; let acc:int=0; while(j<n){ acc=acc+(j&7)*3-1; j=j+1; }; return acc; };\n"
+            "return sum(10000000);");
+    return fib && loop?0:1;
+}
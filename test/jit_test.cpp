@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "aot.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "lexer.h"
+#include "parser.h"
+#include "error.h"
+#include "jit.h"
+#include "value.h"
+#include "vm.h"
+
+using namespace tua;
+
+// the value the program returns or the text of its error, and the names
+// of the functions the jit compiled
+static std::string run(const std::string& src,std::vector<std::string>* natives=nullptr,bool jit=true){
+    Parser parser{Lexer(std::string(src))};
+    auto program=parser.parse();
+    if(!program){
+        return std::string(*program.error());
+    }
+    auto module=compile(program.value());
+    if(!module){
+        return std::string(*module.error());
+    }
+    auto made=Jit::create();
+    if(!made){
+        return std::string(*made.error());
+    }
+    if(jit){
+        auto compiled=made->compile(program.value(),module.value());
+        if(!compiled){
+            return std::string(*compiled.error());
+        }
+        if(natives){
+            for(auto name:compiled.value()) natives->emplace_back(ident_name(name));
+        }
+    }
+    VM vm;
+    auto value=vm.run(module.value());
+    if(!value){
+        return std::string(*value.error());
+    }
+    return to_string(value.value());
+}
+
+static void same_as_vm(const std::string& src,std::size_t native_count){
+    std::vector<std::string> natives;
+    EXPECT_EQ(run(src,&natives),run(src,nullptr,false))<<src;
+    EXPECT_EQ(natives.size(),native_count)<<src;
+}
+
+TEST(JitTest, Lowered) {
+    same_as_vm("fun int fib(n:int,){ if(n<2){return n;}; return fib(n-1)+fib(n-2); }; return fib(20);",1);
+    same_as_vm("fun int sum(n:int,){ let i:int=0; let s:int=0; while(i<n){ s=s+(i&7)*3-1; i=i+1; }; return s; }; return sum(1000);",1);
+    same_as_vm("fun double half(x:double,){ return x/2; }; fun double twice(x:double,){ return half(x)*4; }; return twice(1.5);",2);
+    same_as_vm("fun bool odd(n:int,){ if(n==0){return false;}; return !odd(n-1); }; return odd(7);",1);
+    same_as_vm("fun int wrap(a:int,b:int,){ return a*b+(a<<b)-(a>>1)/(b|1); }; return wrap(9223372036854775807,65);",1);
+    same_as_vm("fun int quot(a:int,b:int,){ return a/b; }; return quot(-9223372036854775807-1,-1);",1);
+    same_as_vm("fun bool mixed(a:int,b:double,){ return a==b; }; return mixed(2,2.0);",1);
+}
+
+TEST(JitTest, FallsBackToVm) {
+    // the native code stops and the VM reports the error
+    same_as_vm("fun int div(a:int,b:int,){ return a/b; }; return div(1,0);",1);
+    same_as_vm("fun int deep(n:int,){ return deep(n+1); }; return deep(0);",1);
+    same_as_vm("fun int none(n:int,){ if(n>0){return n;}; }; return none(0);",1);
+    // arguments of another type than declared
+    same_as_vm("fun int id(n:int,){ return n; }; return id(\"a\");",1);
+    same_as_vm("fun int id(n:int,){ return n; }; return id(1.5);",1);
+    // not lowered: strings, lambdas, rebound names and what calls them
+    same_as_vm("fun str s(n:int,){ return \"a\"; }; return s(1);",0);
+    same_as_vm("fun int f(n:int,){ let g:fn=lambda int (x:int,){ return x; }; return g(n); }; return f(3);",0);
+    same_as_vm("fun int f(n:int,){ return n; }; fun int g(n:int,){ return f(n)+1; }; f=5; return g(1);",0);
+    same_as_vm("fun str s(){ return \"a\"; }; fun int g(n:int,){ s(); return n; }; return g(2);",0);
+}
+
+TEST(JitTest, FrameLimit) {
+    // d(n) takes n+1 frames above the top level, the last one the VM has
+    // is MAX_FRAMES-1
+    std::string d="fun int d(n:int,){ if(n<1){return 0;}; return d(n-1)+1; }; ";
+    auto at=[&](std::uint32_t n){return d+"return d("+std::to_string(n)+");";};
+    EXPECT_EQ(run(at(MAX_FRAMES-2)),std::to_string(MAX_FRAMES-2));
+    EXPECT_EQ(run(at(MAX_FRAMES-1)),"stack overflow in d");
+    same_as_vm(at(MAX_FRAMES-2),1);
+    same_as_vm(at(MAX_FRAMES-1),1);
+    // the frames the VM already has count, v takes strings so it stays
+    // bytecode
+    auto v="fun int v(n:int,s:str,){ if(n<1){return d(m);}; return v(n-1,s); }; ";
+    for(auto [depth,m]:{std::pair(500,MAX_FRAMES-503),std::pair(500,MAX_FRAMES-502)}){
+        auto src=d+"let m:int="+std::to_string(m)+"; "+v+"return v("+std::to_string(depth)+",\"s\");";
+        same_as_vm(src,1);
+    }
+    auto deep=[&](std::uint32_t m){return run(d+"let m:int="+std::to_string(m)+"; "+v+"return v(500,\"s\");");};
+    EXPECT_EQ(deep(MAX_FRAMES-503),std::to_string(MAX_FRAMES-503));
+    EXPECT_EQ(deep(MAX_FRAMES-502),"stack overflow in d");
+}
+
+TEST(JitTest, LongExpressions) {
+    // the input of ParserTest.LongExpressions as the body of a function
+    const int terms=100'000;
+    std::string src="fun int f(x:int,){ return x";
+    for(int i=1;i<terms;i++){
+        src+=(i%3==0?"*x":i%3==1?"-x":"+x");
+    }
+    src+="; }; return f(3);";
+    same_as_vm(src,1);
+    same_as_vm("fun bool g(b:bool,){ return "+std::string(terms,'!')+"b; }; return g(true);",1);
+}
+
+TEST(JitTest, CompileObject) {
+    Parser parser{Lexer(std::string(
+                "fun int fib(n:int,){ if(n<2){return n;}; return fib(n-1)+fib(n-2); };"
+                "fun str name(){ return \"x\"; };"
+                "fun double scale(x:double,odd:bool,){ if(odd){return x*3;}; return x/2; };"
+                "fun double double(x:double,){ return x*2; };"
+                "fun int new(delete:int,){ return delete/0; };"))};
+    auto program=parser.parse();
+    ASSERT_TRUE(program.has_value());
+    auto dir=testing::TempDir();
+    auto path=dir+"tua_aot.o";
+    auto lowered=compile_object(program.value(),path);
+    ASSERT_TRUE(lowered.has_value())<<std::string(*lowered.error());
+    ASSERT_EQ(lowered->size(),4);
+    EXPECT_EQ((*lowered)[0].symbol,"tua_fib");
+    EXPECT_EQ((*lowered)[1].symbol,"tua_scale");
+    EXPECT_EQ((*lowered)[2].symbol,"tua_double");
+
+    // the symbol table of any object format has the names as they are
+    std::ifstream file(path,std::ios::binary);
+    std::string object((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+    for(auto& fct:lowered.value()) EXPECT_NE(object.find(fct.symbol),std::string::npos)<<fct.symbol;
+
+    auto header=cpp_header(lowered.value());
+    EXPECT_NE(header.find("    bool tua_fib(std::int64_t,std::int64_t*,std::int32_t);\n"),std::string::npos)<<header;
+    EXPECT_NE(header.find("    bool tua_scale(double,bool,double*,std::int32_t);\n"),std::string::npos)<<header;
+    EXPECT_NE(header.find("inline std::optional<double> scale(double x_,bool odd_){"),std::string::npos)<<header;
+    EXPECT_NE(header.find("inline std::optional<double> double_(double x_){"),std::string::npos)<<header;
+    EXPECT_NE(header.find("inline std::optional<std::int64_t> new_(std::int64_t delete_){"),std::string::npos)<<header;
+    EXPECT_EQ(header.find("tua_name"),std::string::npos)<<header;
+
+#ifdef TUA_CXX
+    // a program built against the header and the object calls them
+    std::ofstream(dir+"tua_aot.h")<<header;
+    std::ofstream(dir+"tua_aot_main.cpp")<<
+        "#include <cstdio>\n"
+        "#include \"tua_aot.h\"\n"
+        "int main(){\n"
+        "    std::printf(\"%lld %g %g %d\\n\",(long long)*tua::native::fib(20),*tua::native::scale(1.5,true),\n"
+        "            *tua::native::double_(2.5),(int)tua::native::new_(1).has_value());\n"
+        "}\n";
+    auto exe=dir+"tua_aot_main";
+    auto out=dir+"tua_aot_main.txt";
+    auto built=std::system((std::string(TUA_CXX)+" -std=c++17 -I"+dir+" "+dir+"tua_aot_main.cpp "+path+" -o "+exe).c_str());
+    ASSERT_EQ(built,0);
+    ASSERT_EQ(std::system((exe+" > "+out).c_str()),0);
+    std::ifstream printed(out);
+    std::string line;
+    std::getline(printed,line);
+    EXPECT_EQ(line,"6765 4.5 5 0");
+    for(auto made:{dir+"tua_aot.h",dir+"tua_aot_main.cpp",exe,out}) std::remove(made.c_str());
+#endif
+    std::remove(path.c_str());
+}
@@ -0,0 +1,112 @@
+#include<chrono>
+#include<iostream>
+#include<string>
+#include<string_view>
+#include<unordered_map>
+#include<vector>
+
+#include "lexer.h"
+#include "thread_pool.h"
+
+using namespace tua;
+
+// the key word table the lexer used before key_word()
+static const std::unordered_map<std::string,TokenKind> map_key_words={
+    {"and",TokenKind::AND},
+    {"class",TokenKind::CLASS},
+    {"else",TokenKind::ELSE},
+    {"false",TokenKind::FALSE},
+    {"fun",TokenKind::FUN},
+    {"lambda",TokenKind::LAMBDA},
+    {"for",TokenKind::FOR},
+    {"if",TokenKind::IF},
+    {"nil",TokenKind::NIL},
+    {"or",TokenKind::OR},
+    {"return",TokenKind::RETURN},
+    {"super",TokenKind::SUPER},
+    {"this",TokenKind::THIS},
+    {"true",TokenKind::TRUE},
+    {"let",TokenKind::LET},
+    {"while",TokenKind::WHILE},
+};
+
+static TokenKind map_key_word(std::string_view word){
+    auto tkind_ptr=map_key_words.find(std::string(word));
+    return tkind_ptr==map_key_words.end()?TokenKind::IDENT:tkind_ptr->second;
+}
+
+static std::vector<std::string_view> ident_heavy_words(std::size_t count){
+    static const std::string_view pool[]={
+        "counter","i","value","while","fun","result","buffersize","x",
+        "let","index","total","if","return","node","accumulator","lambda",
+    };
+    std::vector<std::string_view> words;
+    words.reserve(count);
+    for(std::size_t i=0;i<count;i++){
+        words.push_back(pool[(i*7)%std::size(pool)]);
+    }
+    return words;
+}
+
+template<typename F> static void bench(const char* name,std::size_t items,F&& fct){
+    auto start=std::chrono::steady_clock::now();
+    auto sink=fct();
+    auto ns=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+    std::cout<<name<<" : "<<ns/items<<" ns/item ("<<sink<<")"<<std::endl;
+}
+
+int main(){
+    const std::size_t count=4'000'000;
+    auto words=ident_heavy_words(count);
+
+    bench("unordered_map key words",count,[&]{
+        std::size_t idents=0;
+        for(auto word:words) idents+=map_key_word(word)==TokenKind::IDENT;
+        return idents;
+    });
+
+    bench("key_word switch",count,[&]{
+        std::size_t idents=0;
+        for(auto word:words) idents+=key_word(word)==TokenKind::IDENT;
+        return idents;
+    });
+
+    std::string src;
+    for(auto word:words){
+        src.append(word).push_back(' ');
+    }
+    bench("Lexer::get_token on identifiers",count,[&]{
+        auto lexer=Lexer(std::string(src));
+        std::size_t tokens=0;
+        while(lexer.get_token().kind!=TokenKind::Eof) tokens++;
+        return tokens;
+    });
+
+    std::string commented;
+    for(std::size_t i=0;i<count/20;i++){
+        commented.append("        // a long comment line explaining the statement below it\n");
+        commented.append("        let counter:int=counter+1; \"a string literal body\";\n");
+    }
+    bench("Lexer::get_token on comments and indentation (per byte)",commented.size(),[&]{
+        auto lexer=Lexer(std::string(commented));
+        std::size_t tokens=0;
+        while(lexer.get_token().kind!=TokenKind::Eof) tokens++;
+        return tokens;
+    });
+
+    std::string large;
+    while(large.size()<(64u<<20)){
+        large.append(commented);
+    }
+    // copies of a Lexer share the source, so the text isn't copied per run
+    auto large_lexer=Lexer(std::move(large));
+    for(unsigned threads:{1,2,4,8,16}){
+        auto pool=ThreadPool(threads);
+        auto name="Lexer::tokenize_parallel "+std::to_string(threads)+" threads (per byte)";
+        bench(name.c_str(),large_lexer.source().size(),[&]{
+            auto lexer=large_lexer;
+            return lexer.tokenize_parallel(pool,threads*4).size();
+        });
+    }
+    return 0;
+}
@@ -1,7 +1,16 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <gtest/gtest.h>
 
+#include "interner.h"
 #include "lexer.h"
+#include "scan.h"
+#include "source.h"
+#include "stream_lexer.h"
+#include "thread_pool.h"
 
 
 using namespace tua;
@@ -11,26 +20,26 @@ TEST(LexerTest, simple_token) {
     auto lexer=Lexer("(){}[],:.;*/+-===!!=|&");
     auto tokens=std::vector{
             Token(TokenKind::LEFT_PAREN,0),
-            Token(TokenKind::RIGHT_PAREN,0),
-            Token(TokenKind::LEFT_BRACE,0),
-            Token(TokenKind::RIGHT_BRACE,0),
-            Token(TokenKind::LEFT_BRACKET,0),
-            Token(TokenKind::RIGHT_BRACKET,0),
-            Token(TokenKind::COMMA,0),
-            Token(TokenKind::COLLON,0),
-            Token(TokenKind::DOT,0),
-            Token(TokenKind::SEMICOLON,0),
-            Token(TokenKind::STAR,0),
-            Token(TokenKind::SLASH,0),
-            Token(TokenKind::PLUS,0),
-            Token(TokenKind::MINUS,0),
-            Token(TokenKind::EQUAL_EQUAL,0),
-            Token(TokenKind::EQUAL,0),
-            Token(TokenKind::BANG,0),
-            Token(TokenKind::BANG_EQUAL,0),
-            Token(TokenKind::BIT_OR,0),
-            Token(TokenKind::BIT_AND,0),
-            Token(TokenKind::Eof,0),
+            Token(TokenKind::RIGHT_PAREN,1),
+            Token(TokenKind::LEFT_BRACE,2),
+            Token(TokenKind::RIGHT_BRACE,3),
+            Token(TokenKind::LEFT_BRACKET,4),
+            Token(TokenKind::RIGHT_BRACKET,5),
+            Token(TokenKind::COMMA,6),
+            Token(TokenKind::COLLON,7),
+            Token(TokenKind::DOT,8),
+            Token(TokenKind::SEMICOLON,9),
+            Token(TokenKind::STAR,10),
+            Token(TokenKind::SLASH,11),
+            Token(TokenKind::PLUS,12),
+            Token(TokenKind::MINUS,13),
+            Token(TokenKind::EQUAL_EQUAL,14),
+            Token(TokenKind::EQUAL,16),
+            Token(TokenKind::BANG,17),
+            Token(TokenKind::BANG_EQUAL,18),
+            Token(TokenKind::BIT_OR,20),
+            Token(TokenKind::BIT_AND,21),
+            Token(TokenKind::Eof,22),
     };
     for(const auto& expected_token: tokens){
         auto token=lexer.get_token();
@@ -42,12 +51,12 @@ TEST(LexerTest, ShitAndComp) {
     auto lexer=Lexer("<<>> <= >= < >");
     auto tokens=std::vector{
         Token(TokenKind::BIT_LSHIFT,0),
-        Token(TokenKind::BIT_RSHIFT,0),
-        Token(TokenKind::LESS_EQUAL,0),
-        Token(TokenKind::GREATER_EQUAL,0),
-        Token(TokenKind::LESS,0),
-        Token(TokenKind::GREATER,0),
-        Token(TokenKind::Eof,0),
+        Token(TokenKind::BIT_RSHIFT,2),
+        Token(TokenKind::LESS_EQUAL,5),
+        Token(TokenKind::GREATER_EQUAL,8),
+        Token(TokenKind::LESS,11),
+        Token(TokenKind::GREATER,13),
+        Token(TokenKind::Eof,14),
     };
     for(const auto& expected_token: tokens){
         auto token=lexer.get_token();
@@ -55,6 +64,239 @@ TEST(LexerTest, ShitAndComp) {
     }
 }
 
+TEST(LexerTest, LexemeViewsSource) {
+    auto lexer=Lexer("toufik \"zoubir\" 13.3");
+    auto ident=lexer.get_token();
+    auto str=lexer.get_token();
+    auto num=lexer.get_token();
+    EXPECT_EQ(ident.lexeme,"toufik");
+    EXPECT_EQ(str.lexeme,"zoubir");
+    EXPECT_EQ(num.lexeme,"13.3");
+    EXPECT_EQ(str.lexeme.data(),ident.lexeme.data()+8);
+    EXPECT_EQ(num.lexeme.data(),ident.lexeme.data()+16);
+}
+
+TEST(LexerTest, ScanMatchesByteLoop) {
+    // lengths around the 16 and 32 bytes blocks with the stop byte at every position
+    for(std::size_t len=0;len<80;len++){
+        for(std::size_t stop=0;stop<=len;stop++){
+            std::string spaces(len,' ');
+            for(std::size_t i=0;i<len;i+=3) spaces[i]='\n';
+            std::string alnums(len,'a');
+            for(std::size_t i=0;i<len;i+=5) alnums[i]='7';
+            std::string bytes(len,'x');
+            if(stop<len){
+                spaces[stop]='a';
+                alnums[stop]='_';
+                bytes[stop]='"';
+            }
+            EXPECT_EQ(scan::skip_space(spaces.data(),spaces.data()+len)-spaces.data(),stop);
+            EXPECT_EQ(scan::skip_alnum(alnums.data(),alnums.data()+len)-alnums.data(),stop);
+            EXPECT_EQ(scan::find_byte(bytes.data(),bytes.data()+len,'"')-bytes.data(),stop);
+        }
+    }
+    std::string high("\xe9\xa0\x85");
+    EXPECT_EQ(scan::skip_space(high.data(),high.data()+high.size()),high.data());
+    EXPECT_EQ(scan::skip_alnum(high.data(),high.data()+high.size()),high.data());
+}
+
+TEST(LexerTest, CommentEndsLine) {
+    auto lexer=Lexer("// first\n    // second\n\t3");
+    auto token=lexer.get_token();
+    EXPECT_EQ(token,Token(TokenKind::INT,"3",24));
+    EXPECT_EQ(lexer.line_of(token.offset),2);
+    EXPECT_EQ(lexer.column_of(token.offset),1);
+}
+
+TEST(LexerTest, LinesPastUint16) {
+    std::string src;
+    for(int i=0;i<70000;i++) src+="a;\n";
+    src+="\n  \"x\n\" b";
+    auto lexer=Lexer(std::string(src));
+    auto tokens=lexer.tokenize_all();
+    auto ident=tokens.size()-2;
+    EXPECT_EQ(lexer.line_of(tokens.offsets[ident-1]),70001);
+    EXPECT_EQ(lexer.column_of(tokens.offsets[ident-1]),3);
+    EXPECT_EQ(lexer.line_of(tokens.offsets[ident]),70002);
+    EXPECT_EQ(lexer.column_of(tokens.offsets[ident]),2);
+    EXPECT_EQ(lexer.line_of(0),0);
+}
+
+TEST(LexerTest, LinesOfViews) {
+    std::string src="a;\n  b;\n    c;";
+    auto c=static_cast<std::uint32_t>(src.find('c'));
+    for(auto lexer:{Lexer::view(src),Lexer::view(src,4),Lexer::view(src).at(c)}){
+        EXPECT_EQ(lexer.line_of(c),2);
+        EXPECT_EQ(lexer.column_of(c),4);
+        auto copy=lexer.at(0);
+        EXPECT_EQ(copy.line_of(3),1);
+    }
+}
+
+TEST(LexerTest, TokenizeAllMatchesGetToken) {
+    std::string src="fun int fib(n:int,){\n  // recursion\n  if(n<2){return n;};\n  return fib(n-1)+fib(n-2);\n};\nlet s:str=\"a\nb\"; 3.25 $";
+    auto lexer=Lexer(std::string(src));
+    auto tokens=Lexer(std::string(src)).tokenize_all();
+    for(std::size_t i=0;i<tokens.size();i++){
+        auto token=lexer.get_token();
+        EXPECT_EQ(tokens.kinds[i],token.kind);
+        EXPECT_EQ(tokens.offsets[i],token.offset);
+        EXPECT_EQ(tokens.lengths[i],token.lexeme.size());
+        EXPECT_EQ(src.substr(tokens.offsets[i],tokens.lengths[i]),token.lexeme);
+    }
+    EXPECT_EQ(tokens.kinds.back(),TokenKind::Err);
+    EXPECT_EQ(lexer.line_of(tokens.offsets.back()),6);
+}
+
+TEST(LexerTest, NumberPayloads) {
+    auto tokens=Lexer(std::string("12 3.5 0 7. 4x 18446744073709551616 1.25 9")).tokenize_all();
+    std::vector<TokenKind> kinds;
+    for(std::size_t i=0;i<tokens.size();i++){
+        kinds.push_back(tokens.kinds[i]);
+        if(tokens.kinds[i]==TokenKind::Err) break;
+    }
+    ASSERT_EQ(kinds,(std::vector<TokenKind>{TokenKind::INT,TokenKind::DOUBLE,TokenKind::INT,TokenKind::Err}));
+    EXPECT_EQ(tokens.numbers[tokens.payloads[0]].int_value,12);
+    EXPECT_EQ(tokens.numbers[tokens.payloads[1]].double_value,3.5);
+    EXPECT_EQ(tokens.numbers[tokens.payloads[2]].int_value,0);
+    EXPECT_EQ(static_cast<LexError>(tokens.payloads[3]),LexError::Malformed);
+    EXPECT_EQ(tokens.lengths[3],2);
+
+    auto lexer=Lexer(std::string("4x 18446744073709551616 1.25"));
+    auto token=lexer.get_token();
+    EXPECT_EQ(token,Token(TokenKind::Err,"4x",0));
+    EXPECT_EQ(token.error,LexError::Malformed);
+    token=lexer.get_token();
+    EXPECT_EQ(token.kind,TokenKind::Err);
+    EXPECT_EQ(token.error,LexError::OutOfRange);
+    token=lexer.get_token();
+    EXPECT_EQ(token.kind,TokenKind::DOUBLE);
+    EXPECT_EQ(token.number.double_value,1.25);
+}
+
+TEST(LexerTest, IdentifiersAreInterned) {
+    auto tokens=Lexer(std::string("count total count fun total_ x")).tokenize_all();
+    auto& interner=Interner::global();
+    EXPECT_EQ(tokens.kinds[0],TokenKind::IDENT);
+    EXPECT_EQ(tokens.payloads[0],tokens.payloads[2]);
+    EXPECT_NE(tokens.payloads[0],tokens.payloads[1]);
+    EXPECT_EQ(interner.name(tokens.payloads[0]),"count");
+    EXPECT_EQ(interner.name(tokens.payloads[1]),"total");
+    EXPECT_EQ(interner.intern("count"),tokens.payloads[0]);
+    EXPECT_EQ(interner.name(NoIdent),"");
+}
+
+TEST(LexerTest, InternerThreads) {
+    Interner interner;
+    std::vector<std::vector<IdentId>> ids(4);
+    std::vector<std::thread> threads;
+    for(std::size_t t=0;t<ids.size();t++){
+        threads.emplace_back([&,t]{
+            for(int i=0;i<5000;i++){
+                ids[t].push_back(interner.intern("name"+std::to_string(i)));
+            }
+        });
+    }
+    for(auto& thread:threads) thread.join();
+    EXPECT_EQ(interner.size(),5001);
+    for(std::size_t t=1;t<ids.size();t++){
+        EXPECT_EQ(ids[t],ids[0]);
+    }
+    EXPECT_EQ(interner.name(ids[0][4321]),"name4321");
+}
+
+TEST(LexerTest, InternerTruncate) {
+    Interner interner;
+    auto kept=interner.intern("kept");
+    auto mark=interner.size();
+    // past a few blocks, with a name larger than one
+    std::string large(100000,'x');
+    std::vector<IdentId> ids;
+    for(int i=0;i<20000;i++) ids.push_back(interner.intern("program"+std::to_string(i)));
+    ids.push_back(interner.intern(large));
+    interner.truncate(mark);
+    EXPECT_EQ(interner.size(),mark);
+    EXPECT_EQ(interner.intern("kept"),kept);
+    EXPECT_EQ(interner.name(kept),"kept");
+    EXPECT_EQ(interner.name(NoIdent),"");
+    // the next names take the ids dropped
+    EXPECT_EQ(interner.intern(large),ids[0]);
+    EXPECT_EQ(interner.intern("program7"),ids[1]);
+    EXPECT_EQ(interner.name(ids[0]),large);
+    EXPECT_EQ(interner.name(kept),"kept");
+
+    interner.truncate(0);
+    EXPECT_EQ(interner.size(),1);
+    EXPECT_EQ(interner.intern("again"),1);
+    EXPECT_EQ(interner.intern(""),NoIdent);
+}
+
+TEST(LexerTest, MappedSource) {
+    auto path=std::filesystem::temp_directory_path()/"tua_lexer_source_test.txt";
+    // 4096 bytes fill a page exactly and are read instead of mapped
+    for(std::size_t size:{std::size_t(0),std::size_t(13),std::size_t(4096),std::size_t(5000)}){
+        std::string text(size,'x');
+        for(std::size_t i=0;i<size;i+=7) text[i]=' ';
+        {
+            std::ofstream file(path,std::ios::binary);
+            file<<text;
+        }
+        auto source=Source::map_file(path.string());
+        ASSERT_TRUE(source);
+        EXPECT_EQ(source->text(),text);
+        EXPECT_EQ(source->text().data()[size],'\0');
+    }
+    std::filesystem::remove(path);
+    EXPECT_FALSE(Source::map_file(path.string()));
+}
+
+TEST(LexerTest, LexerCopiesShareSource) {
+    auto lexer=std::make_unique<Lexer>(Source(std::string("toufik zoubir")));
+    auto copy=*lexer;
+    lexer.reset();
+    EXPECT_EQ(copy.get_token().lexeme,"toufik");
+    EXPECT_EQ(copy.get_token().lexeme,"zoubir");
+}
+
+TEST(LexerTest, StreamLexerMatchesLexer) {
+    std::string src="fun int fib(n:int,){\n  // recursion on n\n  if(n<=2){return n;};\n"
+        "  return fib(n-1)+fib(n-2);\n};\n// trailing comment\nlet s:str=\"a long\nstring\"; 3.25 / 7 <<x;\n//";
+    auto tokens=Lexer(std::string(src)).tokenize_all();
+    for(std::size_t chunk=1;chunk<10;chunk++){
+        std::istringstream input(src);
+        auto stream=StreamLexer(input,chunk);
+        for(std::size_t i=0;i<tokens.size();i++){
+            auto token=stream.get_token();
+            stream.release(token.offset);
+            EXPECT_EQ(tokens.kinds[i],token.kind);
+            EXPECT_EQ(tokens.offsets[i],token.offset);
+            EXPECT_EQ(src.substr(tokens.offsets[i],tokens.lengths[i]),token.lexeme);
+            EXPECT_EQ(Lexer(std::string(src)).line_of(token.offset),stream.line_of(token.offset));
+        }
+    }
+}
+
+TEST(LexerTest, ParallelMatchesSequential) {
+    std::string src;
+    for(int i=0;i<300;i++){
+        src+="let s"+std::to_string(i)+":str=\"multi\nline // not a comment\n\";\n";
+        src+="// comment with a \" quote\nfun int f(a:int,){return a/2;};\n";
+    }
+    auto pool=ThreadPool(4);
+    for(auto tail:{std::string(),std::string("\n\"unterminated\nstring"),std::string("a $ b\n3;")}){
+        auto text=src+tail;
+        auto expected=Lexer(std::string(text)).tokenize_all();
+        for(std::size_t segments:{1,2,3,7,64,5000}){
+            auto tokens=Lexer(std::string(text)).tokenize_parallel(pool,segments);
+            EXPECT_EQ(tokens.kinds,expected.kinds);
+            EXPECT_EQ(tokens.offsets,expected.offsets);
+            EXPECT_EQ(tokens.lengths,expected.lengths);
+            EXPECT_EQ(tokens.payloads,expected.payloads);
+            EXPECT_EQ(tokens.numbers.size(),expected.numbers.size());
+        }
+    }
+}
+
 // Define a test fixture class
 class LexerFixture : public ::testing::TestWithParam<std::tuple<std::string, Token>> {
 };
@@ -100,8 +342,8 @@ INSTANTIATE_TEST_SUITE_P(
         StringToken,
         LexerFixture,
         ::testing::Values(
-            std::tuple(std::string("\"toufik\""),Token(TokenKind::STRING,"toufik",0)),
-            std::tuple(std::string("\"zoubir\n\""),Token(TokenKind::STRING,"zoubir\n",0))
+            std::tuple(std::string("\"toufik\""),Token(TokenKind::STRING,"toufik",1)),
+            std::tuple(std::string("\"zoubir\n\""),Token(TokenKind::STRING,"zoubir\n",1))
             )
         );
 
@@ -134,7 +376,7 @@ INSTANTIATE_TEST_SUITE_P(
         comment,
         LexerFixture,
         ::testing::Values(
-            std::tuple(std::string("//toufik"),Token(TokenKind::Eof,0)),
-            std::tuple(std::string("\n//toufik"),Token(TokenKind::Eof,1))
+            std::tuple(std::string("//toufik"),Token(TokenKind::Eof,8)),
+            std::tuple(std::string("\n//toufik"),Token(TokenKind::Eof,9))
             )
         );
@@ -1,46 +1,73 @@
-#include<iostream>
-#include<optional>
 #include<fstream>
+#include<iostream>
 #include<string>
+#include<string_view>
 
-#include "lexer.h"
-#include "parser.h"
-
-std::optional<std::string> readfilecontent(std::string_view path){
-    std::string myText;
-    std::string ouput;
+#include "ast_cache.h"
+#include "bytecode.h"
+#include "flat_ast.h"
+#include "source.h"
+#include "vm.h"
+#ifdef TUA_LLVM
+#include "aot.h"
+#include "jit.h"
+#endif
 
-    std::ifstream MyReadfile(path.data());
-    if(!MyReadfile.is_open()){
-        return std::nullopt;
+// main <source> runs it, main <source> --emit <out> writes the functions
+// it can compile ahead of time to <out>.o and their declarations to <out>.h.
+// Without LLVM there's no --emit and all of it runs on the vm. The tree of
+// <source> is cached in <source>.tuac for the next run
+int main(int argc,char** argv){
+    std::string_view path="C:\\Users\\toufik\\Documents\\cpp_projects\\lox_cpp\\build\\test\\source.txt";
+    if(argc>1){
+        path=argv[1];
     }
-
-    while (getline (MyReadfile, myText)) {
-        std::cout<<myText<<std::endl;
-        ouput+=myText+'\n';
-    }
-    MyReadfile.close();
-    return ouput;
-}
-
-int main(){
-    auto op_source=readfilecontent("C:\\Users\\toufik\\Documents\\cpp_projects\\lox_cpp\\build\\test\\source.txt");
+    auto op_source=tua::Source::map_file(path);
     if(!op_source){
         std::cout<<"no source code available"<<std::endl;
         return 1;
     }
-    auto source=std::move(op_source.value());
-    auto lexer=tua::Lexer(std::move(source));
-    auto parser=tua::Parser(lexer);
-    auto output=parser.parse();
-    if(!output){
-        std::cout<<output.error()->_msg<<std::endl;
-        std::cout<<output.error()->_lnum<<std::endl;
+    auto cache=tua::load_or_parse(std::string(path)+".tuac",op_source->text());
+    if(!cache){
+        std::cout<<cache.error()->_msg<<std::endl;
+        std::cout<<cache.error()->_lnum<<std::endl;
+        return 1;
+    }
+    auto program=tua::to_program(cache->view());
+#ifdef TUA_LLVM
+    if(argc>3 && std::string_view(argv[2])=="--emit"){
+        std::string out=argv[3];
+        auto lowered=tua::compile_object(program,out+".o");
+        if(!lowered){
+            std::cout<<std::string(*lowered.error())<<std::endl;
+            return 1;
+        }
+        std::ofstream(out+".h")<<tua::cpp_header(lowered.value());
+        std::cout<<lowered->size()<<" functions written to "<<out<<".o"<<std::endl;
+        return 0;
+    }
+#endif
+    auto module=tua::compile(program);
+    if(!module){
+        std::cout<<std::string(*module.error())<<std::endl;
         return 1;
     }
-    else{
-        std::cout<<"OK"<<std::endl;
+#ifdef TUA_LLVM
+    // functions the jit can't take stay bytecode
+    auto jit=tua::Jit::create();
+    if(jit){
+        auto compiled=jit->compile(program,module.value());
+        if(!compiled){
+            std::cout<<std::string(*compiled.error())<<std::endl;
+        }
+    }
+#endif
+    tua::VM vm;
+    auto value=vm.run(module.value());
+    if(!value){
+        std::cout<<std::string(*value.error())<<std::endl;
         return 1;
     }
+    std::cout<<tua::to_string(value.value())<<std::endl;
+    return 0;
 }
-
@@ -0,0 +1,235 @@
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstddef>
+#include<cstdlib>
+#include<iostream>
+#include<new>
+#include<string>
+
+#include "ast_cache.h"
+#include "ast_visitor.h"
+#include "lexer.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+using namespace tua;
+
+// every heap allocation of the process goes through here
+static std::size_t allocations=0;
+static std::size_t allocated_bytes=0;
+
+void* operator new(std::size_t size){
+    allocations++;
+    allocated_bytes+=size;
+    if(void* p=std::malloc(size?size:1)) return p;
+    throw std::bad_alloc();
+}
+
+// std::pmr's default upstream allocates with the alignment overloads
+void* operator new(std::size_t size,std::align_val_t align){
+    allocations++;
+    allocated_bytes+=size;
+    auto alignment=static_cast<std::size_t>(align);
+    if(void* p=std::aligned_alloc(alignment,(size+alignment-1)/alignment*alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p,std::size_t) noexcept { std::free(p); }
+void operator delete(void* p,std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p,std::size_t,std::align_val_t) noexcept { std::free(p); }
+
+static std::string program_source(std::size_t functions){
+    std::string src;
+    for(std::size_t i=0;i<functions;i++){
+        auto n=std::to_string(i);
+        src+="// function "+n+"\n";
+        src+="fun int f"+n+"(a:int,b:int,){\n";
+        src+="  let c:int=a*3+b/2-(a+b)*"+n+";\n";
+        src+="  if(c){return f"+n+"(c,b-1);} else {c=c+1;};\n";
+        src+="  while(c){c=c-1;};\n";
+        src+="  let s:str=\"value "+n+"\";\n";
+        src+="  return lambda int (x:int,){return x+c;};\n";
+        src+="};\n";
+    }
+    return src;
+}
+
+// parses src rounds times with parse(parser), the lexing done by the
+// Parser constructor is neither timed nor counted
+template<typename F> static bool bench(const char* name,const std::string& src,int rounds,F&& parse){
+    std::size_t parse_allocations=0;
+    std::size_t parse_bytes=0;
+    double parse_ns=0;
+    double total_ns=0;
+    for(int round=0;round<rounds;round++){
+        auto lexer=Lexer(std::string(src));
+        Parser parser(lexer);
+        auto start=std::chrono::steady_clock::now();
+        {
+            auto before=allocations;
+            auto before_bytes=allocated_bytes;
+            auto program=parse(parser);
+            parse_ns+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+            parse_allocations+=allocations-before;
+            parse_bytes+=allocated_bytes-before_bytes;
+            if(!program){
+                std::cerr<<std::string(*program.error())<<std::endl;
+                return false;
+            }
+        }
+        total_ns+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+    }
+
+    double mib=static_cast<double>(src.size())*rounds/(1<<20);
+    std::cout<<name<<std::endl;
+    std::cout<<"  allocations per parse : "<<parse_allocations/rounds<<" ("<<parse_bytes/rounds/1024<<" KiB)"<<std::endl;
+    std::cout<<"  parse : "<<mib/(parse_ns/1e9)<<" MiB/s"<<std::endl;
+    std::cout<<"  parse and free : "<<mib/(total_ns/1e9)<<" MiB/s"<<std::endl;
+    return true;
+}
+
+// every node of a tree, parents before children
+struct Collect:AstVisitor<Collect>{
+    std::vector<Stmt*> nodes;
+
+    void add(Stmt* node){
+        nodes.push_back(node);
+        dispatch(node);
+    }
+    void visit(Block* node){for(auto stmt:node->stmts) add(stmt);}
+    void visit(ClassStmt* node){add(node->block_);}
+    void visit(FctDecl* node){add(node->block_);}
+    void visit(VarDeclInit* node){if(node->value_) add(node->value_);}
+    void visit(IfElse* node){add(node->condition_); add(node->if_); if(node->else_) add(node->else_);}
+    void visit(WhileStmt* node){add(node->condition_); add(node->block_);}
+    void visit(Return* node){add(node->value_);}
+    void visit(BinExpr* node){add(node->left_); add(node->right_);}
+    void visit(UnaryExpr* node){add(node->expr_);}
+    void visit(Assign* node){add(node->value_);}
+    void visit(FctCall* node){add(node->expr_); for(auto arg:node->exprs_) add(arg);}
+    void visit(FctExpr* node){add(node->block_);}
+    void visit(Expr*){}
+};
+
+struct KindIndex:AstVisitor<KindIndex,std::size_t>{
+    template<typename T> std::size_t visit(T*){return static_cast<std::size_t>(T::Kind);}
+};
+
+// how consumers found the node type before the kind tag
+template<std::size_t... I> static std::size_t cast_index(Stmt* node,std::index_sequence<I...>){
+    std::size_t index=NODE_KIND_COUNT;
+    ((dynamic_cast<std::tuple_element_t<I,NodeTypes>*>(node)?(index=I,true):false) || ...);
+    return index;
+}
+
+static void bench_dispatch(const std::string& src){
+    auto program=Parser(Lexer(std::string(src))).parse();
+    Collect collect;
+    for(auto stmt:program.value().stmts) collect.add(stmt);
+    auto& nodes=collect.nodes;
+
+    auto run=[&](const char* name,auto&& index){
+        const int rounds=20;
+        std::size_t sum=0;
+        auto start=std::chrono::steady_clock::now();
+        for(int round=0;round<rounds;round++){
+            for(auto node:nodes) sum+=index(node);
+        }
+        auto ns=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+        std::cout<<name<<" : "<<ns/(rounds*nodes.size())<<" ns/node ("<<sum<<")"<<std::endl;
+    };
+    std::cout<<nodes.size()<<" tree nodes"<<std::endl;
+    run("dynamic_cast cascade",[](Stmt* node){return cast_index(node,std::make_index_sequence<NODE_KIND_COUNT>{});});
+    KindIndex visitor;
+    run("AstVisitor dispatch",[&](Stmt* node){return visitor.dispatch(node);});
+}
+
+// one character edits in the middle of a 50k lines source, reparse()
+// against lexing and parsing it all again
+static bool bench_reparse(){
+    const int edits=200;
+    auto text=program_source(6'250);
+    auto offset=static_cast<std::uint32_t>(text.find("let s:str=\"value 3125\"")+17);
+
+    auto start=std::chrono::steady_clock::now();
+    auto program=Parser(Lexer(std::string(text))).parse();
+    double full_ns=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+    if(!program) return false;
+
+    double reparse_ns=0;
+    for(int i=0;i<edits;i++){
+        std::string inserted(1,static_cast<char>('0'+i%10));
+        text.replace(offset,1,inserted);
+        start=std::chrono::steady_clock::now();
+        auto next=Parser::reparse(std::move(program.value()),text,Edit{offset,1,inserted});
+        reparse_ns+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+        if(!next){
+            std::cerr<<std::string(*next.error())<<std::endl;
+            return false;
+        }
+        program.emplace(std::move(next.value()));
+    }
+    std::cout<<"Parser::reparse one character, "<<std::count(text.begin(),text.end(),'\n')<<" lines"<<std::endl;
+    std::cout<<"  lex and parse : "<<full_ns/1e3<<" us"<<std::endl;
+    std::cout<<"  reparse : "<<reparse_ns/edits/1e3<<" us"<<std::endl;
+    return true;
+}
+
+// what a run pays before it has a tree: lexing and parsing the source
+// against mapping the cache written by an earlier run
+static bool bench_startup(const std::string& src){
+    const int rounds=5;
+    auto path=std::string("parser_bench.tuac");
+    std::remove(path.c_str());
+    double parse_ns=0,load_ns=0;
+    for(int i=0;i<rounds;i++){
+        auto start=std::chrono::steady_clock::now();
+        auto hash=source_hash(src);
+        auto ast=Parser(Lexer::view(src)).parse_flat();
+        parse_ns+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+        if(!ast || !write_ast_cache(path,ast.value(),hash)) return false;
+
+        start=std::chrono::steady_clock::now();
+        auto cache=AstCache::load(path,source_hash(src));
+        load_ns+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+        if(!cache || cache->view().size()!=ast.value().size()) return false;
+    }
+    std::remove(path.c_str());
+    std::cout<<"startup"<<std::endl;
+    std::cout<<"  hash, lex and parse_flat : "<<parse_ns/rounds/1e6<<" ms"<<std::endl;
+    std::cout<<"  hash and AstCache::load : "<<load_ns/rounds/1e6<<" ms"<<std::endl;
+    return true;
+}
+
+int main(){
+    const std::size_t functions=20'000;
+    const int rounds=5;
+    auto src=program_source(functions);
+    std::cout<<"source : "<<src.size()<<" bytes, "<<functions<<" functions"<<std::endl;
+
+    auto tree=bench("Parser::parse",src,rounds,[](Parser& parser){return parser.parse();});
+    auto explicit_stack=bench("Parser::parse explicit stack",src,rounds,[](Parser& parser){
+        parser.use_explicit_stack();
+        return parser.parse();
+    });
+    auto lazy=bench("Parser::parse lazy bodies",src,rounds,[](Parser& parser){
+        parser.use_lazy_bodies();
+        return parser.parse();
+    });
+    auto pool=ThreadPool();
+    auto parallel=bench("Parser::parse_parallel",src,rounds,[&](Parser& parser){return parser.parse_parallel(pool);});
+    auto flat=bench("Parser::parse_flat",src,rounds,[](Parser& parser){
+        auto ast=parser.parse_flat();
+        if(ast){
+            static bool once=false;
+            if(!once) std::cout<<"  "<<ast.value().size()<<" nodes, "<<ast.value().extra.size()<<" extra"<<std::endl;
+            once=true;
+        }
+        return ast;
+    });
+    if(!tree || !explicit_stack || !lazy || !parallel || !flat) return 1;
+    bench_dispatch(src);
+    return bench_startup(src) && bench_reparse()?0:1;
+}
@@ -1,9 +1,19 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <typeinfo>
 #include <gtest/gtest.h>
 
 #include "ast.h"
+#include "ast_cache.h"
+#include "ast_visitor.h"
 #include "lexer.h"
 #include "parser.h"
 #include "error.h"
+#include "stream_lexer.h"
+#include "thread_pool.h"
 
 using namespace tua;
 
@@ -277,7 +287,7 @@ INSTANTIATE_TEST_SUITE_P(
             std::tuple(std::string("(3+4)*3;")),
             std::tuple(std::string("3*3*0;")),
             std::tuple(std::string("(a+t)*b;")),
-            std::tuple(std::string("3*3/0;"))
+            std::tuple(std::string("3/3*0;"))
             )
         );
 
@@ -305,7 +315,7 @@ INSTANTIATE_TEST_SUITE_P(
             std::tuple(std::string("3/3;")),
             std::tuple(std::string("(3+4)/3;")),
             std::tuple(std::string("(hello+4)/test;")),
-            std::tuple(std::string("3/3*0;"))
+            std::tuple(std::string("3*3/0;"))
             )
         );
 
@@ -386,8 +396,8 @@ INSTANTIATE_TEST_SUITE_P(
         Parsefctcall,
         ParsefctcallFixt,
         ::testing::Values(
-            std::tuple(std::string("a();"),FctCall(new Symbol("a"),std::vector<Expr*>())),
-            std::tuple(std::string("test();"),FctCall(new Symbol("test"),std::vector<Expr*>())),
+            std::tuple(std::string("a();"),FctCall(new Symbol("a"),Exprs())),
+            std::tuple(std::string("test();"),FctCall(new Symbol("test"),Exprs())),
             std::tuple(std::string("(test)(3);"),FctCall(new Group(new Symbol("test")),{new Int(3)})),
             std::tuple(std::string("(test)(3,len);"),FctCall(new Group(new Symbol("test")),{new Int(3),new Symbol("len")})),
             std::tuple(std::string("(test)(3,len)();"),FctCall(new Group(new Symbol("test")),{new Int(3),new Symbol("len")})),
@@ -581,6 +591,23 @@ INSTANTIATE_TEST_SUITE_P(
             )
         );
 
+TEST(ParserTest, NamesAreIdentIds) {
+    auto parser=Parser(Lexer(std::string("fun int toufik(a:b,b:c,){a=b;};")));
+    auto rslt=parser.parse();
+    ASSERT_TRUE(rslt);
+    auto fct=dynamic_cast<FctDecl*>(rslt.value().stmts[0]);
+    ASSERT_TRUE(fct);
+    EXPECT_EQ(fct->ident_->name(),"toufik");
+    EXPECT_EQ(fct->ret_type_,Interner::global().intern("int"));
+    ASSERT_EQ(fct->params_.size(),2);
+    EXPECT_EQ(fct->params_[0],std::make_tuple(Symbol("a").ident_,Symbol("b").ident_));
+    EXPECT_EQ(fct->params_[1],std::make_tuple(Symbol("b").ident_,Symbol("c").ident_));
+    auto assign=dynamic_cast<Assign*>(fct->block_->stmts[0]);
+    ASSERT_TRUE(assign);
+    EXPECT_EQ(assign->ident_,std::get<0>(fct->params_[0]));
+    EXPECT_EQ(*dynamic_cast<Symbol*>(assign->value_),Symbol("b"));
+}
+
 class ParseClassStmtFixt : public ::testing::TestWithParam<std::tuple<std::string>> {
 };
 
@@ -647,5 +674,855 @@ INSTANTIATE_TEST_SUITE_P(
             std::tuple(std::string("let :a;"),ParseError(std::string("variable identifier expected"),0)),
             std::tuple(std::string("let a:;"),ParseError(std::string("type identifier expected"),0)),
             std::tuple(std::string("3;\n\n lambda (a:int, ;"),ParseError(std::string("return type identifier expected "),2)),
-            std::tuple(std::string("3;\n\n lambda int a:int, ;"),ParseError(std::string("( expected"),2))
+            std::tuple(std::string("3;\n\n lambda int a:int, ;"),ParseError(std::string("( expected"),2)),
+            std::tuple(std::string("let a:int=12ab;"),ParseError(std::string("malformed number : 12ab"),0)),
+            std::tuple(std::string("3;\n(3.+1);"),ParseError(std::string("malformed number : 3."),1)),
+            std::tuple(std::string("99999999999999999999;"),ParseError(std::string("number out of range : 99999999999999999999"),0)),
+            std::tuple(std::string("$;"),ParseError(std::string("unrecognized token found"),0))
         ));
+
+TEST(ParserTest, IntLiteralIs64Bit) {
+    auto parser=Parser(Lexer(std::string("9223372036854775807;")));
+    auto rslt=parser.parse();
+    ASSERT_TRUE(rslt);
+    auto value=dynamic_cast<Int*>(rslt.value().stmts[0]);
+    ASSERT_TRUE(value);
+    EXPECT_EQ(value->value,INT64_MAX);
+}
+
+TEST(ParserTest, StreamReleasesStatements) {
+    std::string src;
+    for(int i=0;i<2000;i++){
+        src+="// statement "+std::to_string(i)+"\nfun int f"+std::to_string(i)+"(a:int,){return a*3+1;};\n";
+    }
+    std::istringstream input(src);
+    auto stream=StreamLexer(input,64);
+    Parser parser(stream);
+    std::size_t count=0;
+    std::size_t max_buffered=0;
+    Arena arena;
+    std::expected<Stmt*,Error*> stmt;
+    while((stmt=parser.parse_next(arena)) && stmt.value()){
+        ASSERT_TRUE(dynamic_cast<FctDecl*>(stmt.value()));
+        arena.release();
+        max_buffered=std::max(max_buffered,stream.buffered());
+        count++;
+    }
+    ASSERT_TRUE(stmt);
+    EXPECT_EQ(count,2000);
+    EXPECT_LT(max_buffered,256);
+}
+
+TEST(ParserTest, ProgramOwnsItsNodes) {
+    auto rslt=[]{
+        auto lexer=Lexer(std::string("let s:str=\"text\"; fun int f(a:int,){return g(a,\"b\");};"));
+        Parser parser(lexer);
+        return parser.parse();
+    }();
+    ASSERT_TRUE(rslt);
+    auto program=std::move(rslt.value());
+    ASSERT_EQ(program.stmts.size(),2);
+    auto decl=dynamic_cast<VarDeclInit*>(program.stmts[0]);
+    ASSERT_TRUE(decl);
+    EXPECT_EQ(dynamic_cast<Str*>(decl->value_)->value,"text");
+    auto fct=dynamic_cast<FctDecl*>(program.stmts[1]);
+    ASSERT_TRUE(fct);
+    auto call=dynamic_cast<FctCall*>(dynamic_cast<Return*>(fct->block_->stmts[0])->value_);
+    ASSERT_TRUE(call);
+    ASSERT_EQ(call->exprs_.size(),2);
+    EXPECT_EQ(dynamic_cast<Str*>(call->exprs_[1])->value,"b");
+    EXPECT_EQ(call->exprs_.get_allocator().resource(),program.arena->resource());
+}
+
+TEST(ParserTest, StreamErrorLine) {
+    std::istringstream input("3;\n// comment\n\n(3+0.1");
+    auto stream=StreamLexer(input,4);
+    Parser parser(stream);
+    auto rslt=parser.parse();
+    ASSERT_FALSE(rslt);
+    EXPECT_EQ(*dynamic_cast<ParseError*>(rslt.error()),ParseError(") expected",3));
+}
+
+static const char* op_name(NodeKind kind){
+    switch(kind){
+        case NodeKind::Add: return "+";
+        case NodeKind::Sub: return "-";
+        case NodeKind::Mul: return "*";
+        case NodeKind::Div: return "/";
+        case NodeKind::Equality: return "==";
+        case NodeKind::NotEq: return "!=";
+        case NodeKind::Less: return "<";
+        case NodeKind::Great: return ">";
+        case NodeKind::LessEq: return "<=";
+        case NodeKind::GreatEq: return ">=";
+        case NodeKind::BitOr: return "|";
+        case NodeKind::BitAnd: return "&";
+        case NodeKind::RShift: return ">>";
+        case NodeKind::LShift: return "<<";
+        case NodeKind::Minus: return "neg";
+        case NodeKind::Negate: return "!";
+        case NodeKind::Group: return "group";
+        default: return "?";
+    }
+}
+
+static std::string dump(const Stmt* stmt);
+static std::string dump(const Expr* expr);
+
+// parses lazy bodies on the way
+template<typename Fct> static std::string body(const Fct* fct){
+    auto block=const_cast<Fct*>(fct)->body();
+    return block?dump(block.value()):"(error "+std::string(*block.error())+")";
+}
+
+static std::string dump(const Stmt* stmt){
+    auto name=[](IdentId id){return std::string(ident_name(id));};
+    auto params=[&](const Params& params){
+        std::string text;
+        for(auto& [param,type]:params) text+=" "+name(param)+":"+name(type);
+        return text;
+    };
+    if(auto block=dynamic_cast<const Block*>(stmt)){
+        std::string text="{";
+        for(auto child:block->stmts) text+=" "+dump(child);
+        return text+" }";
+    }
+    if(auto cls=dynamic_cast<const ClassStmt*>(stmt)) return "(class "+name(cls->ident_->ident_)+" "+name(cls->parent_)+" "+dump(cls->block_)+")";
+    if(auto fct=dynamic_cast<const FctDecl*>(stmt)) return "(fun "+name(fct->ret_type_)+" "+name(fct->ident_->ident_)+params(fct->params_)+" "+body(fct)+")";
+    if(auto var=dynamic_cast<const VarDeclInit*>(stmt)) return "(let "+name(var->ident_->ident_)+":"+name(var->type_)+(var->value_?" "+dump(var->value_):"")+")";
+    if(auto ifelse=dynamic_cast<const IfElse*>(stmt)) return "(if "+dump(ifelse->condition_)+" "+dump(ifelse->if_)+(ifelse->else_?" "+dump(ifelse->else_):"")+")";
+    if(auto loop=dynamic_cast<const WhileStmt*>(stmt)) return "(while "+dump(loop->condition_)+" "+dump(loop->block_)+")";
+    if(auto ret=dynamic_cast<const Return*>(stmt)) return "(return "+dump(ret->value_)+")";
+    return dump(dynamic_cast<const Expr*>(stmt));
+}
+
+static std::string dump(const Expr* expr){
+    if(auto node=dynamic_cast<const BinExpr*>(expr)) return std::string("(")+op_name(expr->kind)+" "+dump(node->left_)+" "+dump(node->right_)+")";
+    if(auto node=dynamic_cast<const UnaryExpr*>(expr)) return std::string("(")+op_name(expr->kind)+" "+dump(node->expr_)+")";
+    if(auto value=dynamic_cast<const Int*>(expr)) return std::to_string(value->value);
+    if(auto value=dynamic_cast<const Double*>(expr)) return std::to_string(value->value);
+    if(auto value=dynamic_cast<const Str*>(expr)) return "\""+std::string(value->value)+"\"";
+    if(auto value=dynamic_cast<const Bool*>(expr)) return value->value?"true":"false";
+    if(auto symbol=dynamic_cast<const Symbol*>(expr)) return std::string(symbol->name());
+    if(auto assign=dynamic_cast<const Assign*>(expr)) return "(= "+std::string(ident_name(assign->ident_))+" "+dump(assign->value_)+")";
+    if(auto call=dynamic_cast<const FctCall*>(expr)){
+        std::string text="(call "+dump(call->expr_);
+        for(auto arg:call->exprs_) text+=" "+dump(arg);
+        return text+")";
+    }
+    if(auto fct=dynamic_cast<const FctExpr*>(expr)){
+        std::string text="(lambda "+std::string(ident_name(fct->ret_type));
+        for(auto& [param,type]:fct->params_) text+=" "+std::string(ident_name(param))+":"+std::string(ident_name(type));
+        return text+" "+body(fct)+")";
+    }
+    return "?";
+}
+
+struct KindCheck:AstVisitor<KindCheck,bool>{
+    template<typename T> bool visit(T* node){return T::Kind==node->kind;}
+};
+
+TEST(ParserTest, VisitorDispatchesOnKind) {
+    auto one=new Int(1);
+    auto x=new Symbol("x");
+    std::vector<Expr*> nodes={one,new Double(2.5),new Str("s"),new Bool(true),x,
+        new Add(one,x),new Sub(one,x),new Mul(one,x),new Div(one,x),new Less(one,x),new BitOr(one,x),new LShift(one,x),
+        new Minus(one),new Negate(x),new Group(one),new Assign(x->ident_,one),new FctCall(x,Exprs())};
+    KindCheck check;
+    for(auto node:nodes){
+        EXPECT_TRUE(check.dispatch(node));
+    }
+    EXPECT_EQ(node_cast<Int>(nodes[0]),one);
+    EXPECT_EQ(node_cast<Int>(nodes[1]),nullptr);
+    EXPECT_EQ(node_cast<Add>(nodes[6]),nullptr);
+    EXPECT_TRUE(node_cast<Sub>(nodes[6]));
+    EXPECT_EQ(node_cast<Symbol>(static_cast<Stmt*>(nullptr)),nullptr);
+    for(auto node:nodes) delete node;
+}
+
+static std::string dump(const FlatView& ast,NodeId id){
+    auto name=[&](std::uint32_t id){return std::string(ident_name(ast.ident(id)));};
+    auto& node=ast[id];
+    auto children=[&]{
+        std::string text;
+        for(auto child:ast.children(id)) text+=" "+dump(ast,child);
+        return text;
+    };
+    auto params=[&]{
+        std::string text;
+        auto params=ast.fct_params(id);
+        for(std::size_t i=0;i<params.size();i+=2) text+=" "+name(params[i])+":"+name(params[i+1]);
+        return text;
+    };
+    switch(node.kind){
+        case NodeKind::Block: return "{"+children()+" }";
+        case NodeKind::ClassStmt: return "(class "+name(node.a)+" "+name(node.b)+" "+dump(ast,node.c)+")";
+        case NodeKind::FctDecl: return "(fun "+name(node.b)+" "+name(node.a)+params()+" "+dump(ast,ast.fct_block(id))+")";
+        case NodeKind::FctExpr: return "(lambda "+name(node.b)+params()+" "+dump(ast,ast.fct_block(id))+")";
+        case NodeKind::VarDeclInit: return "(let "+name(node.a)+":"+name(node.b)+(node.c!=NoNode?" "+dump(ast,node.c):"")+")";
+        case NodeKind::IfElse: return "(if "+dump(ast,node.a)+" "+dump(ast,node.b)+(node.c!=NoNode?" "+dump(ast,node.c):"")+")";
+        case NodeKind::WhileStmt: return "(while "+dump(ast,node.a)+" "+dump(ast,node.b)+")";
+        case NodeKind::Return: return "(return "+dump(ast,node.a)+")";
+        case NodeKind::Add: case NodeKind::Sub: case NodeKind::Mul: case NodeKind::Div:
+        case NodeKind::Equality: case NodeKind::NotEq: case NodeKind::Less: case NodeKind::Great:
+        case NodeKind::LessEq: case NodeKind::GreatEq: case NodeKind::BitOr: case NodeKind::BitAnd:
+        case NodeKind::RShift: case NodeKind::LShift:
+            return std::string("(")+op_name(node.kind)+" "+dump(ast,node.a)+" "+dump(ast,node.b)+")";
+        case NodeKind::Minus: case NodeKind::Negate: case NodeKind::Group:
+            return std::string("(")+op_name(node.kind)+" "+dump(ast,node.a)+")";
+        case NodeKind::Int: return std::to_string(ast.int_value(id));
+        case NodeKind::Double: return std::to_string(ast.double_value(id));
+        case NodeKind::Str: return "\""+std::string(ast.str(id))+"\"";
+        case NodeKind::Bool: return node.a?"true":"false";
+        case NodeKind::Symbol: return name(node.a);
+        case NodeKind::Assign: return "(= "+name(node.a)+" "+dump(ast,node.b)+")";
+        case NodeKind::FctCall: return "(call "+dump(ast,node.a)+children()+")";
+        default: return "?";
+    }
+}
+
+TEST(ParserTest, FlatMatchesTree) {
+    std::string src=
+        "fun int fib(n:int,){\n  if(n){return fib(n-1)+fib(n-2);} else {return 1;};\n};\n"
+        "class Point:Base{let x:int=3*(4+x)/2; let y:float;};\n"
+        "let s:str=\"text\"; let f:fn=lambda int (a:int,b:int,){return a*b-1.5;};\n"
+        "while(a<=b != c>d){x=f(1,2)(3) | 4&5<<1>>2; {-!false;};};\n"
+        "fib(20);\n";
+    auto tree=Parser(Lexer(std::string(src))).parse();
+    auto flat=Parser(Lexer(std::string(src))).parse_flat();
+    ASSERT_TRUE(tree);
+    ASSERT_TRUE(flat);
+    auto& stmts=tree.value().stmts;
+    auto& ast=flat.value();
+    ASSERT_EQ(ast.stmts.size(),stmts.size());
+    for(std::size_t i=0;i<stmts.size();i++){
+        EXPECT_EQ(dump(ast.view(),ast.stmts[i]),dump(stmts[i]));
+    }
+    // children come first
+    for(NodeId id=0;id<ast.size();id++){
+        auto& node=ast[id];
+        if(node.kind==NodeKind::Add || node.kind==NodeKind::Mul || node.kind==NodeKind::Sub){
+            EXPECT_LT(node.a,id);
+            EXPECT_LT(node.b,id);
+        }
+    }
+    // one node for each node of the tree, names have none
+    std::size_t nodes=0;
+    std::vector<Stmt*> stack(stmts.begin(),stmts.end());
+    while(!stack.empty()){
+        auto stmt=stack.back();
+        stack.pop_back();
+        nodes++;
+        each_child(stmt,[&](Stmt* child){stack.push_back(child);});
+    }
+    EXPECT_EQ(ast.size(),nodes);
+
+    // the explicit stack makes the same nodes, a lazy parser parses every
+    // body for parse_flat()
+    for(auto explicit_stack:{true,false}){
+        Parser parser{Lexer(std::string(src))};
+        if(explicit_stack) parser.use_explicit_stack();
+        else parser.use_lazy_bodies();
+        auto other=parser.parse_flat();
+        ASSERT_TRUE(other);
+        EXPECT_EQ(other.value().size(),ast.size());
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(dump(other.value().view(),other.value().stmts[i]),dump(stmts[i]));
+        }
+    }
+}
+
+TEST(ParserTest, FlatErrorsMatchTree) {
+    for(auto src:{"3","(3+0.1","3;\n fun int fct(a:int b:float);","3;\n\n lambda int a:int, ;","class test:{a};","f(1 2);","let a:int=12ab;"}){
+        auto tree=Parser(Lexer(std::string(src))).parse();
+        auto flat=Parser(Lexer(std::string(src))).parse_flat();
+        ASSERT_FALSE(tree);
+        ASSERT_FALSE(flat);
+        EXPECT_EQ(*dynamic_cast<ParseError*>(flat.error()),*dynamic_cast<ParseError*>(tree.error()));
+    }
+}
+
+class PrecedenceFixt : public ::testing::TestWithParam<std::tuple<std::string,std::string>> {
+};
+
+TEST_P(PrecedenceFixt, ParserTest) {
+    auto src=std::get<0>(GetParam());
+    auto tree=Parser(Lexer(std::string(src))).parse();
+    auto flat=Parser(Lexer(std::string(src))).parse_flat();
+    ASSERT_TRUE(tree);
+    ASSERT_TRUE(flat);
+    EXPECT_EQ(dump(tree.value().stmts.at(0)),std::get<1>(GetParam()));
+    EXPECT_EQ(dump(flat.value().view(),flat.value().stmts.at(0)),std::get<1>(GetParam()));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        Precedence,
+        PrecedenceFixt,
+        ::testing::Values(
+            std::tuple(std::string("a-b-c;"),std::string("(- (- a b) c)")),
+            std::tuple(std::string("a/b*c;"),std::string("(* (/ a b) c)")),
+            std::tuple(std::string("a+b*c-d;"),std::string("(- (+ a (* b c)) d)")),
+            std::tuple(std::string("a<<1+b;"),std::string("(<< a (+ 1 b))")),
+            std::tuple(std::string("a<b==c>=d;"),std::string("(== (< a b) (>= c d))")),
+            std::tuple(std::string("a|b&c!=d;"),std::string("(| a (& b (!= c d)))")),
+            std::tuple(std::string("a>>b<=c>d;"),std::string("(> (<= (>> a b) c) d)")),
+            std::tuple(std::string("-a*-(b+c);"),std::string("(* (neg a) (neg (group (+ b c))))")),
+            std::tuple(std::string("!!f(a)|1;"),std::string("(| (! (! (call f a))) 1)")),
+            std::tuple(std::string("x=a-b-c;"),std::string("(= x (- (- a b) c))"))
+            )
+        );
+
+TEST(ParserTest, LongExpressions) {
+    const int terms=100'000;
+    std::string src="x0";
+    for(int i=1;i<terms;i++){
+        src+=(i%3==0?"*x":i%3==1?"-x":"+x")+std::to_string(i%10);
+    }
+    src+=";";
+    auto tree=Parser(Lexer(std::string(src))).parse();
+    ASSERT_TRUE(tree);
+    // left associative: the spine goes down the left operands
+    std::size_t depth=0;
+    Expr* expr=static_cast<Expr*>(tree.value().stmts.at(0));
+    while(auto bin=dynamic_cast<BinExpr*>(expr)){
+        expr=bin->left_;
+        depth++;
+    }
+    EXPECT_GT(depth,terms/2);
+    auto flat=Parser(Lexer(std::string(src))).parse_flat();
+    ASSERT_TRUE(flat);
+    EXPECT_EQ(flat.value().size(),2*terms-1);
+}
+
+TEST(ParserTest, ExplicitStackMatchesRecursive) {
+    std::string src=
+        "fun int fib(n:int,){\n  if(n<2){return n;} else {return fib(n-1)+fib(n-2);};\n};\n"
+        "class Point:Base{let x:int=3; fun int get(){return x;}; class Inner{};};\n"
+        "while(a){ {}; if(b){}; while(c){ {x=lambda int (a:int,){ if(a){return 1;}; return 0;};}; }; };\n"
+        "let s:str=\"text\"; {};\n";
+    auto recursive=Parser(Lexer(std::string(src))).parse();
+    Parser parser{Lexer(std::string(src))};
+    parser.use_explicit_stack();
+    auto explicit_stack=parser.parse();
+    ASSERT_TRUE(recursive);
+    ASSERT_TRUE(explicit_stack);
+    auto& expected=recursive.value().stmts;
+    auto& stmts=explicit_stack.value().stmts;
+    ASSERT_EQ(stmts.size(),expected.size());
+    for(std::size_t i=0;i<stmts.size();i++){
+        EXPECT_EQ(dump(stmts[i]),dump(expected[i]));
+    }
+    auto params=node_cast<FctDecl>(stmts[0])->params_.get_allocator().resource();
+    EXPECT_EQ(params,explicit_stack.value().arena->resource());
+
+    for(auto error_src:{"if(a){b;","while(a){b}","if(a){} else b;","class A{class B{c};};","class A{fun int f(){ 1 2 };};",
+            "fun int f(a:int b){};","{ {;} };","if(a){};\n\nwhile(b){c;};d"}){
+        auto recursive=Parser(Lexer(std::string(error_src))).parse();
+        Parser parser{Lexer(std::string(error_src))};
+        parser.use_explicit_stack();
+        auto explicit_stack=parser.parse();
+        ASSERT_FALSE(recursive);
+        ASSERT_FALSE(explicit_stack);
+        EXPECT_EQ(*dynamic_cast<ParseError*>(explicit_stack.error()),*dynamic_cast<ParseError*>(recursive.error())) << error_src;
+    }
+}
+
+TEST(ParserTest, ExplicitStackDeepNesting) {
+    const int depth=100'000;
+    std::string src;
+    for(int i=0;i<depth;i++){
+        src+=i%2?"if(a){":"while(b){x=x+1;";
+    }
+    for(int i=depth-1;i>=0;i--){
+        src+=i%2?"} else {y;};":"};";
+    }
+    Parser parser{Lexer(std::string(src))};
+    parser.use_explicit_stack(depth);
+    auto rslt=parser.parse();
+    ASSERT_TRUE(rslt);
+    ASSERT_EQ(rslt.value().stmts.size(),1);
+    int levels=0;
+    Stmt* stmt=rslt.value().stmts[0];
+    while(stmt){
+        levels++;
+        Block* block=nullptr;
+        if(auto loop=node_cast<WhileStmt>(stmt)) block=loop->block_;
+        if(auto ifelse=node_cast<IfElse>(stmt)) block=ifelse->if_;
+        stmt=nullptr;
+        if(block && !block->stmts.empty()) stmt=block->stmts.back();
+    }
+    EXPECT_EQ(levels,depth);
+}
+
+TEST(ParserTest, ExplicitStackLimits) {
+    auto nested=[](int depth){
+        std::string src;
+        for(int i=0;i<depth;i++) src+="{";
+        for(int i=0;i<depth;i++) src+="};";
+        return src;
+    };
+    Parser parser(Lexer(nested(101)));
+    parser.use_explicit_stack(100);
+    auto rslt=parser.parse();
+    ASSERT_FALSE(rslt);
+    EXPECT_EQ(*dynamic_cast<ParseError*>(rslt.error()),ParseError("blocks nested deeper than 100",0));
+
+    Parser exact(Lexer(nested(100)));
+    exact.use_explicit_stack(100);
+    EXPECT_TRUE(exact.parse());
+
+    std::string parens(100'000,'(');
+    Parser expr(Lexer(parens+"1"));
+    expr.use_explicit_stack();
+    auto deep=expr.parse();
+    ASSERT_FALSE(deep);
+    EXPECT_EQ(*dynamic_cast<ParseError*>(deep.error()),ParseError("expression nested deeper than 256",0));
+}
+
+TEST(ParserTest, ParallelMatchesSequential) {
+    std::string src;
+    for(int i=0;i<500;i++){
+        auto n=std::to_string(i);
+        src+="fun int f"+n+"(a:int,){ if(a<"+n+"){return a*2.5;}; return f(a-1);};\n";
+        src+="class C"+n+":Base{let s:str=\"text "+n+"\"; fun int get(){return s;};};\n";
+        src+="x=(lambda int (b:int,){return b;})("+n+");\n";
+    }
+    auto pool=ThreadPool(4);
+    auto sequential=Parser(Lexer(std::string(src))).parse();
+    ASSERT_TRUE(sequential);
+    for(auto explicit_stack:{false,true}){
+        Parser parser{Lexer(std::string(src))};
+        if(explicit_stack) parser.use_explicit_stack();
+        auto parallel=parser.parse_parallel(pool);
+        ASSERT_TRUE(parallel);
+        auto& stmts=parallel.value().stmts;
+        auto& expected=sequential.value().stmts;
+        ASSERT_EQ(stmts.size(),expected.size());
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(dump(stmts[i]),dump(expected[i]));
+        }
+        EXPECT_EQ(stmts.get_allocator().resource(),parallel.value().arena->resource());
+    }
+
+    // the first error in the source wins whichever run finds it
+    for(auto tail:{"","f(1 2);","{ ) ; };","}; a;","let a:int=12ab;","x=\"open"}){
+        auto text=src.substr(0,src.size()/2)+tail+"\n"+src.substr(src.size()/2)+"if(a){b};c d;";
+        auto sequential=Parser(Lexer(std::string(text))).parse();
+        auto parallel=Parser(Lexer(std::string(text))).parse_parallel(pool);
+        ASSERT_FALSE(sequential);
+        ASSERT_FALSE(parallel);
+        EXPECT_EQ(*dynamic_cast<ParseError*>(parallel.error()),*dynamic_cast<ParseError*>(sequential.error())) << tail;
+    }
+    for(auto text:{"","3;","3","(3;","a;;b;"}){
+        auto sequential=Parser(Lexer(std::string(text))).parse();
+        auto parallel=Parser(Lexer(std::string(text))).parse_parallel(pool);
+        ASSERT_EQ(bool(parallel),bool(sequential)) << text;
+        if(!sequential){
+            EXPECT_EQ(*dynamic_cast<ParseError*>(parallel.error()),*dynamic_cast<ParseError*>(sequential.error())) << text;
+        }
+    }
+}
+
+TEST(ParserTest, ReparseMatchesFullParse) {
+    std::string text;
+    for(int i=0;i<200;i++){
+        auto n=std::to_string(i);
+        text+="fun int f"+n+"(a:int,){ if(a<"+n+"){return a*2;}; return f(a-1);};\n";
+        text+="let s"+n+":str=\"text "+n+"\";\n";
+    }
+    text+="// the end\n";
+    auto program=Parser(Lexer(std::string(text))).parse();
+    ASSERT_TRUE(program);
+
+    auto at=[&](std::string_view needle){return static_cast<std::uint32_t>(text.find(needle));};
+    // offset, removed and inserted, found in the text as it is when applied
+    std::vector<std::function<std::tuple<std::uint32_t,std::uint32_t,std::string>()>> edits{
+        [&]{return std::tuple(at("a*2;}; return f(a-1);};\nlet s7:")+2,1u,"3");},
+        [&]{return std::tuple(at("let s50:"),0u,"x=lambda int (b:int,){return b;};\n");},
+        [&]{return std::tuple(at("fun int f80("),at("fun int f82(")-at("fun int f80("),"");},
+        [&]{return std::tuple(at("s100:")+1,3u,"1000");},
+        [&]{return std::tuple(0u,0u,"first;");},
+        [&]{return std::tuple(at("// the end"),0u,"last;\n");},
+        [&]{return std::tuple(at("text 120")+5,3u,"x\"; let t:int=4; let u:str=\"y");},
+        [&]{return std::tuple(at("(a:int,){ if(a<150)")+8,40u,"{a;}; fun int g(){");},
+    };
+    for(auto& edit:edits){
+        auto [offset,removed,inserted]=edit();
+        auto before=std::vector<Stmt*>(program.value().stmts.begin(),program.value().stmts.end());
+        text.replace(offset,removed,inserted);
+        auto reparsed=Parser::reparse(std::move(program.value()),text,Edit{offset,removed,inserted});
+        auto full=Parser(Lexer(std::string(text))).parse();
+        ASSERT_TRUE(full) << inserted;
+        ASSERT_TRUE(reparsed) << inserted;
+        auto& stmts=reparsed.value().stmts;
+        ASSERT_EQ(stmts.size(),full.value().stmts.size());
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(dump(stmts[i]),dump(full.value().stmts[i])) << inserted;
+        }
+        EXPECT_EQ(reparsed.value().ends,full.value().ends);
+        // only the statements around the edit are new nodes
+        auto reused=std::count_if(stmts.begin(),stmts.end(),[&](Stmt* stmt){return std::find(before.begin(),before.end(),stmt)!=before.end();});
+        EXPECT_GE(reused+4,stmts.size()) << inserted;
+        program.emplace(std::move(reparsed.value()));
+    }
+    EXPECT_EQ(program.value().reparses,edits.size());
+
+    std::uint32_t offset=at("return f(a-1);};\nlet s30");
+    text.replace(offset,6,"retur");
+    auto broken=Parser::reparse(std::move(program.value()),text,Edit{offset,6,"retur"});
+    auto full=Parser(Lexer(std::string(text))).parse();
+    ASSERT_FALSE(broken);
+    ASSERT_FALSE(full);
+    EXPECT_EQ(*dynamic_cast<ParseError*>(broken.error()),*dynamic_cast<ParseError*>(full.error()));
+}
+
+TEST(ParserTest, ReparseRebindsLazyBodies) {
+    std::string base;
+    for(int i=0;i<20;i++){
+        auto n=std::to_string(i);
+        base+="fun int f"+n+"(a:int,){ fun int g(){ return a+"+n+"; }; return g(); };\n";
+        base+="let s"+n+":fn=lambda int (){ return "+n+"; };\n";
+    }
+    auto at=[&](std::string_view needle){return static_cast<std::uint32_t>(base.find(needle));};
+    std::vector<std::tuple<std::uint32_t,std::uint32_t,std::string>> edits{
+        {at("let s5:"),0u,"let x:int=1;\nlet y:int=2;\n"},
+        {at("fun int f9(")+8,2u,"h"},
+        {at("let s1:fn"),at("fun int f2(")-at("let s1:fn"),""},
+        {at("let s0:fn")+4,2u,"t"},
+    };
+    for(auto& [offset,removed,inserted]:edits){
+        auto old=base;
+        Parser parser{Lexer::view(old)};
+        parser.use_lazy_bodies();
+        auto program=parser.parse();
+        ASSERT_TRUE(program);
+        // the body of f2 is parsed, the g in it is left to parse
+        ASSERT_TRUE(node_cast<FctDecl>(program.value().stmts[4])->body());
+
+        auto text=base;
+        text.replace(offset,removed,inserted);
+        // nothing is left of the old text, as in an editor buffer
+        std::fill(old.begin(),old.end(),'#');
+        auto reparsed=Parser::reparse(std::move(program.value()),text,Edit{offset,removed,std::string_view(inserted)});
+        ASSERT_TRUE(reparsed) << inserted;
+        auto full=Parser(Lexer(std::string(text))).parse();
+        ASSERT_TRUE(full) << inserted;
+        auto& stmts=reparsed.value().stmts;
+        ASSERT_EQ(stmts.size(),full.value().stmts.size());
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(dump(stmts[i]),dump(full.value().stmts[i])) << inserted;
+        }
+    }
+}
+
+TEST(ParserTest, ReparseKeepsParserMode) {
+    std::string base;
+    for(int i=0;i<20;i++){
+        auto n=std::to_string(i);
+        base+="fun int f"+n+"(a:int,){ fun int g(){ return a+"+n+"; }; return g(); };\n";
+        base+="let s"+n+":fn=lambda int (){ return "+n+"; };\n";
+    }
+    auto text=base;
+    Parser parser{Lexer::view(base)};
+    parser.use_lazy_bodies();
+    parser.use_explicit_stack(4);
+    auto program=parser.parse();
+    ASSERT_TRUE(program);
+    EXPECT_EQ(program.value().lazy_bodies.size(),40);
+
+    auto at=[&](std::string_view needle){return static_cast<std::uint32_t>(text.find(needle));};
+    std::vector<std::function<std::tuple<std::uint32_t,std::uint32_t,std::string>()>> edits{
+        [&]{return std::tuple(at("let s5:"),0u,"fun int h(){ return 5; };\n");},
+        [&]{return std::tuple(at("fun int f9(")+8,2u,"k");},
+        [&]{return std::tuple(at("let s1:fn"),at("fun int f2(")-at("let s1:fn"),"");},
+        [&]{return std::tuple(at("fun int f12("),0u,"x=lambda int (){ return 1; };\n");},
+        [&]{return std::tuple(at("return 3;"),6u,"return 4+");},
+    };
+    for(std::size_t i=0;i<edits.size();i++){
+        auto [offset,removed,inserted]=edits[i]();
+        text.replace(offset,removed,inserted);
+        auto reparsed=Parser::reparse(std::move(program.value()),text,Edit{offset,removed,inserted});
+        ASSERT_TRUE(reparsed) << inserted;
+        // the statements parsed again leave their bodies to body() too
+        EXPECT_TRUE(reparsed.value().lazy);
+        EXPECT_EQ(reparsed.value().max_depth,4);
+        auto& lazy_bodies=reparsed.value().lazy_bodies;
+        for(auto stmt:reparsed.value().stmts){
+            if(auto fct=node_cast<FctDecl>(stmt); fct && !fct->block_){
+                EXPECT_NE(std::find(lazy_bodies.begin(),lazy_bodies.end(),stmt),lazy_bodies.end()) << inserted;
+            }
+        }
+        auto full=Parser(Lexer(std::string(text))).parse();
+        ASSERT_TRUE(full) << inserted;
+        auto& stmts=reparsed.value().stmts;
+        ASSERT_EQ(stmts.size(),full.value().stmts.size());
+        // parse every other function now, the functions in those stay
+        // pending for the next edit
+        for(std::size_t j=i%2;j<stmts.size();j+=2){
+            EXPECT_EQ(dump(stmts[j]),dump(full.value().stmts[j])) << inserted;
+        }
+        program.emplace(std::move(reparsed.value()));
+    }
+    for(std::size_t j=0;j<program.value().stmts.size();j++){
+        EXPECT_EQ(dump(program.value().stmts[j]),dump(Parser(Lexer(std::string(text))).parse().value().stmts[j]));
+    }
+
+    std::uint32_t offset=at("let s8:");
+    std::string deep="{{{{{a;};};};};};\n";
+    text.insert(offset,deep);
+    auto too_deep=Parser::reparse(std::move(program.value()),text,Edit{offset,0,deep});
+    ASSERT_FALSE(too_deep);
+    EXPECT_EQ(std::string(*too_deep.error()).find("blocks nested deeper than 4"),0) << std::string(*too_deep.error());
+}
+
+TEST(ParserTest, ParseAllRecovers) {
+    std::string src=
+        "let a:int=1;\n"
+        "let b int=2;\n"
+        "fun int f(x:int,){\n"
+        "  return x y;\n"
+        "  return x;\n"
+        "};\n"
+        "class C{ let c:int=; };\n"
+        "if(a){ b; } else c;\n"
+        "x=f(1 2);\n"
+        "}\n"
+        "let z:int=3;\n";
+    for(auto explicit_stack:{false,true}){
+        Parser parser{Lexer(std::string(src))};
+        if(explicit_stack) parser.use_explicit_stack();
+        auto result=parser.parse_all();
+        std::vector<std::string> found;
+        for(auto& diagnostic:result.diagnostics){
+            found.push_back(parser.message(diagnostic)+" : "+std::to_string(diagnostic.line));
+        }
+        EXPECT_EQ(found,(std::vector<std::string>{
+            ": expected : 1",
+            "; expected : 3",
+            // punctuation tokens have no lexeme
+            "couldn't parse class body : unknown Terminal token :  : 6",
+            "{ expected : 7",
+            ", expected : 8",
+            "unknown Terminal token :  : 9",
+        }));
+
+        std::vector<std::string> stmts;
+        for(auto stmt:result.program.stmts){
+            stmts.push_back(dump(stmt));
+        }
+        auto expected=Parser(Lexer(std::string(
+            "let a:int=1;\n"
+            "fun int f(x:int,){ return x; return x; };\n"
+            "class C{ };\n"
+            "let z:int=3;\n"))).parse();
+        ASSERT_TRUE(expected);
+        ASSERT_EQ(stmts.size(),expected.value().stmts.size());
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(stmts[i],dump(expected.value().stmts[i]));
+        }
+    }
+
+    // the first diagnostic is the error of parse(), a lexer error ends it
+    auto result=Parser(Lexer(std::string("class A{ b c; };\nd e;\nlet f:int=12ab;\ng h;"))).parse_all();
+    auto first=Parser(Lexer(std::string("class A{ b c; };"))).parse();
+    ASSERT_FALSE(first);
+    ASSERT_EQ(result.diagnostics.size(),3);
+    EXPECT_EQ(result.diagnostics[0].code,DiagCode::SemicolonExpected);
+    EXPECT_EQ(result.diagnostics[0].line,dynamic_cast<ParseError*>(first.error())->_lnum);
+    EXPECT_EQ(result.diagnostics[2].code,DiagCode::MalformedNumber);
+    EXPECT_EQ(result.program.stmts.size(),1);
+
+    // errors recovered from in class bodies have the prefixes of parse()
+    std::string nested="class A{ class B{ b c; }; let d:int=1 2; while(e){ f g; }; };\n";
+    for(auto explicit_stack:{false,true}){
+        Parser parser{Lexer(std::string(nested))};
+        if(explicit_stack) parser.use_explicit_stack();
+        auto recovered=parser.parse_all();
+        std::vector<std::string> found;
+        for(auto& diagnostic:recovered.diagnostics){
+            found.push_back(parser.message(diagnostic));
+        }
+        EXPECT_EQ(found,(std::vector<std::string>{
+            "couldn't parse class body : couldn't parse class body : ; expected",
+            "couldn't parse class body : ; expected",
+            "couldn't parse class body : ; expected",
+        }));
+        auto error=Parser(Lexer(std::string(nested))).parse();
+        ASSERT_FALSE(error);
+        EXPECT_EQ(found[0],dynamic_cast<ParseError*>(error.error())->_msg);
+    }
+
+    auto valid=Parser(Lexer(std::string("let a:int=1; while(a){a=a-1;};"))).parse_all();
+    EXPECT_TRUE(valid.diagnostics.empty());
+    EXPECT_EQ(valid.program.stmts.size(),2);
+}
+
+TEST(ParserTest, AstCacheRoundTrip) {
+    std::string src=
+        "fun int fib(n:int,){\n  if(n){return fib(n-1)+fib(n-2);} else {return 1;};\n};\n"
+        "class Point:Base{let x:int=3*(4+x)/2; let y:float;};\n"
+        "let s:str=\"text\"; let f:fn=lambda int (a:int,b:int,){return a*b-1.5;};\n"
+        "while(a<=b != c>d){x=f(1,2)(3) | 4&5<<1>>2; {-!false;};};\n"
+        "let big:int=9223372036854775807; fib(20);\n";
+    auto tree=Parser(Lexer(std::string(src))).parse();
+    ASSERT_TRUE(tree);
+    auto& stmts=tree.value().stmts;
+    auto path=testing::TempDir()+"round_trip.tuac";
+    std::remove(path.c_str());
+
+    // the first call parses and writes the cache, the second maps it
+    for(int run=0;run<2;run++){
+        auto cache=load_or_parse(path,src);
+        ASSERT_TRUE(cache);
+        auto ast=cache.value().view();
+        ASSERT_EQ(ast.stmts.size(),stmts.size());
+        auto program=to_program(ast);
+        ASSERT_EQ(program.stmts.size(),stmts.size());
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(dump(ast,ast.stmts[i]),dump(stmts[i]));
+            EXPECT_EQ(dump(program.stmts[i]),dump(stmts[i]));
+        }
+        // the nodes are of the types the parser makes, not just of their kind
+        std::vector<std::pair<Stmt*,Stmt*>> pending;
+        for(std::size_t i=0;i<stmts.size();i++) pending.emplace_back(program.stmts[i],stmts[i]);
+        while(!pending.empty()){
+            auto [made,parsed]=pending.back();
+            pending.pop_back();
+            ASSERT_EQ(typeid(*made),typeid(*parsed));
+            std::vector<Stmt*> made_children,parsed_children;
+            each_child(made,[&](Stmt* child){made_children.push_back(child);});
+            each_child(parsed,[&](Stmt* child){parsed_children.push_back(child);});
+            ASSERT_EQ(made_children.size(),parsed_children.size());
+            for(std::size_t i=0;i<made_children.size();i++) pending.emplace_back(made_children[i],parsed_children[i]);
+        }
+        auto loop=node_cast<WhileStmt>(program.stmts[4]);
+        ASSERT_TRUE(loop);
+        EXPECT_TRUE(node_cast<NotEq>(loop->condition_));
+        EXPECT_TRUE(dynamic_cast<NotEq*>(loop->condition_));
+        EXPECT_TRUE(dynamic_cast<LessEq*>(static_cast<BinExpr*>(loop->condition_)->left_));
+        EXPECT_EQ(ast.idents.empty(),run==0);
+    }
+
+    // writing again leaves the file a loaded cache maps alone
+    auto mapped=AstCache::load(path,source_hash(src));
+    ASSERT_TRUE(mapped);
+    auto other=Parser(Lexer(std::string("let a:int=1;"))).parse_flat();
+    ASSERT_TRUE(other);
+    ASSERT_TRUE(write_ast_cache(path,other.value(),source_hash("let a:int=1;")));
+    EXPECT_EQ(dump(mapped->view(),mapped->view().stmts[0]),dump(stmts[0]));
+    ASSERT_TRUE(load_or_parse(path,src));
+
+    // the same source gives the same file, padding included
+    auto read=[](const std::string& name){
+        std::ifstream in(name,std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in),{});
+    };
+    auto again=path+".again";
+    for(auto name:{path,again}){
+        auto flat=Parser(Lexer(std::string(src))).parse_flat();
+        ASSERT_TRUE(flat);
+        ASSERT_TRUE(write_ast_cache(name,flat.value(),source_hash(src)));
+    }
+    EXPECT_EQ(read(path),read(again));
+    std::remove(again.c_str());
+
+    // another source, another version or a truncated file all miss
+    auto hash=source_hash(src);
+    EXPECT_TRUE(AstCache::load(path,hash));
+    EXPECT_FALSE(AstCache::load(path,source_hash(src+" ")));
+    std::string file;
+    {
+        std::ifstream in(path,std::ios::binary);
+        file.assign(std::istreambuf_iterator<char>(in),{});
+    }
+    auto rewrite=[&](const std::string& text){
+        std::ofstream(path,std::ios::binary|std::ios::trunc).write(text.data(),text.size());
+    };
+    auto old_version=file;
+    old_version[4]++;
+    rewrite(old_version);
+    EXPECT_FALSE(AstCache::load(path,hash));
+    rewrite(file.substr(0,file.size()-3));
+    EXPECT_FALSE(AstCache::load(path,hash));
+    rewrite(file);
+    EXPECT_TRUE(AstCache::load(path,hash));
+    EXPECT_FALSE(AstCache::load(path+".missing",hash));
+
+    // indices out of bounds or out of order reject the file
+    auto corrupt=[&](FlatAst ast){
+        if(!write_ast_cache(path,ast,hash)) return std::string("not written");
+        auto cache=AstCache::load(path,hash);
+        return cache?std::string("loaded"):std::string(*cache.error());
+    };
+    FlatAst ast;
+    ast.add(NodeKind::Int,1);
+    ast.add(NodeKind::Return,0);
+    ast.stmts.push_back(1);
+    EXPECT_EQ(corrupt(ast),"loaded");
+    ast.nodes[1].a=1;
+    EXPECT_EQ(corrupt(ast),path+" : node 1 out of bounds");
+    ast.nodes[1]={NodeKind::Block,{},0,0,5};
+    EXPECT_EQ(corrupt(ast),path+" : node 1 out of bounds");
+    ast.nodes[1]={NodeKind::IfElse,{},0,0,NoNode};
+    EXPECT_EQ(corrupt(ast),path+" : node 1 out of bounds");
+    ast.nodes[1]={NodeKind::Str,{},2,1,0};
+    EXPECT_EQ(corrupt(ast),path+" : node 1 out of bounds");
+    ast.nodes[1]={NodeKind::Group,{},0,0,0};
+    ast.stmts[0]=2;
+    EXPECT_EQ(corrupt(ast),path+" : statement 2 out of bounds");
+    std::remove(path.c_str());
+
+    EXPECT_NE(source_hash("let a:int=1;"),source_hash("let b:int=1;"));
+    EXPECT_EQ(source_hash(src),source_hash(std::string(src)));
+    EXPECT_EQ(source_hash(std::string_view()),source_hash(""));
+    EXPECT_NE(source_hash(""),source_hash(" "));
+}
+
+TEST(ParserTest, LazyBodiesMatchEager) {
+    std::string src=
+        "fun int fib(n:int,){\n  if(n<2){return n;} else {return fib(n-1)+fib(n-2);};\n};\n"
+        "class Point:Base{let x:int=3; fun int get(){ fun int inner(){ { x; }; return x; }; return x;};};\n"
+        "let f:fn=lambda int (a:int,){ return lambda int (){ return a; }; };\n"
+        "while(a){ fun int g(){}; g(); };\n"
+        "fib(20);\n";
+    auto eager=Parser(Lexer(std::string(src))).parse();
+    ASSERT_TRUE(eager);
+    auto& expected=eager.value().stmts;
+    for(auto explicit_stack:{false,true}){
+        Parser parser{Lexer(std::string(src))};
+        parser.use_lazy_bodies();
+        if(explicit_stack) parser.use_explicit_stack();
+        auto lazy=parser.parse();
+        ASSERT_TRUE(lazy);
+        auto& stmts=lazy.value().stmts;
+        ASSERT_EQ(stmts.size(),expected.size());
+        auto fib=node_cast<FctDecl>(stmts[0]);
+        ASSERT_TRUE(fib);
+        EXPECT_EQ(fib->block_,nullptr);
+        EXPECT_EQ(fib->params_.size(),1);
+        for(std::size_t i=0;i<stmts.size();i++){
+            EXPECT_EQ(dump(stmts[i]),dump(expected[i]));
+        }
+        // parsed once
+        auto block=fib->block_;
+        EXPECT_NE(block,nullptr);
+        EXPECT_EQ(fib->body().value(),block);
+    }
+
+    // errors in a skipped body come up on first use, as parse() reports them
+    std::string bad="fun int f(){\n let a:int=1;\n return a b;\n};\nf();";
+    auto error=Parser(Lexer(std::string(bad))).parse();
+    ASSERT_FALSE(error);
+    Parser parser{Lexer(std::string(bad))};
+    parser.use_lazy_bodies();
+    auto lazy=parser.parse();
+    ASSERT_TRUE(lazy);
+    auto body=node_cast<FctDecl>(lazy.value().stmts[0])->body();
+    ASSERT_FALSE(body);
+    EXPECT_EQ(*dynamic_cast<ParseError*>(body.error()),*dynamic_cast<ParseError*>(error.error()));
+
+    // an unclosed body is still an error of parse()
+    Parser unclosed{Lexer(std::string("fun int f(){ { return 1; };"))};
+    unclosed.use_lazy_bodies();
+    EXPECT_FALSE(unclosed.parse());
+}
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "ast.h"
+#include "ast_visitor.h"
+#include "bytecode.h"
+#include "error.h"
+#include "lexer.h"
+#include "node_kind.h"
+#include "parser.h"
+#include "sema.h"
+
+using namespace tua;
+
+// the messages of the errors check_types() finds in src
+static std::vector<std::string> type_errors(const std::string& src){
+    Parser parser{Lexer(std::string(src))};
+    auto program=parser.parse();
+    if(!program){
+        return {std::string(*program.error())};
+    }
+    std::vector<std::string> messages;
+    for(auto error:check_types(program.value())) messages.emplace_back(*error);
+    return messages;
+}
+
+using Messages=std::vector<std::string>;
+
+TEST(TypeCheckTest, WellTyped) {
+    EXPECT_EQ(type_errors("let a:int=1+2*3; let b:double=a/2.0; let c:bool=a<b; let s:str=\"a\"+\"b\";"),Messages{});
+    EXPECT_EQ(type_errors("fun int fib(n:int,){ if(n<2){return n;}; return fib(n-1)+fib(n-2); }; return fib(10);"),Messages{});
+    EXPECT_EQ(type_errors("fun bool even(n:int,){ return odd(n)==false; }; fun bool odd(n:int,){ return (n&1)==1; };"),Messages{});
+    EXPECT_EQ(type_errors("let y:float=1.5; let z:double=y*2;"),Messages{});
+    EXPECT_EQ(type_errors("fun fn adder(n:int,){ return lambda int (x:int,){ return x+n; }; }; let f:fn=adder(1); let r:int=f(2);"),Messages{});
+    EXPECT_EQ(type_errors("class A{}; let a:A; x=5; let b:int=x;"),Messages{});
+}
+
+TEST(TypeCheckTest, Mismatches) {
+    EXPECT_EQ(type_errors("let a:int=1.5;"),Messages{"let a : declared int, given double"});
+    EXPECT_EQ(type_errors("let a:int=1; a=\"s\";"),Messages{"a : declared int, given str"});
+    EXPECT_EQ(type_errors("let a:bool=1+true;"),Messages{"operands of + must be numbers or strings, got int and bool"});
+    EXPECT_EQ(type_errors("let a:int=\"s\"-1;"),Messages{"operands of - must be numbers, got str and int"});
+    EXPECT_EQ(type_errors("let a:int=1.5|1;"),Messages{"operands of | must be ints, got double and int"});
+    EXPECT_EQ(type_errors("let a:bool=1<\"s\";"),Messages{"operands of < must be numbers or strings, got int and str"});
+    EXPECT_EQ(type_errors("let a:str=-\"s\";"),Messages{"operand of - must be a number, got str"});
+    EXPECT_EQ(type_errors("fun int f(n:int,){ return n>1; };"),Messages{"return : declared int, given bool in f"});
+    EXPECT_EQ(type_errors("fun int f(n:int,){ return n; }; let a:int=f(true); let b:int=f();"),
+            (Messages{"argument n of f : declared int, given bool","f takes 1 arguments, got 0"}));
+    EXPECT_EQ(type_errors("fun str f(n:int,){ return \"s\"; }; let a:int=f(1);"),Messages{"let a : declared int, given str"});
+    EXPECT_EQ(type_errors("let a:int=1; a(2);"),Messages{"can't call a int"});
+    EXPECT_EQ(type_errors("let a:integer=1; class B:C{};"),(Messages{"unknown type integer","class B : unknown class C"}));
+    EXPECT_EQ(type_errors("let f:fn=lambda int (x:int,){ return x/2.0; };"),Messages{"return : declared int, given double"});
+}
+
+TEST(TypeCheckTest, Annotates) {
+    Parser parser{Lexer(std::string("fun double f(a:int,b:float,){ let c:double=a*b; return c; }; let d:int=(1+2)*3;"))};
+    auto program=parser.parse();
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(check_types(program.value()).empty());
+    auto types=builtin_types();
+
+    auto fct=node_cast<FctDecl>(program->stmts[0]);
+    EXPECT_EQ(std::get<1>(fct->params_[1]),types.double_type);
+    auto let=node_cast<VarDeclInit>(fct->body().value()->stmts[0]);
+    auto mul=static_cast<BinExpr*>(let->value_);
+    EXPECT_EQ(mul->type,types.double_type);
+    EXPECT_EQ(mul->left_->type,types.int_type);
+    EXPECT_EQ(mul->right_->type,types.double_type);
+
+    auto d=node_cast<VarDeclInit>(program->stmts[1]);
+    EXPECT_EQ(d->value_->kind,NodeKind::Mul);
+    EXPECT_EQ(d->value_->type,types.int_type);
+    EXPECT_EQ(static_cast<BinExpr*>(d->value_)->left_->type,types.int_type);
+}
+
+// "0" a local in slot 0, "1.0" slot 0 of the function 1 out, "self" the
+// function itself, "self1" the one 1 out, "global"
+static std::string where(const Resolution& at){
+    switch(at.scope){
+        case Scope::Local: return std::to_string(at.slot);
+        case Scope::Capture: return std::to_string(at.depth)+"."+std::to_string(at.slot);
+        case Scope::Self: return "self"+(at.depth?std::to_string(at.depth):"");
+        case Scope::Global: return "global";
+        default: return "?";
+    }
+}
+
+template<typename Slots> static std::string captured(const Slots& slots){
+    std::vector<std::uint16_t> sorted(slots.begin(),slots.end());
+    std::sort(sorted.begin(),sorted.end());
+    std::string text;
+    for(auto slot:sorted) text+=(text.empty()?"":",")+std::to_string(slot);
+    return "["+text+"]";
+}
+
+// the names of src in the order they appear, with where resolve() found
+// them: "a:0", "n:1.0", "f:self"... With reads set only the reads without
+// their names, and after each function the slots captured from it
+struct Resolutions:AstVisitor<Resolutions>{
+    std::string text;
+    bool reads=false;
+
+    void add(const std::string& item){text+=(text.empty()?"":" ")+item;}
+    void add(IdentId name,const Resolution& at){
+        add(reads?where(at):std::string(ident_name(name))+":"+where(at));
+    }
+
+    void visit(Block* block){for(auto stmt:block->stmts) dispatch(stmt);}
+    void visit(ClassStmt* cls){visit(cls->block_);}
+    void visit(FctDecl* fct){
+        visit(fct->body().value());
+        if(reads) add(captured(fct->captured_));
+    }
+    void visit(VarDeclInit* var){if(var->value_) dispatch(var->value_);}
+    void visit(IfElse* ifelse){dispatch(ifelse->condition_); visit(ifelse->if_); if(ifelse->else_) visit(ifelse->else_);}
+    void visit(WhileStmt* loop){dispatch(loop->condition_); visit(loop->block_);}
+    void visit(Return* ret){dispatch(ret->value_);}
+    void visit(BinExpr* node){dispatch(node->left_); dispatch(node->right_);}
+    void visit(UnaryExpr* node){dispatch(node->expr_);}
+    void visit(Expr*){}
+    void visit(Symbol* symbol){add(symbol->ident_,symbol->resolved);}
+    void visit(Assign* assign){
+        dispatch(assign->value_);
+        if(!reads) add(assign->ident_,assign->resolved);
+    }
+    void visit(FctCall* call){dispatch(call->expr_); for(auto arg:call->exprs_) dispatch(arg);}
+    void visit(FctExpr* fct){
+        visit(fct->body().value());
+        if(reads) add(captured(fct->captured_));
+    }
+};
+
+// the reads in the code compile() made, as Resolutions with reads set
+// gives them. The code of a function is read where its Closure is
+struct CompiledReads{
+    const Module& module;
+    std::string text{};
+
+    void add(const std::string& item){text+=(text.empty()?"":" ")+item;}
+
+    // captures: where each capture of fct comes from, seen from fct
+    void function(const Function& fct,const std::vector<Resolution>& captures){
+        std::vector<std::uint16_t> locals;
+        auto code=fct.code.data();
+        for(std::size_t at=0;at<fct.code.size();){
+            auto read16=[&]{
+                auto value=code[at]|code[at+1]<<8;
+                at+=2;
+                return value;
+            };
+            switch(static_cast<OpCode>(code[at++])){
+                case OpCode::GetLocal: add(std::to_string(code[at++])); break;
+                case OpCode::GetCapture: add(where(captures[code[at++]])); break;
+                case OpCode::GetGlobal: add("global"); at+=2; break;
+                case OpCode::SetLocal:
+                case OpCode::StoreLocal:
+                case OpCode::SetCapture:
+                case OpCode::StoreCapture:
+                case OpCode::Call: at++; break;
+                case OpCode::Const:
+                case OpCode::SetGlobal:
+                case OpCode::StoreGlobal:
+                case OpCode::Jump:
+                case OpCode::JumpIfFalse:
+                case OpCode::Loop: at+=2; break;
+                case OpCode::Closure:{
+                                         auto& inner=*module.functions[read16()];
+                                         std::vector<Resolution> from;
+                                         for(int i=0;i<inner.captures;i++){
+                                             auto kind=static_cast<CaptureFrom>(code[at++]);
+                                             auto index=code[at++];
+                                             if(kind==CaptureFrom::Local){
+                                                 locals.push_back(index);
+                                                 from.push_back(Resolution{Scope::Capture,1,index});
+                                             }else if(kind==CaptureFrom::Capture){
+                                                 auto outer=captures[index];
+                                                 outer.depth++;
+                                                 from.push_back(outer);
+                                             }else{
+                                                 from.push_back(Resolution{Scope::Self,0,0});
+                                             }
+                                         }
+                                         function(inner,from);
+                                         break;
+                                     }
+                default: break;
+            }
+        }
+        std::sort(locals.begin(),locals.end());
+        locals.erase(std::unique(locals.begin(),locals.end()),locals.end());
+        add(captured(locals));
+    }
+};
+
+static std::string resolutions(Program& program){
+    Resolutions found;
+    for(auto stmt:program.stmts) found.dispatch(stmt);
+    return found.text;
+}
+
+// the resolutions of src, or its resolve() errors
+static std::string resolved(const std::string& src,bool lazy=false){
+    Parser parser{Lexer(std::string(src))};
+    if(lazy) parser.use_lazy_bodies();
+    auto program=parser.parse();
+    if(!program){
+        return std::string(*program.error());
+    }
+    auto errors=resolve(program.value());
+    if(!errors.empty()){
+        std::string text;
+        for(auto error:errors) text+=(text.empty()?"":", ")+std::string(*error);
+        return text;
+    }
+    return resolutions(program.value());
+}
+
+TEST(ResolveTest, Locals) {
+    EXPECT_EQ(resolved("fun int f(a:int,b:int,){ let c:int=a+b; { let d:int=c; d=d+1; }; { let e:int=b; return e; }; };"),
+            "a:0 b:1 c:2 d:3 d:3 b:1 e:3");
+    EXPECT_EQ(resolved("let g:int=1; { let a:int=g; a=2; }; g=3;"),"g:global a:0 g:global");
+    // the value of a let is resolved before its name is
+    EXPECT_EQ(resolved("fun int f(a:int,){ let a:int=a+1; return a; };"),"a:0 a:1");
+    EXPECT_EQ(resolved("fun int f(a:int,){ let a:int=a+1; return a; };",true),"a:0 a:1");
+}
+
+TEST(ResolveTest, Captures) {
+    Parser parser{Lexer(std::string(
+                "fun fn adder(n:int,){ let k:int=1; let unused:int=2; return lambda int (x:int,){ return x+n+k+n; }; };"))};
+    auto program=parser.parse();
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(resolve(program.value()).empty());
+    EXPECT_EQ(resolutions(program.value()),"x:0 n:1.0 k:1.1 n:1.0");
+    auto adder=node_cast<FctDecl>(program->stmts[0]);
+    EXPECT_EQ(std::vector<std::uint16_t>(adder->captured_.begin(),adder->captured_.end()),(std::vector<std::uint16_t>{0,1}));
+    auto ret=node_cast<Return>(adder->body().value()->stmts[2]);
+    EXPECT_TRUE(node_cast<FctExpr>(ret->value_)->captured_.empty());
+
+    EXPECT_EQ(resolved("fun fn f(a:int,){ return lambda fn (){ return lambda int (){ return a; }; }; };"),"a:2.0");
+    EXPECT_EQ(resolved("fun int fib(n:int,){ let g:fn=lambda int (){ return fib(n); }; return fib(n-1)+g(); };"),
+            "fib:self1 n:1.0 fib:self n:0 g:1");
+    EXPECT_EQ(resolved("fun int f(){ fun int g(){ return f()+g(); }; return g(); };"),"f:self1 g:self g:0");
+
+    Parser top{Lexer(std::string("{ let a:int=1; fun int g(){ return a; }; };"))};
+    auto script=top.parse();
+    ASSERT_TRUE(script.has_value());
+    EXPECT_TRUE(resolve(script.value()).empty());
+    EXPECT_EQ(resolutions(script.value()),"a:1.0");
+    EXPECT_EQ(script->captured,(std::vector<std::uint16_t>{0}));
+}
+
+TEST(ResolveTest, MatchesCompiler) {
+    // resolve() and compile() each find the scope of a name, they have to
+    // agree on the slots read and the ones captured
+    for(auto src:{
+            "fun int f(a:int,b:int,){ let c:int=a+b; { let d:int=c; d=d+1; }; { let e:int=b; return e; }; };",
+            "let g:int=1; { let a:int=g; a=2; }; g=3;",
+            "fun int f(a:int,){ let a:int=a+1; return a; };",
+            "fun fn adder(n:int,){ let k:int=1; let unused:int=2; return lambda int (x:int,){ return x+n+k+n; }; };",
+            "fun fn f(a:int,){ return lambda fn (){ return lambda int (){ return a; }; }; };",
+            "fun int fib(n:int,){ let g:fn=lambda int (){ return fib(n); }; return fib(n-1)+g(); };",
+            "fun int f(){ fun int g(){ return f()+g(); }; return g(); };",
+            "{ let a:int=1; fun int g(){ return a; }; };",
+            "fun int f(a:int,){ let b:int=a; while(b>0){ let c:int=b; b=c-1; }; let d:fn=lambda int (){ return a+b; }; return d(); };"}){
+        Parser parser{Lexer(std::string(src))};
+        auto program=parser.parse();
+        ASSERT_TRUE(program.has_value())<<src;
+        EXPECT_TRUE(resolve(program.value()).empty())<<src;
+        Resolutions resolver;
+        resolver.reads=true;
+        for(auto stmt:program->stmts) resolver.dispatch(stmt);
+        resolver.add(captured(program->captured));
+
+        auto module=compile(program.value());
+        ASSERT_TRUE(module.has_value())<<src;
+        CompiledReads compiled{module.value()};
+        compiled.function(*module->functions[0],{});
+        EXPECT_EQ(resolver.text,compiled.text)<<src;
+    }
+}
+
+TEST(ResolveTest, UseBeforeDeclare) {
+    EXPECT_EQ(resolved("return y;"),"y isn't declared");
+    EXPECT_EQ(resolved("fun int f(){ return y; };"),"y isn't declared in f");
+    EXPECT_EQ(resolved("return a; let a:int=1;"),"a used before its declaration");
+    EXPECT_EQ(resolved("let a:int=a;"),"a used before its declaration");
+    EXPECT_EQ(resolved("return f(); fun int f(){ return 1; };"),"f used before its declaration");
+    EXPECT_EQ(resolved("fun int f(){ { let c:int=b; }; let b:int=1; return b; };"),"b used before its declaration in f");
+    EXPECT_EQ(resolved("fun int f(){ { let b:int=1; }; return b; };"),"b isn't declared in f");
+    // globals are found when the code runs
+    EXPECT_EQ(resolved("fun int f(){ return g()+z; }; fun int g(){ return 1; }; let z:int=2;"),"g:global z:global");
+    EXPECT_EQ(resolved("x=5; return x;"),"x:global x:global");
+    EXPECT_EQ(resolved("fun int f(){ return w; }; w=1;"),"w:global w:global");
+}
+
+TEST(ResolveTest, LongExpressions) {
+    // a chain as long as ParserTest.LongExpressions, the Resolutions
+    // visitor above would recurse through it so only its ends are checked
+    const int terms=100'000;
+    std::string src="fun fn f(x:int,){ return lambda int (y:int,){ return x";
+    for(int i=1;i<terms;i++){
+        src+=(i%2?"+y":"-x");
+    }
+    src+="; }; };";
+    Parser parser{Lexer(std::string(src))};
+    auto program=parser.parse();
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(resolve(program.value()).empty());
+    auto ret=node_cast<Return>(node_cast<FctDecl>(program->stmts[0])->body().value()->stmts[0]);
+    auto lambda=node_cast<FctExpr>(ret->value_);
+    auto chain=node_cast<Return>(lambda->body().value()->stmts[0])->value_;
+    ASSERT_TRUE(is_binary(chain->kind));
+    auto last=node_cast<Symbol>(static_cast<BinExpr*>(chain)->right_);
+    EXPECT_EQ(last->resolved.scope,Scope::Local);
+    EXPECT_EQ(last->resolved.slot,0);
+    while(is_binary(chain->kind)) chain=static_cast<BinExpr*>(chain)->left_;
+    auto first=node_cast<Symbol>(chain);
+    EXPECT_EQ(first->resolved.scope,Scope::Capture);
+    EXPECT_EQ(first->resolved.depth,1);
+    EXPECT_EQ(first->resolved.slot,0);
+}
+
+TEST(TypeCheckTest, LongExpressions) {
+    // the input of ParserTest.LongExpressions with its names declared
+    const int terms=100'000;
+    std::string src="fun int f(x:int,){ return x";
+    for(int i=1;i<terms;i++){
+        src+=(i%3==0?"*x":i%3==1?"-x":"+x");
+    }
+    src+="; }; fun bool g(b:bool,){ return "+std::string(terms,'!')+"b; };";
+    Parser parser{Lexer(std::string(src))};
+    auto program=parser.parse();
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(check_types(program.value()).empty());
+    auto ret=node_cast<Return>(node_cast<FctDecl>(program->stmts[0])->body().value()->stmts[0]);
+    EXPECT_EQ(ret->value_->type,builtin_types().int_type);
+    ret=node_cast<Return>(node_cast<FctDecl>(program->stmts[1])->body().value()->stmts[0]);
+    EXPECT_EQ(ret->value_->type,builtin_types().bool_type);
+}
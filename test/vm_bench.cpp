@@ -0,0 +1,63 @@
+#include<chrono>
+#include<iostream>
+#include<string>
+
+#include "bytecode.h"
+#include "lexer.h"
+#include "parser.h"
+#include "vm.h"
+
+using namespace tua;
+
+// runs src rounds times on one VM, the parse and compile aren't timed
+static bool bench(const char* name,const std::string& src,double work,const char* unit,int rounds=3){
+    auto program=Parser(Lexer(std::string(src))).parse();
+    if(!program){
+        std::cerr<<std::string(*program.error())<<std::endl;
+        return false;
+    }
+    auto module=compile(program.value());
+    if(!module){
+        std::cerr<<std::string(*module.error())<<std::endl;
+        return false;
+    }
+    VM vm;
+    double ns=0;
+    std::string result;
+    for(int round=0;round<rounds;round++){
+        auto start=std::chrono::steady_clock::now();
+        auto value=vm.run(module.value());
+        ns+=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+        if(!value){
+            std::cerr<<std::string(*value.error())<<std::endl;
+            return false;
+        }
+        result=to_string(value.value());
+    }
+    std::cout<<name<<" : "<<ns/rounds/1e6<<" ms, "<<ns/rounds/work<<" ns/"<<unit<<" ("<<result.size()<<" chars result)"<<std::endl;
+    return true;
+}
+
+int main(){
+    // 1664079 calls
+    auto fib=bench("fib(30)",
+            "fun int fib(n:int,){ if(n<2){return n;}; return fib(n-1)+fib(n-2); };\n"
+            "return fib(30);",1664079,"call");
+    auto loop=bench("while 10M",
+            "let i:int=0; let sum:int=0;\n"
+            "{ let j:int=0; let acc:int=0; while(j<10000000){ acc=acc+(j&7)*3-1; j=j+1; }; sum=acc; };\n"
+            "return sum;",1e7,"iteration");
+    auto strings=bench("string building",
+            "fun str build(n:int,){\n"
+            "  let s:str=\"\"; let line:str=\"\"; let i:int=0;\n"
+            "  while(i<n){ line=\"item \"+\"x\"; s=s+line; i=i+1; };\n"
+            "  return s;\n"
+            "};\n"
+            "return build(20000);",20000,"append");
+    auto closures=bench("closure calls",
+            "fun fn adder(n:int,){ return lambda int (x:int,){ return x+n; }; };\n"
+            "fun int run(){ let add:fn=adder(1); let i:int=0; let acc:int=0;\n"
+            "  while(i<1000000){ acc=add(acc); i=i+1; }; return acc; };\n"
+            "return run();",1e6,"call");
+    return fib && loop && strings && closures?0:1;
+}
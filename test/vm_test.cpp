@@ -0,0 +1,156 @@
+#include <string>
+#include <gtest/gtest.h>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "lexer.h"
+#include "parser.h"
+#include "error.h"
+#include "value.h"
+#include "vm.h"
+
+using namespace tua;
+
+// the value the program returns or the text of its error
+static std::string run(const std::string& src,bool lazy=false){
+    Parser parser{Lexer(std::string(src))};
+    if(lazy) parser.use_lazy_bodies();
+    auto program=parser.parse();
+    if(!program){
+        return std::string(*program.error());
+    }
+    auto module=compile(program.value());
+    if(!module){
+        return std::string(*module.error());
+    }
+    VM vm;
+    auto value=vm.run(module.value());
+    if(!value){
+        return std::string(*value.error());
+    }
+    return to_string(value.value());
+}
+
+TEST(VmTest, Arithmetic) {
+    EXPECT_EQ(run("return 1+2*3-4/2;"),"5");
+    EXPECT_EQ(run("return (1+2)*3;"),"9");
+    EXPECT_EQ(run("return 7/2;"),"3");
+    EXPECT_EQ(run("return 7.0/2;"),"3.5");
+    EXPECT_EQ(run("return -3+1.5;"),"-1.5");
+    EXPECT_EQ(run("return 6|1&3<<1>>1;"),"7");
+    EXPECT_EQ(run("return 9223372036854775807+1;"),"-9223372036854775808");
+    EXPECT_EQ(run("return 1<2 != 2<=1;"),"true");
+    EXPECT_EQ(run("return !0;"),"true");
+    EXPECT_EQ(run("return 2==2.0;"),"true");
+    EXPECT_EQ(run("let a:int=1;"),"nil");
+}
+
+TEST(VmTest, Variables) {
+    EXPECT_EQ(run("let a:int=1; a=a+1; return a;"),"2");
+    EXPECT_EQ(run("let a:int=1; { let a:int=10; a=a+1; }; return a;"),"1");
+    EXPECT_EQ(run("let a:int=1; { let b:int=a+1; { let c:int=b*3; a=c; }; }; return a;"),"6");
+    EXPECT_EQ(run("let a:int; return a;"),"nil");
+    EXPECT_EQ(run("x=5; return x;"),"5");
+}
+
+TEST(VmTest, ControlFlow) {
+    EXPECT_EQ(run("let a:int=0; if(1<2){a=1;} else {a=2;}; return a;"),"1");
+    EXPECT_EQ(run("let a:int=0; if(false){a=1;} else {a=2;}; return a;"),"2");
+    EXPECT_EQ(run("let a:int=0; if(false){a=1;}; return a;"),"0");
+    EXPECT_EQ(run("let i:int=0; let sum:int=0; while(i<100){sum=sum+i; i=i+1;}; return sum;"),"4950");
+    EXPECT_EQ(run("let i:int=10; while(i){ if(i==4){return i;}; i=i-1; }; return 0;"),"4");
+}
+
+TEST(VmTest, Functions) {
+    std::string fib=
+        "fun int fib(n:int,){ if(n<2){return n;}; return fib(n-1)+fib(n-2); };\n"
+        "return fib(20);";
+    EXPECT_EQ(run(fib),"6765");
+    EXPECT_EQ(run(fib,true),"6765");
+    EXPECT_EQ(run("fun int add(a:int,b:int,){ return a+b; }; return add(2,add(3,4));"),"9");
+    EXPECT_EQ(run("fun int none(){ let a:int=1; }; return none();"),"nil");
+    // the global is looked up when the call runs
+    EXPECT_EQ(run("fun int f(){ return g(); }; fun int g(){ return 3; }; return f();"),"3");
+    EXPECT_EQ(run("fun int f(){ return 1; }; return f;"),"<fun f>");
+}
+
+TEST(VmTest, Closures) {
+    EXPECT_EQ(run("let k:int=3; let f:fn=lambda int (x:int,){return x*k;}; return f(5);"),"15");
+    EXPECT_EQ(run(
+        "fun fn adder(n:int,){ return lambda int (x:int,){ return x+n; }; };\n"
+        "let add2:fn=adder(2); let add5:fn=adder(5);\n"
+        "return add2(1)*10+add5(1);"),"36");
+    // values are copied when the closure is made
+    EXPECT_EQ(run(
+        "fun int f(){ let a:int=1; let g:fn=lambda int (){ a=a+1; return a; }; g(); a=10; return g()+a; };\n"
+        "return f();"),"13");
+    // captures through two levels and a nested function calling itself
+    EXPECT_EQ(run(
+        "fun int outer(n:int,){\n"
+        "  fun int count(i:int,){ if(i<n){ return count(i+1); }; return i; };\n"
+        "  let f:fn=lambda int (){ return lambda int (){ return count(0); }; };\n"
+        "  return f()();\n"
+        "};\n"
+        "return outer(7);"),"7");
+}
+
+TEST(VmTest, Strings) {
+    EXPECT_EQ(run("let s:str=\"ab\"; return s+\"cd\";"),"abcd");
+    EXPECT_EQ(run("return \"abc\"<\"abd\";"),"true");
+    EXPECT_EQ(run("return \"abc\"==\"ab\"+\"c\";"),"true");
+    // enough garbage for several collections, the live string survives
+    EXPECT_EQ(run(
+        "let s:str=\"\"; let i:int=0;\n"
+        "while(i<3000){ s=s+\"x\"; let t:str=s+s; i=i+1; };\n"
+        "let n:int=0; let j:int=0; while(j<10){ n=n+1; j=j+1; };\n"
+        "return s==s+\"\";"),"true");
+}
+
+TEST(VmTest, Errors) {
+    EXPECT_EQ(run("return y;"),"y isn't defined");
+    EXPECT_EQ(run("fun int f(){ return 1/0; }; return f();"),"division by zero in f");
+    EXPECT_EQ(run("return 1+\"a\";"),"operands of + must be numbers");
+    EXPECT_EQ(run("return 1.5|2;"),"operands of | must be ints");
+    EXPECT_EQ(run("let a:int=1; return a(2);"),"can't call a 1");
+    EXPECT_EQ(run("fun int f(a:int,){ return a; }; return f();"),"<fun f> takes 1 arguments, got 0");
+    EXPECT_EQ(run("fun int f(n:int,){ return f(n+1); }; return f(0);"),"stack overflow in f");
+    EXPECT_EQ(run("class A{};"),"class A : classes can't be compiled yet");
+    // a lazy body that doesn't parse fails the compile
+    EXPECT_EQ(run("fun int f(){ return 1 2; }; return 0;",true),"; expected : 0");
+}
+
+TEST(VmTest, RunsAgain) {
+    Parser parser{Lexer(std::string("let s:str=\"a\"; let i:int=0; while(i<10){ s=s+s; i=i+1; }; return s;"))};
+    auto program=parser.parse();
+    ASSERT_TRUE(program);
+    auto module=compile(program.value());
+    ASSERT_TRUE(module);
+    VM vm;
+    for(int i=0;i<3;i++){
+        auto value=vm.run(module.value());
+        ASSERT_TRUE(value);
+        EXPECT_EQ(value.value().str().size(),1024);
+    }
+}
+
+TEST(VmTest, LongExpressions) {
+    // the input of ParserTest.LongExpressions, x being 3
+    const int terms=100'000;
+    const std::int64_t x=3;
+    std::string src="let x:int=3; return x";
+    std::int64_t sum=0;
+    std::int64_t term=x;
+    for(int i=1;i<terms;i++){
+        src+=(i%3==0?"*x":i%3==1?"-x":"+x");
+        if(i%3==0){
+            term*=x;
+        }else{
+            sum+=term;
+            term=i%3==1?-x:x;
+        }
+    }
+    src+=";";
+    EXPECT_EQ(run(src),std::to_string(sum+term));
+    EXPECT_EQ(run("return "+std::string(terms,'!')+"true;"),"true");
+    EXPECT_EQ(run("return "+std::string(terms+1,'!')+"true;"),"false");
+}